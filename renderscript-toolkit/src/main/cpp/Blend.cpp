@@ -16,6 +16,7 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 
 #include "RenderScriptToolkit.h"
 #include "TaskProcessor.h"
@@ -43,6 +44,9 @@ class BlendTask : public Task {
                      size_t endY) override;
 
    public:
+    const char* name() const override { return "blend"; }
+    const void* dataOfRow(size_t y) const override { return mIn + mSizeX * y; }
+
     BlendTask(RenderScriptToolkit::BlendingMode mode, const uint8_t* in, uint8_t* out, size_t sizeX,
               size_t sizeY, const Restriction* restriction)
         : Task{sizeX, sizeY, 4, true, restriction},
@@ -56,21 +60,6 @@ extern "C" int rsdIntrinsicBlend_K(uchar4 *out, uchar4 const *in, int slot,
                     uint32_t xstart, uint32_t xend);
 #endif
 
-#if defined(ARCH_X86_HAVE_SSSE3)
-extern void rsdIntrinsicBlendSrcOver_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendDstOver_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendSrcIn_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendDstIn_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendSrcOut_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendDstOut_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendSrcAtop_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendDstAtop_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendXor_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendMultiply_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendAdd_K(void *dst, const void *src, uint32_t count8);
-extern void rsdIntrinsicBlendSub_K(void *dst, const void *src, uint32_t count8);
-#endif
-
 // Convert vector to uchar4, clipping each value to 255.
 template <typename TI>
 static inline uchar4 convertClipped(TI amount) {
@@ -80,6 +69,57 @@ static inline uchar4 convertClipped(TI amount) {
                     static_cast<uchar>(amount.w > 255 ? 255 : amount.w)};
 }
 
+// The block types below are wider than the vector registers of some targets, which changes how
+// they would be passed between translation units. They're only passed to the inline functions of
+// this file, so that doesn't matter.
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpsabi"
+
+// The generic code blends blocks of kBlockSize pixels at once, with one channel per lane.
+constexpr uint32_t kBlockSize = 8;
+typedef uchar ucharBlock __attribute__((ext_vector_type(32)));
+typedef ushort ushortBlock __attribute__((ext_vector_type(32)));
+typedef uint uintBlock __attribute__((ext_vector_type(32)));
+
+// Returns a block where each lane contains the alpha of its pixel.
+template <typename T>
+static inline T alphaOf(T v) {
+    return __builtin_shufflevector(v, v, 3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15,
+                                   19, 19, 19, 19, 23, 23, 23, 23, 27, 27, 27, 27, 31, 31, 31, 31);
+}
+
+// Returns the red, green, and blue of rgb with the alpha of a.
+template <typename T>
+static inline T withAlphaOf(T rgb, T a) {
+    return __builtin_shufflevector(rgb, a, 0, 1, 2, 35, 4, 5, 6, 39, 8, 9, 10, 43, 12, 13, 14, 47,
+                                   16, 17, 18, 51, 20, 21, 22, 55, 24, 25, 26, 59, 28, 29, 30, 63);
+}
+
+// Convert a block to uchar, clipping each value to 255.
+template <typename TI>
+static inline ucharBlock convertClippedBlock(TI amount) {
+    return convert<ucharBlock>(amount > 255 ? (TI)255 : amount);
+}
+
+/**
+ * Blends the pixels from x1 to x2 in blocks of kBlockSize, and advances in, out, and x1 past
+ * the pixels it blended. The caller blends the remaining pixels one at a time.
+ *
+ * @param op Computes the blended block from the source and the destination blocks.
+ */
+template <typename Op>
+static inline void blendBlocks(const uchar4*& in, uchar4*& out, uint32_t& x1, uint32_t x2,
+                               Op op) {
+    for (; x1 + kBlockSize <= x2; x1 += kBlockSize, in += kBlockSize, out += kBlockSize) {
+        ucharBlock src;
+        ucharBlock dst;
+        memcpy(&src, in, sizeof(src));
+        memcpy(&dst, out, sizeof(dst));
+        dst = op(src, dst);
+        memcpy(out, &dst, sizeof(dst));
+    }
+}
+
 void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in, uchar4* out,
                       uint32_t length) {
     uint32_t x1 = 0;
@@ -96,6 +136,17 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
      }
     }
 #endif
+    // The SIMD kernels handle groups of eight pixels. The remainder is done below.
+    if (static_cast<int>(mode) < kNumberOfBlendKernels) {
+        auto kernel = mKernels->blend[static_cast<int>(mode)];
+        if (kernel != nullptr && (x1 + 8) < x2) {
+            uint32_t len = (x2 - x1) >> 3;
+            kernel(out, in, len);
+            x1 += len << 3;
+            out += len << 3;
+            in += len << 3;
+        }
+    }
     switch (mode) {
     case RenderScriptToolkit::BlendingMode::CLEAR:
         for (;x1 < x2; x1++, out++) {
@@ -111,17 +162,11 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
     case RenderScriptToolkit::BlendingMode::DST:
         break;
     case RenderScriptToolkit::BlendingMode::SRC_OVER:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendSrcOver_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-    #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            ushortBlock in_s = convert<ushortBlock>(src);
+            ushortBlock out_s = convert<ushortBlock>(dst);
+            return convertClippedBlock(in_s + ((out_s * (255 - alphaOf(in_s))) >> 8));
+        });
         for (;x1 < x2; x1++, out++, in++) {
             ushort4 in_s = convert<ushort4>(*in);
             ushort4 out_s = convert<ushort4>(*out);
@@ -130,17 +175,11 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
         }
         break;
     case RenderScriptToolkit::BlendingMode::DST_OVER:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendDstOver_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-     #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            ushortBlock in_s = convert<ushortBlock>(src);
+            ushortBlock out_s = convert<ushortBlock>(dst);
+            return convertClippedBlock(out_s + ((in_s * (255 - alphaOf(out_s))) >> 8));
+        });
         for (;x1 < x2; x1++, out++, in++) {
             ushort4 in_s = convert<ushort4>(*in);
             ushort4 out_s = convert<ushort4>(*out);
@@ -149,17 +188,10 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
         }
         break;
     case RenderScriptToolkit::BlendingMode::SRC_IN:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendSrcIn_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-#endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            ushortBlock in_s = convert<ushortBlock>(src);
+            return convert<ucharBlock>((in_s * alphaOf(convert<ushortBlock>(dst))) >> 8);
+        });
         for (;x1 < x2; x1++, out++, in++) {
             ushort4 in_s = convert<ushort4>(*in);
             in_s = (in_s * out->w) >> (ushort4)8;
@@ -167,17 +199,10 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
         }
         break;
     case RenderScriptToolkit::BlendingMode::DST_IN:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendDstIn_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-     #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            ushortBlock out_s = convert<ushortBlock>(dst);
+            return convert<ucharBlock>((out_s * alphaOf(convert<ushortBlock>(src))) >> 8);
+        });
         for (;x1 < x2; x1++, out++, in++) {
             ushort4 out_s = convert<ushort4>(*out);
             out_s = (out_s * in->w) >> (ushort4)8;
@@ -185,17 +210,10 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
         }
         break;
     case RenderScriptToolkit::BlendingMode::SRC_OUT:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendSrcOut_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-    #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            ushortBlock in_s = convert<ushortBlock>(src);
+            return convert<ucharBlock>((in_s * (255 - alphaOf(convert<ushortBlock>(dst)))) >> 8);
+        });
         for (;x1 < x2; x1++, out++, in++) {
             ushort4 in_s = convert<ushort4>(*in);
             in_s = (in_s * (ushort4)(255 - out->w)) >> (ushort4)8;
@@ -203,17 +221,10 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
         }
         break;
     case RenderScriptToolkit::BlendingMode::DST_OUT:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendDstOut_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-    #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            ushortBlock out_s = convert<ushortBlock>(dst);
+            return convert<ucharBlock>((out_s * (255 - alphaOf(convert<ushortBlock>(src)))) >> 8);
+        });
         for (;x1 < x2; x1++, out++, in++) {
             ushort4 out_s = convert<ushort4>(*out);
             out_s = (out_s * (ushort4)(255 - in->w)) >> (ushort4)8;
@@ -221,17 +232,12 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
         }
         break;
     case RenderScriptToolkit::BlendingMode::SRC_ATOP:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendSrcAtop_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-    #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            uintBlock in_s = convert<uintBlock>(src);
+            uintBlock out_s = convert<uintBlock>(dst);
+            uintBlock rgb = ((in_s * alphaOf(out_s)) + (out_s * (255 - alphaOf(in_s)))) >> 8;
+            return convertClippedBlock(withAlphaOf(rgb, out_s));
+        });
         for (;x1 < x2; x1++, out++, in++) {
             // The max value the operation could produce before the shift
             // is 255 * 255 + 255 * (255 - 0) = 130050, or 0x1FC02.
@@ -244,17 +250,12 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
         }
         break;
     case RenderScriptToolkit::BlendingMode::DST_ATOP:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendDstAtop_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-     #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            uintBlock in_s = convert<uintBlock>(src);
+            uintBlock out_s = convert<uintBlock>(dst);
+            uintBlock rgb = ((out_s * alphaOf(in_s)) + (in_s * (255 - alphaOf(out_s)))) >> 8;
+            return convertClippedBlock(withAlphaOf(rgb, in_s));
+        });
         for (;x1 < x2; x1++, out++, in++) {
             uint4 in_s = convert<uint4>(*in);
             uint4 out_s = convert<uint4>(*out);
@@ -265,50 +266,24 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
         }
         break;
     case RenderScriptToolkit::BlendingMode::XOR:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendXor_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-    #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) { return src ^ dst; });
         for (;x1 < x2; x1++, out++, in++) {
             *out = *in ^ *out;
         }
         break;
     case RenderScriptToolkit::BlendingMode::MULTIPLY:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if ((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendMultiply_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-    #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            return convert<ucharBlock>((convert<ushortBlock>(src) * convert<ushortBlock>(dst)) >> 8);
+        });
         for (;x1 < x2; x1++, out++, in++) {
           *out = convert<uchar4>((convert<ushort4>(*in) * convert<ushort4>(*out))
                                 >> (ushort4)8);
         }
         break;
     case RenderScriptToolkit::BlendingMode::ADD:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendAdd_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-    #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            return convertClippedBlock(convert<ushortBlock>(dst) + convert<ushortBlock>(src));
+        });
         for (;x1 < x2; x1++, out++, in++) {
             uint32_t iR = in->x, iG = in->y, iB = in->z, iA = in->w,
                 oR = out->x, oG = out->y, oB = out->z, oA = out->w;
@@ -319,17 +294,9 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
         }
         break;
     case RenderScriptToolkit::BlendingMode::SUBTRACT:
-    #if defined(ARCH_X86_HAVE_SSSE3)
-        if (mUsesSimd) {
-            if((x1 + 8) < x2) {
-                uint32_t len = (x2 - x1) >> 3;
-                rsdIntrinsicBlendSub_K(out, in, len);
-                x1 += len << 3;
-                out += len << 3;
-                in += len << 3;
-            }
-        }
-    #endif
+        blendBlocks(in, out, x1, x2, [](ucharBlock src, ucharBlock dst) {
+            return dst > src ? dst - src : (ucharBlock)0;
+        });
         for (;x1 < x2; x1++, out++, in++) {
             int32_t iR = in->x, iG = in->y, iB = in->z, iA = in->w,
                 oR = out->x, oG = out->y, oB = out->z, oA = out->w;
@@ -370,7 +337,7 @@ void BlendTask::blend(RenderScriptToolkit::BlendingMode mode, const uchar4* in,
     }
 }
 
-
+#pragma clang diagnostic pop
 
 void BlendTask::processData(int /* threadIndex */, size_t startX, size_t startY, size_t endX,
                             size_t endY) {
@@ -380,16 +347,35 @@ void BlendTask::processData(int /* threadIndex */, size_t startX, size_t startY,
     }
 }
 
-void RenderScriptToolkit::blend(BlendingMode mode, const uint8_t* in, uint8_t* out, size_t sizeX,
-                                size_t sizeY, const Restriction* restriction) {
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::blend(BlendingMode mode, const uint8_t* in,
+                                                           uint8_t* out, size_t sizeX, size_t sizeY,
+                                                           const Restriction* restriction,
+                                                           const TaskOptions* options) {
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
     if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
-        return;
+        return TaskStatus::INVALID_ARGUMENTS;
     }
 #endif
 
     BlendTask task(mode, in, out, sizeX, sizeY, restriction);
-    processor->doTask(&task);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::blendAsync(BlendingMode mode,
+                                                                const uint8_t* in, uint8_t* out,
+                                                                size_t sizeX, size_t sizeY,
+                                                                const Restriction* restriction,
+                                                                Callback callback,
+                                                                const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
+        return TaskHandle();
+    }
+#endif
+
+    return TaskHandle(processor->startTask(
+            std::make_unique<BlendTask>(mode, in, out, sizeX, sizeY, restriction),
+            std::move(callback), options));
 }
 
 }  // namespace google::android::renderscript
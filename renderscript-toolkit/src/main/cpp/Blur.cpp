@@ -16,6 +16,7 @@
 
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 
 #include "RenderScriptToolkit.h"
 #include "TaskProcessor.h"
@@ -37,6 +38,7 @@ class BlurTask : public Task {
     uchar* outArray;
     // The size of the kernel radius is limited to 25 in ScriptIntrinsicBlur.java.
     // So, the max kernel size is 51 (= 2 * 25 + 1).
+    static constexpr int kMaxDiameter = 51;
     // Considering SSSE3 case, which requires the size is multiple of 4,
     // at least 52 words are necessary. Values outside of the kernel should be 0.
     float mFp[104];
@@ -58,22 +60,38 @@ class BlurTask : public Task {
     void kernelU1(void* outPtr, uint32_t xstart, uint32_t xend, uint32_t currentY);
     void ComputeGaussianWeights();
 
+    // The cells before this one are at least the radius away from the right edge, so their
+    // horizontal blur doesn't need clamping.
+    uint32_t unclampedLimit() const {
+        return mSizeX > (size_t)mIradius ? mSizeX - mIradius : 0;
+    }
+
     // Process a 2D tile of the overall work. threadIndex identifies which thread does the work.
     void processData(int threadIndex, size_t startX, size_t startY, size_t endX,
                      size_t endY) override;
 
    public:
+    const char* name() const override { return "blur"; }
+    // A vertical and an horizontal pass over the diameter.
+    size_t costPerCell() const override { return mVectorSize * 2 * (2 * mIradius + 1); }
+    // The vertical pass of each row reads the rows within the radius.
+    size_t preferredMinTileRows() const override { return 2 * mIradius + 1; }
+    const void* dataOfRow(size_t y) const override { return mIn + mSizeX * y * mVectorSize; }
+
     BlurTask(const uint8_t* in, uint8_t* out, size_t sizeX, size_t sizeY, size_t vectorSize,
-             uint32_t threadCount, float radius, const Restriction* restriction)
+             float radius, const Restriction* restriction)
         : Task{sizeX, sizeY, vectorSize, false, restriction},
           mIn{in},
           outArray{out},
-          mScratch{threadCount},
-          mScratchSize{threadCount},
           mRadius{std::min(25.0f, radius)} {
         ComputeGaussianWeights();
     }
 
+    void allocateThreadStorage(unsigned int numberOfThreads) override {
+        mScratch.resize(numberOfThreads, nullptr);
+        mScratchSize.resize(numberOfThreads, 0);
+    }
+
     ~BlurTask() {
         for (size_t i = 0; i < mScratch.size(); i++) {
             if (mScratch[i]) {
@@ -125,79 +143,112 @@ void BlurTask::ComputeGaussianWeights() {
     }
 }
 
+// The size of the blocks of cells computed together by the generic code.
+constexpr int kBlockSizeU4 = 8;
+constexpr int kBlockSizeU1 = 16;
+
 /**
- * Vertical blur of a uchar4 line.
+ * Finds the input rows needed to blur the line y, clamping them to the image.
  *
- * @param sizeY Number of cells of the input array in the vertical direction.
- * @param out Where to place the computed value.
- * @param x Coordinate of the point we're blurring.
- * @param y Coordinate of the point we're blurring.
+ * @param rows Where to store the row of each coefficient. Must have 2 * iradius + 1 entries.
  * @param ptrIn Start of the input array.
+ * @param y The index of the line we're blurring.
+ * @param sizeY Number of cells of the input array in the vertical direction.
  * @param iStride The size in byte of a row of the input array.
- * @param gPtr The gaussian coefficients.
  * @param iradius The radius of the blur.
  */
-static void OneVU4(uint32_t sizeY, float4* out, int32_t x, int32_t y, const uchar* ptrIn,
-                   int iStride, const float* gPtr, int iradius) {
-    const uchar *pi = ptrIn + x*4;
-
-    float4 blurredPixel = 0;
-    for (int r = -iradius; r <= iradius; r ++) {
+static void clampedRows(const uchar** rows, const uchar* ptrIn, int y, uint32_t sizeY,
+                        int iStride, int iradius) {
+    for (int r = -iradius; r <= iradius; r++) {
         int validY = std::max((y + r), 0);
         validY = std::min(validY, (int)(sizeY - 1));
-        const uchar4 *pvy = (const uchar4 *)&pi[validY * iStride];
-        float4 pf = convert<float4>(pvy[0]);
-        blurredPixel += pf * gPtr[0];
-        gPtr++;
+        rows[r + iradius] = ptrIn + validY * iStride;
     }
-
-    out[0] = blurredPixel;
 }
 
 /**
- * Vertical blur of a uchar1 line.
+ * Vertical blur of a line, without SIMD kernels. This is used for uchar and uchar4 cells.
  *
- * @param sizeY Number of cells of the input array in the vertical direction.
- * @param out Where to place the computed value.
- * @param x Coordinate of the point we're blurring.
- * @param y Coordinate of the point we're blurring.
- * @param ptrIn Start of the input array.
- * @param iStride The size in byte of a row of the input array.
+ * The cells are computed in blocks so that each input row is read sequentially and the sums
+ * stay in registers. The sums are done in the same order as the other generic code.
+ *
+ * @tparam InputType Type of the input cells, e.g. uchar4.
+ * @tparam ComputationType Type of the output cells, e.g. float4.
+ * @tparam kBlockSize How many cells to compute together.
+ * @param out Where to store the results. This is the input to the horizontal blur.
+ * @param rows The input row of each coefficient, see clampedRows().
  * @param gPtr The gaussian coefficients.
- * @param iradius The radius of the blur.
+ * @param ct The diameter of the blur.
+ * @param count How many cells to blur.
  */
-static void OneVU1(uint32_t sizeY, float *out, int32_t x, int32_t y,
-                   const uchar *ptrIn, int iStride, const float* gPtr, int iradius) {
-
-    const uchar *pi = ptrIn + x;
-
-    float blurredPixel = 0;
-    for (int r = -iradius; r <= iradius; r ++) {
-        int validY = std::max((y + r), 0);
-        validY = std::min(validY, (int)(sizeY - 1));
-        float pf = (float)pi[validY * iStride];
-        blurredPixel += pf * gPtr[0];
-        gPtr++;
+template <typename InputType, typename ComputationType, int kBlockSize>
+static void blurVertical(ComputationType* out, const uchar* const* rows, const float* gPtr,
+                         int ct, int count) {
+    int x = 0;
+    for (; x + kBlockSize <= count; x += kBlockSize) {
+        ComputationType sum[kBlockSize] = {};
+        for (int r = 0; r < ct; r++) {
+            const InputType* pi = (const InputType*)rows[r] + x;
+            for (int i = 0; i < kBlockSize; i++) {
+                sum[i] += convert<ComputationType>(pi[i]) * gPtr[r];
+            }
+        }
+        for (int i = 0; i < kBlockSize; i++) {
+            out[x + i] = sum[i];
+        }
+    }
+    for (; x < count; x++) {
+        ComputationType sum = 0;
+        for (int r = 0; r < ct; r++) {
+            sum += convert<ComputationType>(((const InputType*)rows[r])[x]) * gPtr[r];
+        }
+        out[x] = sum;
     }
-
-    out[0] = blurredPixel;
 }
 
+/**
+ * Horizontal blur of cells that are at least the radius away from both sides of the line, so
+ * no clamping is needed. This is used for uchar and uchar4 cells.
+ *
+ * @tparam OutputType Type of the output cells, e.g. uchar4.
+ * @tparam ComputationType Type of the input cells, e.g. float4.
+ * @tparam kBlockSize How many cells to compute together.
+ * @param out Where to place the computed values.
+ * @param ptrIn The input cell at the radius left of the first cell we're blurring.
+ * @param gPtr The gaussian coefficients.
+ * @param ct The diameter of the blur.
+ * @param count How many cells to blur.
+ */
+template <typename OutputType, typename ComputationType, int kBlockSize>
+static void blurHorizontal(OutputType* out, const ComputationType* ptrIn, const float* gPtr,
+                           int ct, int count) {
+    int x = 0;
+    for (; x + kBlockSize <= count; x += kBlockSize) {
+        ComputationType sum[kBlockSize] = {};
+        for (int r = 0; r < ct; r++) {
+            const ComputationType* pi = ptrIn + x + r;
+            for (int i = 0; i < kBlockSize; i++) {
+                sum[i] += pi[i] * gPtr[r];
+            }
+        }
+        for (int i = 0; i < kBlockSize; i++) {
+            out[x + i] = convert<OutputType>(sum[i]);
+        }
+    }
+    for (; x < count; x++) {
+        ComputationType sum = 0;
+        for (int r = 0; r < ct; r++) {
+            sum += ptrIn[x + r] * gPtr[r];
+        }
+        out[x] = convert<OutputType>(sum);
+    }
+}
 
 extern "C" void rsdIntrinsicBlurU1_K(uchar *out, uchar const *in, size_t w, size_t h,
                  size_t p, size_t x, size_t y, size_t count, size_t r, uint16_t const *tab);
 extern "C" void rsdIntrinsicBlurU4_K(uchar4 *out, uchar4 const *in, size_t w, size_t h,
                  size_t p, size_t x, size_t y, size_t count, size_t r, uint16_t const *tab);
 
-#if defined(ARCH_X86_HAVE_SSSE3)
-extern void rsdIntrinsicBlurVFU4_K(void *dst, const void *pin, int stride, const void *gptr,
-                                   int rct, int x1, int ct);
-extern void rsdIntrinsicBlurHFU4_K(void *dst, const void *pin, const void *gptr, int rct, int x1,
-                                   int ct);
-extern void rsdIntrinsicBlurHFU1_K(void *dst, const void *pin, const void *gptr, int rct, int x1,
-                                   int ct);
-#endif
-
 /**
  * Vertical blur of a line of RGBA, knowing that there's enough rows above and below us to avoid
  * dealing with boundary conditions.
@@ -208,25 +259,21 @@ extern void rsdIntrinsicBlurHFU1_K(void *dst, const void *pin, const void *gptr,
  * @param gPtr The gaussian coefficients.
  * @param ct The diameter of the blur.
  * @param len How many cells to blur.
- * @param usesSimd Whether this processor supports SIMD.
+ * @param kernels The SIMD kernels to use.
  */
 static void OneVFU4(float4 *out, const uchar *ptrIn, int iStride, const float* gPtr, int ct,
-                    int x2, bool usesSimd) {
+                    int x2, const KernelTable* kernels) {
     int x1 = 0;
-#if defined(ARCH_X86_HAVE_SSSE3)
-    if (usesSimd) {
+    if (kernels->blurVFU4 != nullptr) {
         int t = (x2 - x1);
         t &= ~1;
         if (t) {
-            rsdIntrinsicBlurVFU4_K(out, ptrIn, iStride, gPtr, ct, x1, x1 + t);
+            kernels->blurVFU4(out, ptrIn, iStride, gPtr, ct, x1, x1 + t);
         }
         x1 += t;
         out += t;
         ptrIn += t << 2;
     }
-#else
-    (void) usesSimd; // Avoid unused parameter warning.
-#endif
     while(x2 > x1) {
         const uchar *pi = ptrIn;
         float4 blurredPixel = 0;
@@ -255,10 +302,10 @@ static void OneVFU4(float4 *out, const uchar *ptrIn, int iStride, const float* g
  * @param gPtr The gaussian coefficients.
  * @param ct The diameter of the blur.
  * @param len How many cells to blur.
- * @param usesSimd Whether this processor supports SIMD.
+ * @param kernels The SIMD kernels to use.
  */
 static void OneVFU1(float* out, const uchar* ptrIn, int iStride, const float* gPtr, int ct, int len,
-                    bool usesSimd) {
+                    const KernelTable* kernels) {
     int x1 = 0;
 
     while((len > x1) && (((uintptr_t)ptrIn) & 0x3)) {
@@ -278,20 +325,16 @@ static void OneVFU1(float* out, const uchar* ptrIn, int iStride, const float* gP
         ptrIn++;
         len--;
     }
-#if defined(ARCH_X86_HAVE_SSSE3)
-    if (usesSimd && (len > x1)) {
+    if (kernels->blurVFU4 != nullptr && (len > x1)) {
         int t = (len - x1) >> 2;
         t &= ~1;
         if (t) {
-            rsdIntrinsicBlurVFU4_K(out, ptrIn, iStride, gPtr, ct, 0, t );
+            kernels->blurVFU4(out, ptrIn, iStride, gPtr, ct, 0, t);
             len -= t << 2;
             ptrIn += t << 2;
             out += t << 2;
         }
     }
-#else
-    (void) usesSimd; // Avoid unused parameter warning.
-#endif
     while(len > 0) {
         const uchar *pi = ptrIn;
         float blurredPixel = 0;
@@ -397,16 +440,13 @@ void BlurTask::kernelU4(void *outPtr, uint32_t xstart, uint32_t xend, uint32_t c
     }
     float4 *fout = (float4 *)buf;
     int y = currentY;
-    if ((y > mIradius) && (y < ((int)mSizeY - mIradius))) {
+    if ((y > mIradius) && (y < ((int)mSizeY - mIradius)) && mKernels->blurVFU4 != nullptr) {
         const uchar *pi = mIn + (y - mIradius) * stride;
-        OneVFU4(fout, pi, stride, mFp, mIradius * 2 + 1, mSizeX, mUsesSimd);
+        OneVFU4(fout, pi, stride, mFp, mIradius * 2 + 1, mSizeX, mKernels);
     } else {
-        x1 = 0;
-        while(mSizeX > x1) {
-            OneVU4(mSizeY, fout, x1, y, mIn, stride, mFp, mIradius);
-            fout++;
-            x1++;
-        }
+        const uchar* rows[kMaxDiameter];
+        clampedRows(rows, mIn, y, mSizeY, stride, mIradius);
+        blurVertical<uchar4, float4, kBlockSizeU4>(fout, rows, mFp, mIradius * 2 + 1, mSizeX);
     }
 
     x1 = xstart;
@@ -415,16 +455,21 @@ void BlurTask::kernelU4(void *outPtr, uint32_t xstart, uint32_t xend, uint32_t c
         out++;
         x1++;
     }
-#if defined(ARCH_X86_HAVE_SSSE3)
-    if (mUsesSimd) {
+    if (mKernels->blurHFU4 != nullptr) {
         if ((x1 + mIradius) < x2) {
-            rsdIntrinsicBlurHFU4_K(out, buf - mIradius, mFp,
-                                   mIradius * 2 + 1, x1, x2 - mIradius);
+            mKernels->blurHFU4(out, buf - mIradius, mFp, mIradius * 2 + 1, x1, x2 - mIradius);
             out += (x2 - mIradius) - x1;
             x1 = x2 - mIradius;
         }
     }
-#endif
+    // Only the cells close to the right edge need their input clamped.
+    const uint32_t unclampedEnd = std::min(x2, unclampedLimit());
+    if (unclampedEnd > x1) {
+        blurHorizontal<uchar4, float4, kBlockSizeU4>(out, buf + x1 - mIradius, mFp,
+                                                     mIradius * 2 + 1, unclampedEnd - x1);
+        out += unclampedEnd - x1;
+        x1 = unclampedEnd;
+    }
     while(x2 > x1) {
         OneHU4(mSizeX, out, x1, buf, mFp, mIradius);
         out++;
@@ -463,16 +508,13 @@ void BlurTask::kernelU1(void *outPtr, uint32_t xstart, uint32_t xend, uint32_t c
 
     float *fout = (float *)buf;
     int y = currentY;
-    if ((y > mIradius) && (y < ((int)mSizeY - mIradius -1))) {
+    if ((y > mIradius) && (y < ((int)mSizeY - mIradius -1)) && mKernels->blurVFU4 != nullptr) {
         const uchar *pi = mIn + (y - mIradius) * stride;
-        OneVFU1(fout, pi, stride, mFp, mIradius * 2 + 1, mSizeX, mUsesSimd);
+        OneVFU1(fout, pi, stride, mFp, mIradius * 2 + 1, mSizeX, mKernels);
     } else {
-        x1 = 0;
-        while(mSizeX > x1) {
-            OneVU1(mSizeY, fout, x1, y, mIn, stride, mFp, mIradius);
-            fout++;
-            x1++;
-        }
+        const uchar* rows[kMaxDiameter];
+        clampedRows(rows, mIn, y, mSizeY, stride, mIradius);
+        blurVertical<uchar, float, kBlockSizeU1>(fout, rows, mFp, mIradius * 2 + 1, mSizeX);
     }
 
     x1 = xstart;
@@ -482,8 +524,7 @@ void BlurTask::kernelU1(void *outPtr, uint32_t xstart, uint32_t xend, uint32_t c
         out++;
         x1++;
     }
-#if defined(ARCH_X86_HAVE_SSSE3)
-    if (mUsesSimd) {
+    if (mKernels->blurHFU1 != nullptr) {
         if ((x1 + mIradius) < x2) {
             uint32_t len = x2 - (x1 + mIradius);
             len &= ~3;
@@ -493,14 +534,21 @@ void BlurTask::kernelU1(void *outPtr, uint32_t xstart, uint32_t xend, uint32_t c
             // uninitialized buffer.
             if (len > 4) {
                 len -= 4;
-                rsdIntrinsicBlurHFU1_K(out, ((float *)buf) - mIradius, mFp,
-                                       mIradius * 2 + 1, x1, x1 + len);
+                mKernels->blurHFU1(out, ((float *)buf) - mIradius, mFp, mIradius * 2 + 1, x1,
+                                   x1 + len);
                 out += len;
                 x1 += len;
             }
         }
     }
-#endif
+    // Only the cells close to the right edge need their input clamped.
+    const uint32_t unclampedEnd = std::min(x2, unclampedLimit());
+    if (unclampedEnd > x1) {
+        blurHorizontal<uchar, float, kBlockSizeU1>(out, buf + x1 - mIradius, mFp,
+                                                   mIradius * 2 + 1, unclampedEnd - x1);
+        out += unclampedEnd - x1;
+        x1 = unclampedEnd;
+    }
     while(x2 > x1) {
         OneHU1(mSizeX, out, x1, buf, mFp, mIradius);
         out++;
@@ -520,23 +568,76 @@ void BlurTask::processData(int threadIndex, size_t startX, size_t startY, size_t
     }
 }
 
-void RenderScriptToolkit::blur(const uint8_t* in, uint8_t* out, size_t sizeX, size_t sizeY,
-                               size_t vectorSize, int radius, const Restriction* restriction) {
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+static bool validBlurArguments(size_t sizeX, size_t sizeY, size_t vectorSize, int radius,
+                               const Restriction* restriction) {
     if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
-        return;
+        return false;
     }
     if (radius <= 0 || radius > 25) {
         ALOGE("The radius should be between 1 and 25. %d provided.", radius);
+        return false;
     }
     if (vectorSize != 1 && vectorSize != 4) {
         ALOGE("The vectorSize should be 1 or 4. %zu provided.", vectorSize);
+        return false;
+    }
+    return true;
+}
+#endif
+
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::blur(const uint8_t* in, uint8_t* out,
+                                                          size_t sizeX, size_t sizeY,
+                                                          size_t vectorSize, int radius,
+                                                          const Restriction* restriction,
+                                                          const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validBlurArguments(sizeX, sizeY, vectorSize, radius, restriction)) {
+        return TaskStatus::INVALID_ARGUMENTS;
+    }
+#endif
+
+    BlurTask task(in, out, sizeX, sizeY, vectorSize, radius, restriction);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::blurBatch(const BlurJob* jobs,
+                                                               size_t numberOfJobs,
+                                                               size_t vectorSize, int radius,
+                                                               const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    for (size_t i = 0; i < numberOfJobs; i++) {
+        if (!validBlurArguments(jobs[i].sizeX, jobs[i].sizeY, vectorSize, radius, nullptr)) {
+            return TaskStatus::INVALID_ARGUMENTS;
+        }
+    }
+#endif
+
+    std::vector<std::unique_ptr<Task>> tasks;
+    tasks.reserve(numberOfJobs);
+    for (size_t i = 0; i < numberOfJobs; i++) {
+        const BlurJob& job = jobs[i];
+        tasks.push_back(std::make_unique<BlurTask>(job.in, job.out, job.sizeX, job.sizeY,
+                                                   vectorSize, radius, nullptr));
+    }
+    return processor->doTasks(tasks, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::blurAsync(const uint8_t* in, uint8_t* out,
+                                                               size_t sizeX, size_t sizeY,
+                                                               size_t vectorSize, int radius,
+                                                               const Restriction* restriction,
+                                                               Callback callback,
+                                                               const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validBlurArguments(sizeX, sizeY, vectorSize, radius, restriction)) {
+        return TaskHandle();
     }
 #endif
 
-    BlurTask task(in, out, sizeX, sizeY, vectorSize, processor->getNumberOfThreads(), radius,
-                  restriction);
-    processor->doTask(&task);
+    return TaskHandle(processor->startTask(
+            std::make_unique<BlurTask>(in, out, sizeX, sizeY, vectorSize, radius, restriction),
+            std::move(callback), options));
 }
 
 }  // namespace renderscript
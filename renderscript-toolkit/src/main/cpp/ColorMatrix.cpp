@@ -19,6 +19,7 @@
 #include "Utils.h"
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <sys/mman.h>
 
 namespace renderscript {
@@ -200,6 +201,12 @@ class ColorMatrixTask : public Task {
                      size_t endY) override;
 
    public:
+    const char* name() const override { return "colorMatrix"; }
+    size_t costPerCell() const override { return mInputVectorSize * mVectorSize; }
+    const void* dataOfRow(size_t y) const override {
+        return static_cast<const uchar*>(mIn) + mSizeX * y * paddedSize(mInputVectorSize);
+    }
+
     ColorMatrixTask(const void* in, void* out, size_t inputVectorSize, size_t outputVectorSize,
                     size_t sizeX, size_t sizeY, const float* matrix, const float* addVector,
                     const Restriction* restriction)
@@ -916,6 +923,29 @@ void ColorMatrixTask::kernel(uchar *out, uchar *in, uint32_t xstart, uint32_t xe
 
     if(x2 > x1) {
         int32_t len = x2 - x1;
+        // Unlike the SSSE3 kernels, the table kernels compute the same values as One(), so
+        // they can be used for all 3 and 4 channel unsigned byte conversions.
+        const uint32_t pixels = mKernels->colorMatrixPixels;
+        if (mKernels->colorMatrix != nullptr && !floatIn && !floatOut && vsin >= 2 && vsout >= 2 &&
+            len >= (int32_t)pixels) {
+            uint32_t count = len / pixels;
+            mKernels->colorMatrix(out, in, mTmpFp, mTmpFpa, count, vsin == 2);
+            int32_t done = count * pixels;
+            x1 += done;
+            out += mOutstep * done;
+            in += mInstep * done;
+            len -= done;
+            const uint32_t tailPixels = mKernels->colorMatrixTailPixels;
+            if (mKernels->colorMatrixTail != nullptr && len >= (int32_t)tailPixels) {
+                count = len / tailPixels;
+                mKernels->colorMatrixTail(out, in, mTmpFp, mTmpFpa, count, vsin == 2);
+                done = count * tailPixels;
+                x1 += done;
+                out += mOutstep * done;
+                in += mInstep * done;
+                len -= done;
+            }
+        }
         if (mUsesSimd) {
             if((mOptKernel != nullptr) && (len >= 4)) {
                 // The optimized kernel processes 4 pixels at once
@@ -1035,21 +1065,37 @@ void ColorMatrixTask::processData(int /* threadIndex */, size_t startX, size_t s
 
 static const float fourZeroes[]{0.0f, 0.0f, 0.0f, 0.0f};
 
-void RenderScriptToolkit::colorMatrix(const void* in, void* out, size_t inputVectorSize,
-                                      size_t outputVectorSize, size_t sizeX, size_t sizeY,
-                                      const float* matrix, const float* addVector,
-                                      const Restriction* restriction) {
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+static bool validColorMatrixArguments(size_t inputVectorSize, size_t outputVectorSize,
+                                      size_t sizeX, size_t sizeY,
+                                      const Restriction* restriction) {
     if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
-        return;
+        return false;
     }
     if (inputVectorSize < 1 || inputVectorSize > 4) {
         ALOGE("The inputVectorSize should be between 1 and 4. %zu provided.", inputVectorSize);
-        return;
+        return false;
     }
     if (outputVectorSize < 1 || outputVectorSize > 4) {
         ALOGE("The outputVectorSize should be between 1 and 4. %zu provided.", outputVectorSize);
-        return;
+        return false;
+    }
+    return true;
+}
+#endif
+
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::colorMatrix(const void* in, void* out,
+                                                                 size_t inputVectorSize,
+                                                                 size_t outputVectorSize,
+                                                                 size_t sizeX, size_t sizeY,
+                                                                 const float* matrix,
+                                                                 const float* addVector,
+                                                                 const Restriction* restriction,
+                                                                 const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validColorMatrixArguments(inputVectorSize, outputVectorSize, sizeX, sizeY,
+                                   restriction)) {
+        return TaskStatus::INVALID_ARGUMENTS;
     }
 #endif
 
@@ -1058,7 +1104,27 @@ void RenderScriptToolkit::colorMatrix(const void* in, void* out, size_t inputVec
     }
     ColorMatrixTask task(in, out, inputVectorSize, outputVectorSize, sizeX, sizeY, matrix,
                          addVector, restriction);
-    processor->doTask(&task);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::colorMatrixAsync(
+        const void* in, void* out, size_t inputVectorSize, size_t outputVectorSize, size_t sizeX,
+        size_t sizeY, const float* matrix, const float* addVector, const Restriction* restriction,
+        Callback callback, const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validColorMatrixArguments(inputVectorSize, outputVectorSize, sizeX, sizeY,
+                                   restriction)) {
+        return TaskHandle();
+    }
+#endif
+
+    if (addVector == nullptr) {
+        addVector = fourZeroes;
+    }
+    return TaskHandle(processor->startTask(
+            std::make_unique<ColorMatrixTask>(in, out, inputVectorSize, outputVectorSize, sizeX,
+                                              sizeY, matrix, addVector, restriction),
+            std::move(callback), options));
 }
 
 }  // namespace renderscript
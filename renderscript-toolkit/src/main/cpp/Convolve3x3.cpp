@@ -24,8 +24,10 @@
 
 namespace renderscript {
 
+#if defined(ARCH_ARM_USE_INTRINSICS)
 extern "C" void rsdIntrinsicConvolve3x3_K(void* dst, const void* y0, const void* y1, const void* y2,
                                           const int16_t* coef, uint32_t count);
+#endif
 
 class Convolve3x3Task : public Task {
     const void* mIn;
@@ -45,6 +47,12 @@ class Convolve3x3Task : public Task {
                      size_t endY) override;
 
    public:
+    const char* name() const override { return "convolve3x3"; }
+    size_t costPerCell() const override { return mVectorSize * 9; }
+    const void* dataOfRow(size_t y) const override {
+        return static_cast<const uchar*>(mIn) + mSizeX * y * paddedSize(mVectorSize);
+    }
+
     Convolve3x3Task(const void* in, void* out, size_t vectorSize, size_t sizeX, size_t sizeY,
                     const float* coefficients, const Restriction* restriction)
         : Task{sizeX, sizeY, vectorSize, false, restriction}, mIn{in}, mOut{out} {
@@ -94,6 +102,66 @@ static void convolveOneU(uint32_t x, InputOutputType* out, const InputOutputType
     *out = convert<InputOutputType>(px);
 }
 
+/**
+ * Convolves the cells [x1, x2) of one line and stores the results in the output. This is used
+ * for uchar, uchar2, uchar3, and uchar4 vectors.
+ *
+ * Only the first and last cells of the line need their input clamped. The other cells are
+ * computed in blocks, with the sums done in the same order as convolveOneU().
+ *
+ * @tparam InputOutputType Type of the input and output arrays. A vector type, e.g. uchar4.
+ * @tparam ComputationType Type we use for the intermediate computations.
+ * @param x1 The index in the row of the first value we'll convolve.
+ * @param x2 The index in the row after the last value we'll convolve.
+ * @param out The location in the output array where we store the value of x1.
+ * @param py0 The start of the top row.
+ * @param py1 The start of the middle row.
+ * @param py2 The start of the bottom row.
+ * @param coeff Pointer to the float coefficients, in row major format.
+ * @param sizeX The number of cells of one row.
+ */
+template <typename InputOutputType, typename ComputationType>
+static void convolveLineU(uint32_t x1, uint32_t x2, InputOutputType* out,
+                          const InputOutputType* py0, const InputOutputType* py1,
+                          const InputOutputType* py2, const float* coeff, int32_t sizeX) {
+    constexpr uint32_t kBlockSize = 8;
+    if (x1 == 0 && x2 > x1) {
+        convolveOneU<InputOutputType, ComputationType>(x1, out, py0, py1, py2, coeff, sizeX);
+        out++;
+        x1++;
+    }
+
+    const InputOutputType* rows[3] = {py0, py1, py2};
+    const uint32_t unclampedEnd = std::min(x2, (uint32_t)std::max(sizeX - 1, 0));
+    while (x1 + kBlockSize <= unclampedEnd) {
+        ComputationType px[kBlockSize];
+        for (int r = 0; r < 3; r++) {
+            // Convert each input cell once, rather than once per coefficient.
+            ComputationType in[kBlockSize + 2];
+            for (uint32_t i = 0; i < kBlockSize + 2; i++) {
+                in[i] = convert<ComputationType>(rows[r][x1 + i - 1]);
+            }
+            const float* k = coeff + r * 3;
+            for (uint32_t i = 0; i < kBlockSize; i++) {
+                ComputationType sum = r == 0 ? in[i] * k[0] : px[i] + in[i] * k[0];
+                sum = sum + in[i + 1] * k[1];
+                px[i] = sum + in[i + 2] * k[2];
+            }
+        }
+        for (uint32_t i = 0; i < kBlockSize; i++) {
+            out[i] = convert<InputOutputType>(clamp(px[i] + 0.5f, 0.f, 255.f));
+        }
+        out += kBlockSize;
+        x1 += kBlockSize;
+    }
+
+    while (x1 < x2) {
+        convolveOneU<InputOutputType, ComputationType>(x1, out, py0, py1, py2, coeff, sizeX);
+        out++;
+        x1++;
+    }
+}
+
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_SUPPORTS_FLOAT
 /**
  * Computes one convolution and stores the result in the output. This is used for float, float2,
@@ -146,7 +214,27 @@ void Convolve3x3Task::kernelU4(uchar* pout, uint32_t xstart, uint32_t xend, cons
     }
 
     if (x2 > x1) {
-#if defined(ARCH_ARM_USE_INTRINSICS) || defined(ARCH_X86_HAVE_SSSE3)
+        // Like below, we stay one pixel away from the end boundary.
+        if (mKernels->convolve3x3 != nullptr) {
+            const uint32_t pixels = mKernels->convolve3x3Pixels;
+            int32_t len = (x2 - x1 - 1) / pixels;
+            if (len > 0) {
+                mKernels->convolve3x3(out, &py0[x1 - 1], &py1[x1 - 1], &py2[x1 - 1], mIp, len);
+                x1 += len * pixels;
+                out += len * pixels;
+            }
+            if (mKernels->convolve3x3Tail != nullptr) {
+                const uint32_t tailPixels = mKernels->convolve3x3TailPixels;
+                len = (x2 - x1 - 1) / tailPixels;
+                if (len > 0) {
+                    mKernels->convolve3x3Tail(out, &py0[x1 - 1], &py1[x1 - 1], &py2[x1 - 1], mIp,
+                                              len);
+                    x1 += len * tailPixels;
+                    out += len * tailPixels;
+                }
+            }
+        }
+#if defined(ARCH_ARM_USE_INTRINSICS)
         if (mUsesSimd) {
             int32_t len = (x2 - x1 - 1) >> 1;
             if (len > 0) {
@@ -157,11 +245,7 @@ void Convolve3x3Task::kernelU4(uchar* pout, uint32_t xstart, uint32_t xend, cons
         }
 #endif
 
-        while (x1 != x2) {
-            convolveOneU<uchar4, float4>(x1, out, py0, py1, py2, mFp, mSizeX);
-            out++;
-            x1++;
-        }
+        convolveLineU<uchar4, float4>(x1, x2, out, py0, py1, py2, mFp, mSizeX);
     }
 }
 
@@ -198,9 +282,8 @@ static void convolveU(const uchar* pin, uchar* pout, size_t vectorSize, size_t s
         InputOutputType* py0 = (InputOutputType*)(pin + stride * y2);
         InputOutputType* py1 = (InputOutputType*)(pin + stride * y);
         InputOutputType* py2 = (InputOutputType*)(pin + stride * y1);
-        for (uint32_t x = startX; x < endX; x++, px++) {
-            convolveOneU<InputOutputType, ComputationType>(x, px, py0, py1, py2, fp, sizeX);
-        }
+        convolveLineU<InputOutputType, ComputationType>(startX, endX, px, py0, py1, py2, fp,
+                                                        sizeX);
     }
 }
 
@@ -242,21 +325,50 @@ void Convolve3x3Task::processData(int /* threadIndex */, size_t startX, size_t s
     }
 }
 
-void RenderScriptToolkit::convolve3x3(const void* in, void* out, size_t vectorSize, size_t sizeX,
-                                      size_t sizeY, const float* coefficients,
-                                      const Restriction* restriction) {
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+static bool validConvolveArguments(size_t vectorSize, size_t sizeX, size_t sizeY,
+                                   const Restriction* restriction) {
     if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
-        return;
+        return false;
     }
     if (vectorSize < 1 || vectorSize > 4) {
         ALOGE("The vectorSize should be between 1 and 4. %zu provided.", vectorSize);
-        return;
+        return false;
+    }
+    return true;
+}
+#endif
+
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::convolve3x3(const void* in, void* out,
+                                                                 size_t vectorSize, size_t sizeX,
+                                                                 size_t sizeY,
+                                                                 const float* coefficients,
+                                                                 const Restriction* restriction,
+                                                                 const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validConvolveArguments(vectorSize, sizeX, sizeY, restriction)) {
+        return TaskStatus::INVALID_ARGUMENTS;
     }
 #endif
 
     Convolve3x3Task task(in, out, vectorSize, sizeX, sizeY, coefficients, restriction);
-    processor->doTask(&task);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::convolve3x3Async(
+        const void* in, void* out, size_t vectorSize, size_t sizeX, size_t sizeY,
+        const float* coefficients, const Restriction* restriction, Callback callback,
+        const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validConvolveArguments(vectorSize, sizeX, sizeY, restriction)) {
+        return TaskHandle();
+    }
+#endif
+
+    return TaskHandle(processor->startTask(
+            std::make_unique<Convolve3x3Task>(in, out, vectorSize, sizeX, sizeY, coefficients,
+                                             restriction),
+            std::move(callback), options));
 }
 
 }  // namespace renderscript
@@ -24,9 +24,11 @@ namespace renderscript {
 
 #define LOG_TAG "renderscript.toolkit.Convolve5x5"
 
+#if defined(ARCH_ARM_USE_INTRINSICS)
 extern "C" void rsdIntrinsicConvolve5x5_K(void* dst, const void* y0, const void* y1, const void* y2,
                                           const void* y3, const void* y4, const int16_t* coef,
                                           uint32_t count);
+#endif
 
 class Convolve5x5Task : public Task {
     const void* mIn;
@@ -46,6 +48,12 @@ class Convolve5x5Task : public Task {
                      size_t endY) override;
 
    public:
+    const char* name() const override { return "convolve5x5"; }
+    size_t costPerCell() const override { return mVectorSize * 25; }
+    const void* dataOfRow(size_t y) const override {
+        return static_cast<const uchar*>(mIn) + mSizeX * y * paddedSize(mVectorSize);
+    }
+
     Convolve5x5Task(const void* in, void* out, size_t vectorSize, size_t sizeX, size_t sizeY,
                     const float* coefficients, const Restriction* restriction)
         : Task{sizeX, sizeY, vectorSize, false, restriction}, mIn{in}, mOut{out} {
@@ -104,6 +112,60 @@ static void ConvolveOneU(uint32_t x, InputOutputType* out, const InputOutputType
     *out = convert<InputOutputType>(px);
 }
 
+/**
+ * Convolves the cells [x1, x2) of one line and stores the results in the output. This is used
+ * for uchar, uchar2, uchar3, and uchar4 vectors.
+ *
+ * Only the first two and last two cells of the line need their input clamped. The other cells
+ * are computed in blocks, with the sums done in the same order as ConvolveOneU().
+ */
+template <typename InputOutputType, typename ComputationType>
+static void convolveLineU(uint32_t x1, uint32_t x2, InputOutputType* out,
+                          const InputOutputType* py0, const InputOutputType* py1,
+                          const InputOutputType* py2, const InputOutputType* py3,
+                          const InputOutputType* py4, const float* coeff, int32_t width) {
+    constexpr uint32_t kBlockSize = 8;
+    while ((x1 < x2) && (x1 < 2)) {
+        ConvolveOneU<InputOutputType, ComputationType>(x1, out, py0, py1, py2, py3, py4, coeff,
+                                                       width);
+        out++;
+        x1++;
+    }
+
+    const InputOutputType* rows[5] = {py0, py1, py2, py3, py4};
+    const uint32_t unclampedEnd = std::min(x2, (uint32_t)std::max(width - 2, 0));
+    while (x1 + kBlockSize <= unclampedEnd) {
+        ComputationType px[kBlockSize];
+        for (int r = 0; r < 5; r++) {
+            // Convert each input cell once, rather than once per coefficient.
+            ComputationType in[kBlockSize + 4];
+            for (uint32_t i = 0; i < kBlockSize + 4; i++) {
+                in[i] = convert<ComputationType>(rows[r][x1 + i - 2]);
+            }
+            const float* k = coeff + r * 5;
+            for (uint32_t i = 0; i < kBlockSize; i++) {
+                ComputationType sum = r == 0 ? in[i] * k[0] : px[i] + in[i] * k[0];
+                for (int c = 1; c < 5; c++) {
+                    sum = sum + in[i + c] * k[c];
+                }
+                px[i] = sum;
+            }
+        }
+        for (uint32_t i = 0; i < kBlockSize; i++) {
+            out[i] = convert<InputOutputType>(clamp(px[i] + 0.5f, 0.f, 255.f));
+        }
+        out += kBlockSize;
+        x1 += kBlockSize;
+    }
+
+    while (x1 < x2) {
+        ConvolveOneU<InputOutputType, ComputationType>(x1, out, py0, py1, py2, py3, py4, coeff,
+                                                       width);
+        out++;
+        x1++;
+    }
+}
+
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_SUPPORTS_FLOAT
 template <typename InputOutputType>
 static void ConvolveOneF(uint32_t x, InputOutputType* out, const InputOutputType* py0,
@@ -161,18 +223,27 @@ void Convolve5x5Task::kernelU4(uchar* pout, uint32_t x1, uint32_t x2, const ucha
         out++;
         x1++;
     }
-#if defined(ARCH_X86_HAVE_SSSE3)
-    // for x86 SIMD, require minimum of 7 elements (4 for SIMD,
-    // 3 for end boundary where x may hit the end boundary)
-    if (mUsesSimd && ((x1 + 6) < x2)) {
-        // subtract 3 for end boundary
-        uint32_t len = (x2 - x1 - 3) >> 2;
-        rsdIntrinsicConvolve5x5_K(out, py0 + x1 - 2, py1 + x1 - 2, py2 + x1 - 2, py3 + x1 - 2,
+    // The kernels need 3 pixels past the group for the end boundary, where x may hit it.
+    if (mKernels->convolve5x5 != nullptr && (x1 + 3) < x2) {
+        const uint32_t pixels = mKernels->convolve5x5Pixels;
+        uint32_t len = (x2 - x1 - 3) / pixels;
+        if (len > 0) {
+            mKernels->convolve5x5(out, py0 + x1 - 2, py1 + x1 - 2, py2 + x1 - 2, py3 + x1 - 2,
                                   py4 + x1 - 2, mIp, len);
-        out += len << 2;
-        x1 += len << 2;
+            out += len * pixels;
+            x1 += len * pixels;
+        }
+        if (mKernels->convolve5x5Tail != nullptr && (x1 + 3) < x2) {
+            const uint32_t tailPixels = mKernels->convolve5x5TailPixels;
+            len = (x2 - x1 - 3) / tailPixels;
+            if (len > 0) {
+                mKernels->convolve5x5Tail(out, py0 + x1 - 2, py1 + x1 - 2, py2 + x1 - 2,
+                                          py3 + x1 - 2, py4 + x1 - 2, mIp, len);
+                out += len * tailPixels;
+                x1 += len * tailPixels;
+            }
+        }
     }
-#endif
 
 #if defined(ARCH_ARM_USE_INTRINSICS)
     if (mUsesSimd && ((x1 + 3) < x2)) {
@@ -184,11 +255,7 @@ void Convolve5x5Task::kernelU4(uchar* pout, uint32_t x1, uint32_t x2, const ucha
     }
 #endif
 
-    while (x1 < x2) {
-        ConvolveOneU<uchar4, float4>(x1, out, py0, py1, py2, py3, py4, mFp, mSizeX);
-        out++;
-        x1++;
-    }
+    convolveLineU<uchar4, float4>(x1, x2, out, py0, py1, py2, py3, py4, mFp, mSizeX);
 }
 
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_SUPPORTS_FLOAT
@@ -278,10 +345,8 @@ static void convolveU(const uchar* pin, uchar* pout, size_t vectorSize, size_t s
         InputOutputType* py2 = (InputOutputType*)(pin + stride * y2);
         InputOutputType* py3 = (InputOutputType*)(pin + stride * y3);
         InputOutputType* py4 = (InputOutputType*)(pin + stride * y4);
-        for (uint32_t x = startX; x < endX; x++, px++) {
-            ConvolveOneU<InputOutputType, ComputationType>(x, px, py0, py1, py2, py3, py4, mFp,
-                                                           sizeX);
-        }
+        convolveLineU<InputOutputType, ComputationType>(startX, endX, px, py0, py1, py2, py3,
+                                                        py4, mFp, sizeX);
     }
 }
 
@@ -328,21 +393,50 @@ void Convolve5x5Task::processData(int /* threadIndex */, size_t startX, size_t s
     }
 }
 
-void RenderScriptToolkit::convolve5x5(const void* in, void* out, size_t vectorSize, size_t sizeX,
-                                      size_t sizeY, const float* coefficients,
-                                      const Restriction* restriction) {
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+static bool validConvolveArguments(size_t vectorSize, size_t sizeX, size_t sizeY,
+                                   const Restriction* restriction) {
     if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
-        return;
+        return false;
     }
     if (vectorSize < 1 || vectorSize > 4) {
         ALOGE("The vectorSize should be between 1 and 4. %zu provided.", vectorSize);
-        return;
+        return false;
+    }
+    return true;
+}
+#endif
+
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::convolve5x5(const void* in, void* out,
+                                                                 size_t vectorSize, size_t sizeX,
+                                                                 size_t sizeY,
+                                                                 const float* coefficients,
+                                                                 const Restriction* restriction,
+                                                                 const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validConvolveArguments(vectorSize, sizeX, sizeY, restriction)) {
+        return TaskStatus::INVALID_ARGUMENTS;
     }
 #endif
 
     Convolve5x5Task task(in, out, vectorSize, sizeX, sizeY, coefficients, restriction);
-    processor->doTask(&task);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::convolve5x5Async(
+        const void* in, void* out, size_t vectorSize, size_t sizeX, size_t sizeY,
+        const float* coefficients, const Restriction* restriction, Callback callback,
+        const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validConvolveArguments(vectorSize, sizeX, sizeY, restriction)) {
+        return TaskHandle();
+    }
+#endif
+
+    return TaskHandle(processor->startTask(
+            std::make_unique<Convolve5x5Task>(in, out, vectorSize, sizeX, sizeY, coefficients,
+                                             restriction),
+            std::move(callback), options));
 }
 
 }  // namespace renderscript
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CpuTopology.h"
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+
+namespace renderscript {
+
+/**
+ * Returns the integer in the topology file of the CPU, or defaultValue if it can't be read.
+ */
+static int readTopologyValue(int cpu, const char* name, int defaultValue) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        return defaultValue;
+    }
+    int value = defaultValue;
+    if (fscanf(file, "%d", &value) != 1) {
+        value = defaultValue;
+    }
+    fclose(file);
+    return value;
+}
+
+CpuLocation cpuLocation(int cpu) {
+    return CpuLocation{cpu, readTopologyValue(cpu, "physical_package_id", 0),
+                       readTopologyValue(cpu, "cluster_id", 0),
+                       readTopologyValue(cpu, "core_id", cpu)};
+}
+
+/**
+ * Returns the first element of each list, then the second of each, and so on.
+ */
+static std::vector<int> interleave(const std::vector<std::vector<int>>& lists) {
+    std::vector<int> result;
+    for (size_t i = 0;; i++) {
+        bool any = false;
+        for (const std::vector<int>& list : lists) {
+            if (i < list.size()) {
+                result.push_back(list[i]);
+                any = true;
+            }
+        }
+        if (!any) {
+            return result;
+        }
+    }
+}
+
+/**
+ * Orders the CPUs, which are the same hardware thread of different cores, for SCATTER.
+ */
+static std::vector<int> scatter(const std::vector<CpuLocation>& locations) {
+    // The CPUs of each cluster, by package.
+    std::map<int, std::map<int, std::vector<int>>> clusters;
+    for (const CpuLocation& location : locations) {
+        clusters[location.package][location.cluster].push_back(location.cpu);
+    }
+    std::vector<std::vector<int>> packages;
+    for (const auto& [package, clustersOfPackage] : clusters) {
+        std::vector<std::vector<int>> lists;
+        for (const auto& [cluster, cpus] : clustersOfPackage) {
+            lists.push_back(cpus);
+        }
+        packages.push_back(interleave(lists));
+    }
+    return interleave(packages);
+}
+
+std::vector<int> orderCpusForPlacement(const std::vector<int>& cpus, ThreadPlacement placement) {
+    std::vector<int> unique = cpus;
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+    // rounds[i] holds the i-th hardware thread of each core.
+    std::vector<std::vector<CpuLocation>> rounds;
+    std::map<std::tuple<int, int, int>, size_t> threadsOfCore;
+    for (int cpu : unique) {
+        const CpuLocation location = cpuLocation(cpu);
+        const size_t round = threadsOfCore[{location.package, location.cluster, location.core}]++;
+        if (round == rounds.size()) {
+            rounds.emplace_back();
+        }
+        rounds[round].push_back(location);
+    }
+
+    std::vector<int> ordered;
+    for (std::vector<CpuLocation>& round : rounds) {
+        std::sort(round.begin(), round.end(), [](const CpuLocation& a, const CpuLocation& b) {
+            return std::tie(a.package, a.cluster, a.core, a.cpu) <
+                   std::tie(b.package, b.cluster, b.core, b.cpu);
+        });
+        if (placement == ThreadPlacement::SCATTER) {
+            const std::vector<int> scattered = scatter(round);
+            ordered.insert(ordered.end(), scattered.begin(), scattered.end());
+        } else {
+            for (const CpuLocation& location : round) {
+                ordered.push_back(location.cpu);
+            }
+        }
+    }
+    return ordered;
+}
+
+/**
+ * Returns the CPU quota set in the cgroup v2 directory, as a number of CPUs, or 0 if it has none.
+ * cpu.max holds the quota and the period in microseconds, or "max" for no quota.
+ */
+static double readCgroupV2Quota(const std::string& directory) {
+    FILE* file = fopen((directory + "/cpu.max").c_str(), "r");
+    if (file == nullptr) {
+        return 0;
+    }
+    char quota[32];
+    long long period = 0;
+    double cpus = 0;
+    if (fscanf(file, "%31s %lld", quota, &period) == 2 && strcmp(quota, "max") != 0 &&
+        period > 0) {
+        cpus = atof(quota) / static_cast<double>(period);
+    }
+    fclose(file);
+    return cpus;
+}
+
+/**
+ * Returns the integer in the file, or defaultValue if it can't be read.
+ */
+static long long readValue(const std::string& path, long long defaultValue) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return defaultValue;
+    }
+    long long value = defaultValue;
+    if (fscanf(file, "%lld", &value) != 1) {
+        value = defaultValue;
+    }
+    fclose(file);
+    return value;
+}
+
+/**
+ * Same as readCgroupV2Quota() for the cgroup v1 cpu controller, where the quota is -1 when there
+ * is none.
+ */
+static double readCgroupV1Quota(const std::string& directory) {
+    const long long quota = readValue(directory + "/cpu.cfs_quota_us", -1);
+    const long long period = readValue(directory + "/cpu.cfs_period_us", 0);
+    return quota > 0 && period > 0 ? static_cast<double>(quota) / static_cast<double>(period) : 0;
+}
+
+/**
+ * Returns the smallest CPU quota of the cgroups of the process, as a number of CPUs, or 0 if
+ * there's none.
+ */
+static double cgroupCpuQuota() {
+    FILE* file = fopen("/proc/self/cgroup", "r");
+    if (file == nullptr) {
+        return 0;
+    }
+    double smallest = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        // Each line is hierarchy-id:controllers:path. The controllers are empty for cgroup v2.
+        char* controllers = strchr(line, ':');
+        char* path = controllers != nullptr ? strchr(controllers + 1, ':') : nullptr;
+        if (path == nullptr) {
+            continue;
+        }
+        *path++ = '\0';
+        controllers++;
+        path[strcspn(path, "\n")] = '\0';
+        const bool v2 = controllers[0] == '\0';
+        if (!v2 && (std::string(",") + controllers + ",").find(",cpu,") == std::string::npos) {
+            continue;
+        }
+        const std::string mount = v2 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/cpu";
+        // The quota may be set on any ancestor of the cgroup. In a container, the cgroup of the
+        // process is often mounted as the root, so we look from its directory up to the root.
+        std::string directory = path;
+        while (true) {
+            const double quota = v2 ? readCgroupV2Quota(mount + directory)
+                                    : readCgroupV1Quota(mount + directory);
+            if (quota > 0 && (smallest == 0 || quota < smallest)) {
+                smallest = quota;
+            }
+            if (directory.empty() || directory == "/") {
+                break;
+            }
+            directory.resize(directory.rfind('/'));
+        }
+    }
+    fclose(file);
+    return smallest;
+}
+
+int usableCpuCount() {
+    int count;
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+        count = CPU_COUNT(&cpus);
+    } else {
+        count = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    const double quota = cgroupCpuQuota();
+    if (quota > 0) {
+        count = std::min(count, static_cast<int>(std::ceil(quota)));
+    }
+    return std::max(count, 1);
+}
+
+/**
+ * Reads a sysfs list of numbers like 0-3,8-11. Returns an empty list if it can't be read.
+ */
+static std::vector<int> readList(const char* path) {
+    std::vector<int> values;
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        return values;
+    }
+    int first;
+    while (fscanf(file, "%d", &first) == 1) {
+        int last = first;
+        char separator = 0;
+        if (fscanf(file, "%c", &separator) == 1 && separator == '-') {
+            if (fscanf(file, "%d", &last) != 1) {
+                break;
+            }
+            // Skip the comma or the newline that follows the range.
+            fscanf(file, "%c", &separator);
+        }
+        for (int value = first; value <= last; value++) {
+            values.push_back(value);
+        }
+        if (separator != ',') {
+            break;
+        }
+    }
+    fclose(file);
+    return values;
+}
+
+NumaTopology readNumaTopology() {
+    NumaTopology topology;
+    for (int node : readList("/sys/devices/system/node/online")) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        for (int cpu : readList(path)) {
+            if (static_cast<size_t>(cpu) >= topology.nodeOfCpu.size()) {
+                topology.nodeOfCpu.resize(cpu + 1, 0);
+            }
+            topology.nodeOfCpu[cpu] = node;
+        }
+        topology.numberOfNodes = std::max(topology.numberOfNodes, node + 1);
+    }
+    return topology;
+}
+
+int NumaTopology::nodeOfThisThread() const {
+    const int cpu = sched_getcpu();
+    return cpu >= 0 && static_cast<size_t>(cpu) < nodeOfCpu.size() ? nodeOfCpu[cpu] : 0;
+}
+
+bool findNodesOfPages(const std::vector<const void*>& addresses, std::vector<int>* nodes) {
+    nodes->assign(addresses.size(), -1);
+#ifdef SYS_move_pages
+    // With no target nodes, move_pages doesn't move anything but tells where the pages are.
+    std::vector<void*> pages(addresses.size());
+    const uintptr_t pageMask = ~static_cast<uintptr_t>(sysconf(_SC_PAGESIZE) - 1);
+    for (size_t i = 0; i < addresses.size(); i++) {
+        pages[i] = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(addresses[i]) & pageMask);
+    }
+    if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, nodes->data(), 0) != 0) {
+        return false;
+    }
+    // The status of the pages that can't be found is a negative errno.
+    for (int& node : *nodes) {
+        node = std::max(node, -1);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+}  // namespace renderscript
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_CPUTOPOLOGY_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_CPUTOPOLOGY_H
+
+#include <vector>
+
+#include "RenderScriptToolkit.h"
+
+namespace renderscript {
+
+using ThreadPlacement = RenderScriptToolkit::ThreadPlacement;
+
+/**
+ * Where a CPU, i.e. a hardware thread, sits in the machine, as described by
+ * /sys/devices/system/cpu/cpuN/topology. The values that can't be read are 0, except core which
+ * is then the CPU number, i.e. the CPU is assumed to be a core of its own.
+ */
+struct CpuLocation {
+    int cpu;
+    int package;
+    /**
+     * The cluster of cores that share a cache level, e.g. the big and the little cores of an
+     * ARM SoC. Unique within the package.
+     */
+    int cluster;
+    /**
+     * Unique within the package. The hardware threads of a core have the same one.
+     */
+    int core;
+};
+
+CpuLocation cpuLocation(int cpu);
+
+/**
+ * Returns the CPUs, without duplicates, in the order the pool threads should be pinned to them.
+ * The first hardware thread of each core comes first, then the second of each core, and so on,
+ * so that each thread gets a core of its own as long as there are enough.
+ *
+ * With COMPACT, the cores are in the order of their package, cluster, and number. With SCATTER,
+ * consecutive cores alternate between the packages and, within a package, between the clusters.
+ */
+std::vector<int> orderCpusForPlacement(const std::vector<int>& cpus, ThreadPlacement placement);
+
+/**
+ * Returns the number of CPUs the process can keep busy: those the calling thread may run on, e.g.
+ * as restricted by a cpuset, but no more than the CPU quota of its cgroup, v1 or v2, rounded up.
+ * In a container limited to 2 CPUs on a large host, it's 2. At least 1.
+ */
+int usableCpuCount();
+
+/**
+ * The NUMA nodes of the machine, as described by /sys/devices/system/node. A machine without
+ * NUMA, or whose topology can't be read, has a single node.
+ */
+struct NumaTopology {
+    /**
+     * The node of each CPU, indexed by CPU number.
+     */
+    std::vector<int> nodeOfCpu;
+    /**
+     * One more than the highest node number.
+     */
+    int numberOfNodes = 1;
+
+    /**
+     * Returns the node of the CPU the calling thread is running on, or 0 if unknown.
+     */
+    int nodeOfThisThread() const;
+};
+
+NumaTopology readNumaTopology();
+
+/**
+ * Finds the NUMA node that holds the memory page of each address, with move_pages. The nodes of
+ * the pages that have not been touched yet are -1. Returns false if the kernel can't tell, e.g.
+ * if it was built without NUMA support.
+ */
+bool findNodesOfPages(const std::vector<const void*>& addresses, std::vector<int>* nodes);
+
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_CPUTOPOLOGY_H
@@ -16,6 +16,8 @@
 
 #include <array>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 
 #include "RenderScriptToolkit.h"
 #include "TaskProcessor.h"
@@ -27,8 +29,9 @@ namespace renderscript {
 
 class HistogramTask : public Task {
     const uchar* mIn;
+    int32_t* mOut;
     std::vector<int> mSums;
-    uint32_t mThreadCount;
+    uint32_t mThreadCount = 0;
 
     // Process a 2D tile of the overall work. threadIndex identifies which thread does the work.
     void processData(int threadIndex, size_t startX, size_t startY, size_t endX,
@@ -40,17 +43,28 @@ class HistogramTask : public Task {
     void kernelP1U1(const uchar* in, int* sums, uint32_t xstart, uint32_t xend);
 
    public:
-    HistogramTask(const uint8_t* in, size_t sizeX, size_t sizeY, size_t vectorSize,
-                  uint32_t threadCount, const Restriction* restriction);
+    const char* name() const override { return "histogram"; }
+    const void* dataOfRow(size_t y) const override {
+        return mIn + mSizeX * y * paddedSize(mVectorSize);
+    }
+
+    HistogramTask(const uint8_t* in, int32_t* out, size_t sizeX, size_t sizeY, size_t vectorSize,
+                  const Restriction* restriction);
+    void allocateThreadStorage(unsigned int numberOfThreads) override {
+        mSums.assign(256 * paddedSize(mVectorSize) * numberOfThreads, 0);
+        mThreadCount = numberOfThreads;
+    }
     void collateSums(int* out);
+    void finish() override { collateSums(mOut); }
 };
 
 class HistogramDotTask : public Task {
     const uchar* mIn;
+    int32_t* mOut;
     float mDot[4];
     int mDotI[4];
     std::vector<int> mSums;
-    uint32_t mThreadCount;
+    uint32_t mThreadCount = 0;
 
     void kernelP1L4(const uchar* in, int* sums, uint32_t xstart, uint32_t xend);
     void kernelP1L3(const uchar* in, int* sums, uint32_t xstart, uint32_t xend);
@@ -58,22 +72,27 @@ class HistogramDotTask : public Task {
     void kernelP1L1(const uchar* in, int* sums, uint32_t xstart, uint32_t xend);
 
    public:
-    HistogramDotTask(const uint8_t* in, size_t sizeX, size_t sizeY, size_t vectorSize,
-                     uint32_t threadCount, const float* coefficients,
-                     const Restriction* restriction);
+    const char* name() const override { return "histogramDot"; }
+    const void* dataOfRow(size_t y) const override {
+        return mIn + mSizeX * y * paddedSize(mVectorSize);
+    }
+
+    HistogramDotTask(const uint8_t* in, int32_t* out, size_t sizeX, size_t sizeY,
+                     size_t vectorSize, const float* coefficients, const Restriction* restriction);
+    void allocateThreadStorage(unsigned int numberOfThreads) override {
+        mSums.assign(256 * numberOfThreads, 0);
+        mThreadCount = numberOfThreads;
+    }
     void collateSums(int* out);
+    void finish() override { collateSums(mOut); }
 
     void processData(int threadIndex, size_t startX, size_t startY, size_t endX,
                      size_t endY) override;
 };
 
-HistogramTask::HistogramTask(const uchar* in, size_t sizeX, size_t sizeY, size_t vectorSize,
-                             uint32_t threadCount, const Restriction* restriction)
-    : Task{sizeX, sizeY, vectorSize, true, restriction},
-      mIn{in},
-      mSums(256 * paddedSize(vectorSize) * threadCount) {
-    mThreadCount = threadCount;
-}
+HistogramTask::HistogramTask(const uchar* in, int32_t* out, size_t sizeX, size_t sizeY,
+                             size_t vectorSize, const Restriction* restriction)
+    : Task{sizeX, sizeY, vectorSize, true, restriction}, mIn{in}, mOut{out} {}
 
 void HistogramTask::processData(int threadIndex, size_t startX, size_t startY, size_t endX,
                                 size_t endY) {
@@ -149,12 +168,10 @@ void HistogramTask::collateSums(int* out) {
     }
 }
 
-HistogramDotTask::HistogramDotTask(const uchar* in, size_t sizeX, size_t sizeY, size_t vectorSize,
-                                   uint32_t threadCount, const float* coefficients,
+HistogramDotTask::HistogramDotTask(const uchar* in, int32_t* out, size_t sizeX, size_t sizeY,
+                                   size_t vectorSize, const float* coefficients,
                                    const Restriction* restriction)
-    : Task{sizeX, sizeY, vectorSize, true, restriction}, mIn{in}, mSums(256 * threadCount, 0) {
-    mThreadCount = threadCount;
-
+    : Task{sizeX, sizeY, vectorSize, true, restriction}, mIn{in}, mOut{out} {
     if (coefficients == nullptr) {
         mDot[0] = 0.299f;
         mDot[1] = 0.587f;
@@ -243,33 +260,24 @@ void HistogramDotTask::collateSums(int* out) {
 
 ////////////////////////////////////////////////////////////////////////////
 
-void RenderScriptToolkit::histogram(const uint8_t* in, int32_t* out, size_t sizeX, size_t sizeY,
-                                    size_t vectorSize, const Restriction* restriction) {
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+static bool validHistogramArguments(size_t sizeX, size_t sizeY, size_t vectorSize,
+                                    const Restriction* restriction) {
     if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
-        return;
+        return false;
     }
     if (vectorSize < 1 || vectorSize > 4) {
         ALOGE("The vectorSize should be between 1 and 4. %zu provided.", vectorSize);
-        return;
+        return false;
     }
-#endif
-
-    HistogramTask task(in, sizeX, sizeY, vectorSize, processor->getNumberOfThreads(), restriction);
-    processor->doTask(&task);
-    task.collateSums(out);
+    return true;
 }
 
-void RenderScriptToolkit::histogramDot(const uint8_t* in, int32_t* out, size_t sizeX, size_t sizeY,
-                                       size_t vectorSize, const float* coefficients,
+static bool validHistogramDotArguments(size_t sizeX, size_t sizeY, size_t vectorSize,
+                                       const float* coefficients,
                                        const Restriction* restriction) {
-#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
-    if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
-        return;
-    }
-    if (vectorSize < 1 || vectorSize > 4) {
-        ALOGE("The vectorSize should be between 1 and 4. %zu provided.", vectorSize);
-        return;
+    if (!validHistogramArguments(sizeX, sizeY, vectorSize, restriction)) {
+        return false;
     }
     if (coefficients != nullptr) {
         float sum = 0.0f;
@@ -277,21 +285,80 @@ void RenderScriptToolkit::histogramDot(const uint8_t* in, int32_t* out, size_t s
             if (coefficients[i] < 0.0f) {
                 ALOGE("histogramDot coefficients should not be negative. Coefficient %zu was %f.",
                       i, coefficients[i]);
-                return;
+                return false;
             }
             sum += coefficients[i];
         }
         if (sum > 1.0f) {
             ALOGE("histogramDot coefficients should add to 1 or less. Their sum is %f.", sum);
-            return;
+            return false;
         }
     }
+    return true;
+}
+#endif
+
+// The sums of the threads are collated into out by HistogramTask::finish(), which the
+// TaskProcessor calls once all the tiles have been processed.
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::histogram(const uint8_t* in, int32_t* out,
+                                                               size_t sizeX, size_t sizeY,
+                                                               size_t vectorSize,
+                                                               const Restriction* restriction,
+                                                               const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validHistogramArguments(sizeX, sizeY, vectorSize, restriction)) {
+        return TaskStatus::INVALID_ARGUMENTS;
+    }
+#endif
+
+    HistogramTask task(in, out, sizeX, sizeY, vectorSize, restriction);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::histogramAsync(
+        const uint8_t* in, int32_t* out, size_t sizeX, size_t sizeY, size_t vectorSize,
+        const Restriction* restriction, Callback callback, const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validHistogramArguments(sizeX, sizeY, vectorSize, restriction)) {
+        return TaskHandle();
+    }
+#endif
+
+    return TaskHandle(processor->startTask(
+            std::make_unique<HistogramTask>(in, out, sizeX, sizeY, vectorSize, restriction),
+            std::move(callback), options));
+}
+
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::histogramDot(const uint8_t* in, int32_t* out,
+                                                                  size_t sizeX, size_t sizeY,
+                                                                  size_t vectorSize,
+                                                                  const float* coefficients,
+                                                                  const Restriction* restriction,
+                                                                  const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validHistogramDotArguments(sizeX, sizeY, vectorSize, coefficients, restriction)) {
+        return TaskStatus::INVALID_ARGUMENTS;
+    }
+#endif
+
+    HistogramDotTask task(in, out, sizeX, sizeY, vectorSize, coefficients, restriction);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::histogramDotAsync(
+        const uint8_t* in, int32_t* out, size_t sizeX, size_t sizeY, size_t vectorSize,
+        const float* coefficients, const Restriction* restriction, Callback callback,
+        const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validHistogramDotArguments(sizeX, sizeY, vectorSize, coefficients, restriction)) {
+        return TaskHandle();
+    }
 #endif
 
-    HistogramDotTask task(in, sizeX, sizeY, vectorSize, processor->getNumberOfThreads(),
-                          coefficients, restriction);
-    processor->doTask(&task);
-    task.collateSums(out);
+    return TaskHandle(processor->startTask(
+            std::make_unique<HistogramDotTask>(in, out, sizeX, sizeY, vectorSize, coefficients,
+                                               restriction),
+            std::move(callback), options));
 }
 
 }  // namespace renderscript
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KernelTable.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <strings.h>
+
+#include "Utils.h"
+
+#define LOG_TAG "renderscript.toolkit.KernelTable"
+
+namespace renderscript {
+
+#if defined(ARCH_X86_HAVE_SSSE3)
+extern void rsdIntrinsicBlurVFU4_K(void *dst, const void *pin, int stride, const void *gptr,
+                                   int rct, int x1, int x2);
+extern void rsdIntrinsicBlurHFU4_K(void *dst, const void *pin, const void *gptr, int rct, int x1,
+                                   int x2);
+extern void rsdIntrinsicBlurHFU1_K(void *dst, const void *pin, const void *gptr, int rct, int x1,
+                                   int x2);
+extern "C" void rsdIntrinsicConvolve3x3_K(void *dst, const void *y0, const void *y1,
+                                          const void *y2, const int16_t *coef, uint32_t count);
+extern "C" void rsdIntrinsicConvolve5x5_K(void *dst, const void *y0, const void *y1,
+                                          const void *y2, const void *y3, const void *y4,
+                                          const int16_t *coef, uint32_t count);
+extern void rsdIntrinsicBlendSrcOver_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendDstOver_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendSrcIn_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendDstIn_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendSrcOut_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendDstOut_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendSrcAtop_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendDstAtop_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendXor_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendMultiply_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendAdd_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendSub_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicYuv_K(void *dst, const uint8_t *pY, const uint8_t *pUV, uint32_t count,
+                              const int16_t *param);
+#endif
+
+#if defined(ARCH_X86_USE_AVX2)
+extern void rsdIntrinsicBlurVFU4_avx2_K(void *dst, const void *pin, int stride, const void *gptr,
+                                        int rct, int x1, int x2);
+extern void rsdIntrinsicBlurHFU4_avx2_K(void *dst, const void *pin, const void *gptr, int rct,
+                                        int x1, int x2);
+extern "C" void rsdIntrinsicConvolve3x3_avx2_K(void *dst, const void *y0, const void *y1,
+                                               const void *y2, const int16_t *coef,
+                                               uint32_t count);
+extern "C" void rsdIntrinsicConvolve5x5_avx2_K(void *dst, const void *y0, const void *y1,
+                                               const void *y2, const void *y3, const void *y4,
+                                               const int16_t *coef, uint32_t count);
+extern void rsdIntrinsicColorMatrix4x4_avx2_K(void *dst, const void *src, const float *coef,
+                                              const float *add, uint32_t count,
+                                              bool zeroInputAlpha);
+extern void rsdIntrinsicBlendSrcOver_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendDstOver_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendSrcIn_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendDstIn_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendSrcOut_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendDstOut_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendSrcAtop_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendDstAtop_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendXor_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendMultiply_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendAdd_avx2_K(void *dst, const void *src, uint32_t count8);
+extern void rsdIntrinsicBlendSub_avx2_K(void *dst, const void *src, uint32_t count8);
+#endif
+
+#if defined(ARCH_X86_USE_AVX512)
+extern "C" void rsdIntrinsicConvolve5x5_avx512_K(void *dst, const void *y0, const void *y1,
+                                                 const void *y2, const void *y3, const void *y4,
+                                                 const int16_t *coef, uint32_t count);
+extern void rsdIntrinsicColorMatrix4x4_avx512_K(void *dst, const void *src, const float *coef,
+                                                const float *add, uint32_t count,
+                                                bool zeroInputAlpha);
+#endif
+
+using BlendingMode = RenderScriptToolkit::BlendingMode;
+
+static const char* const kSimdTierVariable = "RENDERSCRIPT_TOOLKIT_SIMD_TIER";
+
+static const SimdTier kAllTiers[] = {SimdTier::SCALAR, SimdTier::SSSE3, SimdTier::AVX2,
+                                     SimdTier::AVX512, SimdTier::NEON,  SimdTier::ASIMD};
+
+static bool isX86Tier(SimdTier tier) {
+    return tier == SimdTier::SSSE3 || tier == SimdTier::AVX2 || tier == SimdTier::AVX512;
+}
+
+/**
+ * Fills the table of a tier. Each x86 tier starts with the kernels of the tier below it and
+ * replaces the ones it has a faster version of.
+ */
+static KernelTable makeKernelTable(SimdTier tier) {
+    KernelTable table;
+    table.tier = tier;
+    if (!isX86Tier(tier)) {
+        return table;
+    }
+#if defined(ARCH_X86_HAVE_SSSE3)
+    table.blurVFU4 = rsdIntrinsicBlurVFU4_K;
+    table.blurHFU4 = rsdIntrinsicBlurHFU4_K;
+    table.blurHFU1 = rsdIntrinsicBlurHFU1_K;
+    table.convolve3x3 = rsdIntrinsicConvolve3x3_K;
+    table.convolve3x3Pixels = 2;
+    table.convolve5x5 = rsdIntrinsicConvolve5x5_K;
+    table.convolve5x5Pixels = 4;
+    // The SSSE3 color matrix kernels are not used, as they fail the RenderScript CTS tests.
+    auto setBlend = [&table](BlendingMode mode, void (*kernel)(void*, const void*, uint32_t)) {
+        table.blend[static_cast<int>(mode)] = kernel;
+    };
+    setBlend(BlendingMode::SRC_OVER, rsdIntrinsicBlendSrcOver_K);
+    setBlend(BlendingMode::DST_OVER, rsdIntrinsicBlendDstOver_K);
+    setBlend(BlendingMode::SRC_IN, rsdIntrinsicBlendSrcIn_K);
+    setBlend(BlendingMode::DST_IN, rsdIntrinsicBlendDstIn_K);
+    setBlend(BlendingMode::SRC_OUT, rsdIntrinsicBlendSrcOut_K);
+    setBlend(BlendingMode::DST_OUT, rsdIntrinsicBlendDstOut_K);
+    setBlend(BlendingMode::SRC_ATOP, rsdIntrinsicBlendSrcAtop_K);
+    setBlend(BlendingMode::DST_ATOP, rsdIntrinsicBlendDstAtop_K);
+    setBlend(BlendingMode::XOR, rsdIntrinsicBlendXor_K);
+    setBlend(BlendingMode::MULTIPLY, rsdIntrinsicBlendMultiply_K);
+    setBlend(BlendingMode::ADD, rsdIntrinsicBlendAdd_K);
+    setBlend(BlendingMode::SUBTRACT, rsdIntrinsicBlendSub_K);
+    table.yuvToRgb = rsdIntrinsicYuv_K;
+
+#if defined(ARCH_X86_USE_AVX2)
+    if (tier == SimdTier::AVX2 || tier == SimdTier::AVX512) {
+        // The last pairs of pixels of a row go to the SSSE3 kernel, rather than to the generic
+        // code, so that each pixel is computed the same way with both tiers.
+        table.convolve3x3Tail = table.convolve3x3;
+        table.convolve3x3TailPixels = table.convolve3x3Pixels;
+        table.blurVFU4 = rsdIntrinsicBlurVFU4_avx2_K;
+        table.blurHFU4 = rsdIntrinsicBlurHFU4_avx2_K;
+        table.convolve3x3 = rsdIntrinsicConvolve3x3_avx2_K;
+        table.convolve3x3Pixels = 4;
+        table.convolve5x5 = rsdIntrinsicConvolve5x5_avx2_K;
+        table.convolve5x5Pixels = 4;
+        table.colorMatrix = rsdIntrinsicColorMatrix4x4_avx2_K;
+        table.colorMatrixPixels = 4;
+        setBlend(BlendingMode::SRC_OVER, rsdIntrinsicBlendSrcOver_avx2_K);
+        setBlend(BlendingMode::DST_OVER, rsdIntrinsicBlendDstOver_avx2_K);
+        setBlend(BlendingMode::SRC_IN, rsdIntrinsicBlendSrcIn_avx2_K);
+        setBlend(BlendingMode::DST_IN, rsdIntrinsicBlendDstIn_avx2_K);
+        setBlend(BlendingMode::SRC_OUT, rsdIntrinsicBlendSrcOut_avx2_K);
+        setBlend(BlendingMode::DST_OUT, rsdIntrinsicBlendDstOut_avx2_K);
+        setBlend(BlendingMode::SRC_ATOP, rsdIntrinsicBlendSrcAtop_avx2_K);
+        setBlend(BlendingMode::DST_ATOP, rsdIntrinsicBlendDstAtop_avx2_K);
+        setBlend(BlendingMode::XOR, rsdIntrinsicBlendXor_avx2_K);
+        setBlend(BlendingMode::MULTIPLY, rsdIntrinsicBlendMultiply_avx2_K);
+        setBlend(BlendingMode::ADD, rsdIntrinsicBlendAdd_avx2_K);
+        setBlend(BlendingMode::SUBTRACT, rsdIntrinsicBlendSub_avx2_K);
+    }
+#endif
+#if defined(ARCH_X86_USE_AVX512)
+    if (tier == SimdTier::AVX512) {
+        // The 1 to 7 pixels left at the end of a row go to the narrower kernels of the tier below.
+        table.convolve5x5Tail = table.convolve5x5;
+        table.convolve5x5TailPixels = table.convolve5x5Pixels;
+        table.colorMatrixTail = table.colorMatrix;
+        table.colorMatrixTailPixels = table.colorMatrixPixels;
+        table.convolve5x5 = rsdIntrinsicConvolve5x5_avx512_K;
+        table.convolve5x5Pixels = 8;
+        table.colorMatrix = rsdIntrinsicColorMatrix4x4_avx512_K;
+        table.colorMatrixPixels = 8;
+    }
+#endif
+#endif  // defined(ARCH_X86_HAVE_SSSE3)
+    return table;
+}
+
+SimdTier bestSupportedSimdTier() {
+#if defined(ARCH_X86_HAVE_SSSE3)
+    if (!cpuSupportsSimd()) {
+        return SimdTier::SCALAR;
+    }
+#if defined(ARCH_X86_USE_AVX512)
+    if (cpuSupportsAvx512()) {
+        return SimdTier::AVX512;
+    }
+#endif
+#if defined(ARCH_X86_USE_AVX2)
+    if (cpuSupportsAvx2()) {
+        return SimdTier::AVX2;
+    }
+#endif
+    return SimdTier::SSSE3;
+#elif defined(ARCH_ARM64_USE_INTRINSICS)
+    return cpuSupportsSimd() ? SimdTier::ASIMD : SimdTier::SCALAR;
+#elif defined(ARCH_ARM_USE_INTRINSICS)
+    return cpuSupportsSimd() ? SimdTier::NEON : SimdTier::SCALAR;
+#else
+    return SimdTier::SCALAR;
+#endif
+}
+
+SimdTier defaultSimdTier() {
+    const char* value = getenv(kSimdTierVariable);
+    if (value != nullptr && value[0] != '\0') {
+        for (SimdTier tier : kAllTiers) {
+            if (strcasecmp(value, simdTierName(tier)) == 0) {
+                return selectSimdTier(tier);
+            }
+        }
+        ALOGW("Unknown SIMD tier '%s' in %s. Using the best supported tier.", value,
+              kSimdTierVariable);
+    }
+    return bestSupportedSimdTier();
+}
+
+SimdTier selectSimdTier(SimdTier requested) {
+    const SimdTier best = bestSupportedSimdTier();
+    if (requested == SimdTier::SCALAR || requested == best) {
+        return requested;
+    }
+    // The x86 tiers are ordered. We can use any tier up to the best one.
+    SimdTier selected = SimdTier::SCALAR;
+    if (isX86Tier(requested) && isX86Tier(best)) {
+        selected = std::min(requested, best);
+    }
+    if (selected != requested) {
+        ALOGW("The %s SIMD tier is not supported by this processor. Using %s instead.",
+              simdTierName(requested), simdTierName(selected));
+    }
+    return selected;
+}
+
+const KernelTable* kernelTableFor(SimdTier tier) {
+    static const KernelTable tables[] = {
+            makeKernelTable(SimdTier::SCALAR), makeKernelTable(SimdTier::SSSE3),
+            makeKernelTable(SimdTier::AVX2),   makeKernelTable(SimdTier::AVX512),
+            makeKernelTable(SimdTier::NEON),   makeKernelTable(SimdTier::ASIMD)};
+    return &tables[static_cast<int>(tier)];
+}
+
+const char* simdTierName(SimdTier tier) {
+    switch (tier) {
+        case SimdTier::SCALAR:
+            return "scalar";
+        case SimdTier::SSSE3:
+            return "ssse3";
+        case SimdTier::AVX2:
+            return "avx2";
+        case SimdTier::AVX512:
+            return "avx512";
+        case SimdTier::NEON:
+            return "neon";
+        case SimdTier::ASIMD:
+            return "asimd";
+    }
+    return "unknown";
+}
+
+}  // namespace renderscript
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_KERNELTABLE_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_KERNELTABLE_H
+
+#include <cstdint>
+
+#include "RenderScriptToolkit.h"
+
+namespace renderscript {
+
+using SimdTier = RenderScriptToolkit::SimdTier;
+
+/**
+ * The number of blending modes that may have a SIMD kernel, i.e. CLEAR to SUBTRACT.
+ */
+constexpr int kNumberOfBlendKernels = 15;
+
+/**
+ * The SIMD kernels available to the tasks for one SIMD tier.
+ *
+ * The TaskProcessor selects the table of its tier when it's constructed and gives it to each
+ * task. The tasks call the kernels through the table rather than checking the processor
+ * features themselves. This lets one binary carry several tiers and lets us force a lower tier
+ * at runtime. When an entry is null, the tier has no kernel for that operation and the task
+ * uses its generic C++ code.
+ *
+ * Only the x86 kernels are in the table. The ARM kernels are built for a single architecture
+ * and the tasks call them directly when mUsesSimd is set, i.e. when the tier is NEON or ASIMD.
+ */
+struct KernelTable {
+    SimdTier tier = SimdTier::SCALAR;
+
+    /**
+     * The vertical pass of the blur, for RGBA. See rsdIntrinsicBlurVFU4_K. x2 - x1 must be even.
+     */
+    void (*blurVFU4)(void* dst, const void* pin, int stride, const void* gptr, int rct, int x1,
+                     int x2) = nullptr;
+    /**
+     * The horizontal pass of the blur, for RGBA and for single bytes.
+     */
+    void (*blurHFU4)(void* dst, const void* pin, const void* gptr, int rct, int x1,
+                     int x2) = nullptr;
+    void (*blurHFU1)(void* dst, const void* pin, const void* gptr, int rct, int x1,
+                     int x2) = nullptr;
+
+    /**
+     * The 3x3 convolution of count groups of convolve3x3Pixels RGBA pixels. The row pointers
+     * point one pixel to the left of the first pixel to compute.
+     */
+    void (*convolve3x3)(void* dst, const void* y0, const void* y1, const void* y2,
+                        const int16_t* coef, uint32_t count) = nullptr;
+    uint32_t convolve3x3Pixels = 0;
+    /**
+     * When not null, a narrower convolve3x3 for the pixels of a row left over by the wide one,
+     * in groups of convolve3x3TailPixels.
+     */
+    void (*convolve3x3Tail)(void* dst, const void* y0, const void* y1, const void* y2,
+                            const int16_t* coef, uint32_t count) = nullptr;
+    uint32_t convolve3x3TailPixels = 0;
+    /**
+     * The 5x5 convolution of count groups of convolve5x5Pixels RGBA pixels. The row pointers
+     * point two pixels to the left of the first pixel to compute.
+     */
+    void (*convolve5x5)(void* dst, const void* y0, const void* y1, const void* y2, const void* y3,
+                        const void* y4, const int16_t* coef, uint32_t count) = nullptr;
+    uint32_t convolve5x5Pixels = 0;
+    /**
+     * When not null, a narrower convolve5x5 for the pixels of a row left over by the wide one,
+     * in groups of convolve5x5TailPixels.
+     */
+    void (*convolve5x5Tail)(void* dst, const void* y0, const void* y1, const void* y2,
+                            const void* y3, const void* y4, const int16_t* coef,
+                            uint32_t count) = nullptr;
+    uint32_t convolve5x5TailPixels = 0;
+
+    /**
+     * The color matrix of count groups of colorMatrixPixels pixels of 3 or 4 bytes, computed in
+     * floating point like the generic code. See rsdIntrinsicColorMatrix4x4_avx2_K.
+     */
+    void (*colorMatrix)(void* dst, const void* src, const float* coef, const float* add,
+                        uint32_t count, bool zeroInputAlpha) = nullptr;
+    uint32_t colorMatrixPixels = 0;
+    /**
+     * When not null, a narrower colorMatrix for the pixels of a row left over by the wide one, in
+     * groups of colorMatrixTailPixels.
+     */
+    void (*colorMatrixTail)(void* dst, const void* src, const float* coef, const float* add,
+                            uint32_t count, bool zeroInputAlpha) = nullptr;
+    uint32_t colorMatrixTailPixels = 0;
+
+    /**
+     * The blend kernels, indexed by BlendingMode. count8 is the number of groups of 8 pixels.
+     */
+    void (*blend[kNumberOfBlendKernels])(void* dst, const void* src, uint32_t count8) = {};
+
+    /**
+     * The conversion of count groups of 8 NV21 pixels to RGBA. pUV points to the interleaved
+     * V and U values.
+     */
+    void (*yuvToRgb)(void* dst, const uint8_t* pY, const uint8_t* pUV, uint32_t count,
+                     const int16_t* param) = nullptr;
+};
+
+/**
+ * Returns the best SIMD tier supported by both this processor and this build of the Toolkit.
+ */
+SimdTier bestSupportedSimdTier();
+
+/**
+ * Returns the tier set by the RENDERSCRIPT_TOOLKIT_SIMD_TIER environment variable, or the best
+ * supported tier if it's not set.
+ */
+SimdTier defaultSimdTier();
+
+/**
+ * Returns the tier to use when the requested one is asked for. That's the requested tier if
+ * it's supported, otherwise the best supported tier below it.
+ */
+SimdTier selectSimdTier(SimdTier requested);
+
+/**
+ * Returns the kernel table of a tier. The tier must be supported, see selectSimdTier().
+ */
+const KernelTable* kernelTableFor(SimdTier tier);
+
+/**
+ * Returns the name of the tier, as used in RENDERSCRIPT_TOOLKIT_SIMD_TIER.
+ */
+const char* simdTierName(SimdTier tier);
+
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_KERNELTABLE_H
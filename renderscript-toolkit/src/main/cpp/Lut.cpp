@@ -37,6 +37,9 @@ class LutTask : public Task {
                      size_t endY) override;
 
    public:
+    const char* name() const override { return "lut"; }
+    const void* dataOfRow(size_t y) const override { return mIn + mSizeX * y; }
+
     LutTask(const uint8_t* input, uint8_t* output, size_t sizeX, size_t sizeY, const uint8_t* red,
             const uint8_t* green, const uint8_t* blue, const uint8_t* alpha,
             const Restriction* restriction)
@@ -64,17 +67,36 @@ void LutTask::processData(int /* threadIndex */, size_t startX, size_t startY, s
     }
 }
 
-void RenderScriptToolkit::lut(const uint8_t* input, uint8_t* output, size_t sizeX, size_t sizeY,
-                              const uint8_t* red, const uint8_t* green, const uint8_t* blue,
-                              const uint8_t* alpha, const Restriction* restriction) {
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::lut(const uint8_t* input, uint8_t* output,
+                                                         size_t sizeX, size_t sizeY,
+                                                         const uint8_t* red, const uint8_t* green,
+                                                         const uint8_t* blue, const uint8_t* alpha,
+                                                         const Restriction* restriction,
+                                                         const TaskOptions* options) {
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
     if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
-        return;
+        return TaskStatus::INVALID_ARGUMENTS;
     }
 #endif
 
     LutTask task(input, output, sizeX, sizeY, red, green, blue, alpha, restriction);
-    processor->doTask(&task);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::lutAsync(
+        const uint8_t* input, uint8_t* output, size_t sizeX, size_t sizeY, const uint8_t* red,
+        const uint8_t* green, const uint8_t* blue, const uint8_t* alpha,
+        const Restriction* restriction, Callback callback, const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
+        return TaskHandle();
+    }
+#endif
+
+    return TaskHandle(processor->startTask(
+            std::make_unique<LutTask>(input, output, sizeX, sizeY, red, green, blue, alpha,
+                                      restriction),
+            std::move(callback), options));
 }
 
 }  // namespace renderscript
@@ -51,6 +51,11 @@ class Lut3dTask : public Task {
                      size_t endY) override;
 
    public:
+    const char* name() const override { return "lut3d"; }
+    // The trilinear interpolation reads 8 entries of the cube.
+    size_t costPerCell() const override { return 4 * 8; }
+    const void* dataOfRow(size_t y) const override { return mIn + mSizeX * y; }
+
     Lut3dTask(const uint8_t* input, uint8_t* output, size_t sizeX, size_t sizeY,
               const uint8_t* cube, int cubeSizeX, int cubeSizeY, int cubeSizeZ,
               const Restriction* restriction)
@@ -163,17 +168,36 @@ void Lut3dTask::processData(int /* threadIndex */, size_t startX, size_t startY,
     }
 }
 
-void RenderScriptToolkit::lut3d(const uint8_t* input, uint8_t* output, size_t sizeX, size_t sizeY,
-                                const uint8_t* cube, size_t cubeSizeX, size_t cubeSizeY,
-                                size_t cubeSizeZ, const Restriction* restriction) {
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::lut3d(const uint8_t* input, uint8_t* output,
+                                                           size_t sizeX, size_t sizeY,
+                                                           const uint8_t* cube, size_t cubeSizeX,
+                                                           size_t cubeSizeY, size_t cubeSizeZ,
+                                                           const Restriction* restriction,
+                                                           const TaskOptions* options) {
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
     if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
-        return;
+        return TaskStatus::INVALID_ARGUMENTS;
     }
 #endif
 
     Lut3dTask task(input, output, sizeX, sizeY, cube, cubeSizeX, cubeSizeY, cubeSizeZ, restriction);
-    processor->doTask(&task);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::lut3dAsync(
+        const uint8_t* input, uint8_t* output, size_t sizeX, size_t sizeY, const uint8_t* cube,
+        size_t cubeSizeX, size_t cubeSizeY, size_t cubeSizeZ, const Restriction* restriction,
+        Callback callback, const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validRestriction(LOG_TAG, sizeX, sizeY, restriction)) {
+        return TaskHandle();
+    }
+#endif
+
+    return TaskHandle(processor->startTask(
+            std::make_unique<Lut3dTask>(input, output, sizeX, sizeY, cube, cubeSizeX, cubeSizeY,
+                                        cubeSizeZ, restriction),
+            std::move(callback), options));
 }
 
 }  // namespace renderscript
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NodeTiles.h"
+
+namespace renderscript {
+
+NodeTiles::NodeTiles(const std::vector<int>& nodeOfTile, int numberOfNodes)
+    : mQueues(numberOfNodes) {
+    for (size_t tile = 0; tile < nodeOfTile.size(); tile++) {
+        mQueues[nodeOfTile[tile]].tiles.push_back(static_cast<int>(tile));
+    }
+}
+
+bool NodeTiles::claim(int node, int* tileIndex) {
+    const size_t numberOfQueues = mQueues.size();
+    for (size_t i = 0; i < numberOfQueues; i++) {
+        Queue& queue = mQueues[(node + i) % numberOfQueues];
+        // Checking first keeps the counters of the empty queues from growing.
+        if (queue.next.load(std::memory_order_relaxed) >= queue.tiles.size()) {
+            continue;
+        }
+        const size_t next = queue.next.fetch_add(1, std::memory_order_relaxed);
+        if (next < queue.tiles.size()) {
+            *tileIndex = queue.tiles[next];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool NodeTiles::hasTilesLeft() const {
+    for (const Queue& queue : mQueues) {
+        if (queue.next.load(std::memory_order_relaxed) < queue.tiles.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace renderscript
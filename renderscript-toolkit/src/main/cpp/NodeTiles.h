@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_NODETILES_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_NODETILES_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace renderscript {
+
+/**
+ * Distributes the tiles of a task for the NUMA_NODES scheduler.
+ *
+ * The tiles are split into one queue per NUMA node, usually a contiguous band of rows. The
+ * threads running on a node take the tiles of its queue in order, from a counter shared by the
+ * threads of the node only. Once it's empty, they help with the queues of the other nodes. Each
+ * queue is on its own cache line.
+ */
+class NodeTiles {
+    struct alignas(64) Queue {
+        std::vector<int> tiles;
+        std::atomic<size_t> next{0};
+    };
+    std::vector<Queue> mQueues;
+
+   public:
+    /**
+     * Puts each tile in the queue of its node. nodeOfTile holds the node of each tile, between 0
+     * and numberOfNodes - 1.
+     */
+    NodeTiles(const std::vector<int>& nodeOfTile, int numberOfNodes);
+
+    /**
+     * Claims the next tile for a thread running on the node, taking one of another node if there
+     * are none left on this one. Returns false when all the tiles have been claimed.
+     */
+    bool claim(int node, int* tileIndex);
+
+    /**
+     * Returns whether some tiles have not been claimed yet.
+     */
+    bool hasTilesLeft() const;
+};
+
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_NODETILES_H
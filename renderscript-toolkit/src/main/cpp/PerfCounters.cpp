@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PerfCounters.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Utils.h"
+
+#define LOG_TAG "renderscript.toolkit.PerfCounters"
+
+namespace renderscript {
+
+#ifdef __linux__
+
+namespace {
+
+struct CounterConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+/**
+ * The perf_event_open configuration of each counter, indexed by HardwareCounter.
+ */
+const CounterConfig kCounterConfigs[kNumberOfHardwareCounters] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        // The generic cache miss event is the last level cache on most processors.
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+int openCounter(const CounterConfig& counter, int groupFd) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter.type;
+    attr.config = counter.config;
+    attr.read_format =
+            PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // Only count this thread in user space. This is what perf_event_paranoid 2 allows.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(
+            syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC));
+}
+
+}  // namespace
+
+PerfCounterGroup::PerfCounterGroup() {
+    for (int i = 0; i < kNumberOfHardwareCounters; i++) {
+        mFds[i] = openCounter(kCounterConfigs[i], mLeaderFd);
+        mPositions[i] = -1;
+        if (mFds[i] < 0) {
+            continue;
+        }
+        if (mLeaderFd < 0) {
+            mLeaderFd = mFds[i];
+        }
+        mPositions[i] = mNumberOfOpenCounters++;
+    }
+    if (mLeaderFd < 0) {
+        ALOGW("Can't open the hardware counters: %s", strerror(errno));
+    }
+}
+
+PerfCounterGroup::~PerfCounterGroup() {
+    for (int fd : mFds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool PerfCounterGroup::read(uint64_t values[kNumberOfHardwareCounters]) const {
+    if (mLeaderFd < 0) {
+        return false;
+    }
+    // The layout of a group read: the number of counters, the time enabled, the time running,
+    // and the values in the order the counters were added to the group.
+    uint64_t buffer[3 + kNumberOfHardwareCounters];
+    const ssize_t expected = static_cast<ssize_t>((3 + mNumberOfOpenCounters) * sizeof(uint64_t));
+    if (::read(mLeaderFd, buffer, sizeof(buffer)) != expected) {
+        return false;
+    }
+    const uint64_t enabled = buffer[1];
+    const uint64_t running = buffer[2];
+    for (int i = 0; i < kNumberOfHardwareCounters; i++) {
+        if (mPositions[i] < 0 || running == 0) {
+            values[i] = 0;
+            continue;
+        }
+        const uint64_t value = buffer[3 + mPositions[i]];
+        // When the counters don't all fit in the processor, the kernel multiplexes them and only
+        // counts part of the time. Extrapolate to the whole time.
+        values[i] = running == enabled
+                            ? value
+                            : static_cast<uint64_t>(static_cast<double>(value) *
+                                                    static_cast<double>(enabled) /
+                                                    static_cast<double>(running));
+    }
+    return true;
+}
+
+#else  // __linux__
+
+PerfCounterGroup::PerfCounterGroup() {
+    for (int i = 0; i < kNumberOfHardwareCounters; i++) {
+        mFds[i] = -1;
+        mPositions[i] = -1;
+    }
+}
+
+PerfCounterGroup::~PerfCounterGroup() {}
+
+bool PerfCounterGroup::read(uint64_t* /* values */) const { return false; }
+
+#endif  // __linux__
+
+const PerfCounterGroup* perfCounterGroupOfThisThread() {
+    // Each thread needs its own group, as a group counts only the thread that opened it.
+    thread_local PerfCounterGroup group;
+    return group.isOpen() ? &group : nullptr;
+}
+
+}  // namespace renderscript
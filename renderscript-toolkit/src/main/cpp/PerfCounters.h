@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_PERFCOUNTERS_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_PERFCOUNTERS_H
+
+#include <cstdint>
+
+#include "RenderScriptToolkit.h"
+
+namespace renderscript {
+
+using HardwareCounter = RenderScriptToolkit::HardwareCounter;
+using HardwareCounters = RenderScriptToolkit::HardwareCounters;
+constexpr int kNumberOfHardwareCounters = RenderScriptToolkit::kNumberOfHardwareCounters;
+
+/**
+ * A group of hardware performance counters that count the user space events of the thread that
+ * opened it. The counters are opened with perf_event_open and run until the group is destroyed.
+ *
+ * The counters that the processor or the kernel don't support are left out of the group, so
+ * a group can have fewer than kNumberOfHardwareCounters counters. The counts are scaled when
+ * the kernel has to multiplex the counters.
+ */
+class PerfCounterGroup {
+    /**
+     * The file descriptors of the counters, indexed by HardwareCounter. -1 if not open.
+     */
+    int mFds[kNumberOfHardwareCounters];
+    /**
+     * The file descriptor of the group leader, i.e. the first counter that could be opened.
+     */
+    int mLeaderFd = -1;
+    /**
+     * The position of each counter in the values read from the group, or -1 if not open.
+     */
+    int mPositions[kNumberOfHardwareCounters];
+    int mNumberOfOpenCounters = 0;
+
+   public:
+    PerfCounterGroup();
+    ~PerfCounterGroup();
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    /**
+     * Returns true if at least one counter is open.
+     */
+    bool isOpen() const { return mNumberOfOpenCounters > 0; }
+
+    bool isAvailable(HardwareCounter counter) const {
+        return mPositions[static_cast<int>(counter)] >= 0;
+    }
+
+    /**
+     * Reads the current counts into values, indexed by HardwareCounter. The counters that are not
+     * open read as 0. Returns false if the counts can't be read.
+     */
+    bool read(uint64_t values[kNumberOfHardwareCounters]) const;
+};
+
+/**
+ * Returns the counter group of the calling thread, opening it on the first call. Returns nullptr
+ * if none of its counters can be opened, e.g. if the platform is not Linux, the processor has no
+ * performance monitoring unit, or perf_event_paranoid forbids it.
+ */
+const PerfCounterGroup* perfCounterGroupOfThisThread();
+
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_PERFCOUNTERS_H
@@ -16,7 +16,13 @@
 
 #include "RenderScriptToolkit.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+
 #include "TaskProcessor.h"
+#include "Utils.h"
 
 #define LOG_TAG "renderscript.toolkit.RenderScriptToolkit"
 
@@ -25,12 +31,160 @@ namespace renderscript {
 // You will find the implementation of the various transformations in the correspondingly
 // named source file. E.g. RenderScriptToolkit::blur() is found in Blur.cpp.
 
+/**
+ * The environment variable that names the tuning profile loaded at construction.
+ */
+static const char* const kTuningProfileVariable = "RENDERSCRIPT_TOOLKIT_TUNING_PROFILE";
+
+/**
+ * The environment variable that replaces kDefaultMaxThreads when the constructor picks the number
+ * of threads.
+ */
+static const char* const kMaxThreadsVariable = "RENDERSCRIPT_TOOLKIT_MAX_THREADS";
+
+/**
+ * Returns the cap on the number of threads set by kMaxThreadsVariable, or kDefaultMaxThreads if
+ * it's not set or not a number. A typo must not lift the cap, as 0 would.
+ */
+static int maxThreadsFromEnvironment() {
+    const char* value = getenv(kMaxThreadsVariable);
+    if (value == nullptr || value[0] == '\0') {
+        return RenderScriptToolkit::kDefaultMaxThreads;
+    }
+    char* end;
+    errno = 0;
+    const long maxThreads = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || maxThreads < 0 ||
+        maxThreads > INT_MAX) {
+        ALOGW("Invalid %s '%s'. Using at most %d threads.", kMaxThreadsVariable, value,
+              RenderScriptToolkit::kDefaultMaxThreads);
+        return RenderScriptToolkit::kDefaultMaxThreads;
+    }
+    return static_cast<int>(maxThreads);
+}
+
+/**
+ * Returns the number of threads the constructor creates when asked for numberOfThreads.
+ */
+static int numberOfThreadsToCreate(int numberOfThreads) {
+    if (numberOfThreads > 0) {
+        return numberOfThreads;
+    }
+    return RenderScriptToolkit::defaultNumberOfThreads(maxThreadsFromEnvironment());
+}
+
 RenderScriptToolkit::RenderScriptToolkit(int numberOfThreads)
-    : processor{new TaskProcessor(numberOfThreads)} {}
+    : RenderScriptToolkit(numberOfThreads, defaultSimdTier()) {}
+
+RenderScriptToolkit::RenderScriptToolkit(int numberOfThreads, SimdTier simdTier)
+    : processor{new TaskProcessor(numberOfThreadsToCreate(numberOfThreads), simdTier)} {
+    const char* profile = getenv(kTuningProfileVariable);
+    if (profile != nullptr && profile[0] != '\0') {
+        loadTuningProfile(profile);
+    }
+}
 
 RenderScriptToolkit::~RenderScriptToolkit() {
     // By defining the destructor here, we don't need to include TaskProcessor.h
     // in RenderScriptToolkit.h.
 }
 
+RenderScriptToolkit::SimdTier RenderScriptToolkit::getSimdTier() const {
+    return processor->getSimdTier();
+}
+
+int RenderScriptToolkit::getNumberOfThreads() const {
+    return static_cast<int>(processor->getNumberOfThreads());
+}
+
+int RenderScriptToolkit::defaultNumberOfThreads(int maxThreads) {
+    const unsigned int max = static_cast<unsigned int>(std::max(0, maxThreads));
+    return static_cast<int>(TaskProcessor::defaultNumberOfThreads(max));
+}
+
+void RenderScriptToolkit::setNumberOfThreads(int numberOfThreads, int maxThreads) {
+    processor->setNumberOfThreads(numberOfThreads > 0 ? numberOfThreads
+                                                      : defaultNumberOfThreads(maxThreads));
+}
+
+bool RenderScriptToolkit::TaskHandle::isDone() const {
+    return mTask == nullptr || mTask->done.load(std::memory_order_acquire);
+}
+
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::TaskHandle::wait() {
+    if (mTask == nullptr) {
+        return TaskStatus::INVALID_ARGUMENTS;
+    }
+    if (!isDone()) {
+        mTask->processor->waitFor(mTask.get());
+    }
+    return mTask->status.load(std::memory_order_relaxed);
+}
+
+void RenderScriptToolkit::setScheduler(Scheduler scheduler) { processor->setScheduler(scheduler); }
+
+RenderScriptToolkit::Scheduler RenderScriptToolkit::getScheduler() const {
+    return processor->getScheduler();
+}
+
+void RenderScriptToolkit::setWaitPolicy(WaitPolicy policy, int spinMicroseconds) {
+    processor->setWaitPolicy(policy, spinMicroseconds);
+}
+
+RenderScriptToolkit::WaitPolicy RenderScriptToolkit::getWaitPolicy() const {
+    return processor->getWaitPolicy();
+}
+
+bool RenderScriptToolkit::setCpuAffinity(const std::vector<int>& cpus, ThreadPlacement placement) {
+    return processor->setCpuAffinity(cpus, placement);
+}
+
+void RenderScriptToolkit::clearCpuAffinity() { processor->clearCpuAffinity(); }
+
+void RenderScriptToolkit::enableTileAutotuning(bool enable) {
+    processor->enableTileAutotuning(enable);
+}
+
+void RenderScriptToolkit::setTuning(const Tuning& tuning) { processor->setTuning(tuning); }
+
+std::vector<RenderScriptToolkit::Tuning> RenderScriptToolkit::getTuning() const {
+    return processor->getTuning();
+}
+
+void RenderScriptToolkit::clearTuning() { processor->clearTuning(); }
+
+bool RenderScriptToolkit::loadTuningProfile(const char* path) {
+    return processor->loadTuningProfile(path);
+}
+
+bool RenderScriptToolkit::saveTuningProfile(const char* path) const {
+    return processor->saveTuningProfile(path);
+}
+
+bool RenderScriptToolkit::enableHardwareCounters(bool enable) {
+    return processor->enableHardwareCounters(enable);
+}
+
+RenderScriptToolkit::HardwareCounters RenderScriptToolkit::getHardwareCounters() const {
+    return processor->getHardwareCounters();
+}
+
+void RenderScriptToolkit::resetHardwareCounters() { processor->resetHardwareCounters(); }
+
+void RenderScriptToolkit::startTracing() { processor->startTracing(); }
+
+void RenderScriptToolkit::stopTracing() { processor->stopTracing(); }
+
+bool RenderScriptToolkit::writeTrace(const char* path) { return processor->writeTrace(path); }
+
+std::vector<RenderScriptToolkit::OperationStats> RenderScriptToolkit::getStats() const {
+    return processor->getStats();
+}
+
+std::vector<RenderScriptToolkit::WorkerStats> RenderScriptToolkit::getWorkerStats() const {
+    return processor->getWorkerStats();
+}
+
+void RenderScriptToolkit::resetStats() { processor->resetStats(); }
+
 }  // namespace renderscript
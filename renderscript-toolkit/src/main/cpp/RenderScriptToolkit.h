@@ -17,12 +17,18 @@
 #ifndef ANDROID_RENDERSCRIPT_TOOLKIT_TOOLKIT_H
 #define ANDROID_RENDERSCRIPT_TOOLKIT_TOOLKIT_H
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace renderscript {
 
 class TaskProcessor;
+struct ActiveTask;
 
 /**
  * Define a range of data to process.
@@ -55,11 +61,12 @@ struct Restriction {
  *
  * You should instantiate the Toolkit once and reuse it throughout your application.
  * On instantiation, the Toolkit creates a thread pool that's used for processing all the functions.
- * You can limit the number of pool threads used by the Toolkit via the constructor. The pool
- * threads are destroyed once the Toolkit is destroyed, after any pending work is done.
+ * You can limit the number of pool threads used by the Toolkit via the constructor, and change it
+ * later with setNumberOfThreads(). The pool threads are destroyed once the Toolkit is destroyed,
+ * after any pending work is done.
  *
- * This library is thread safe. You can call methods from different pool threads. The functions will
- * execute sequentially.
+ * This library is thread safe. You can call methods from different threads. The calls made at the
+ * same time share the pool threads, each calling thread also working on its own call.
  *
  * A Java/Kotlin Toolkit is available. It calls this library through JNI.
  *
@@ -75,18 +82,437 @@ class RenderScriptToolkit {
     std::unique_ptr<TaskProcessor> processor;
 
    public:
+    /**
+     * The families of SIMD instructions the Toolkit has kernels for. A processor supports the
+     * tiers of its architecture up to a certain point, e.g. an x86 processor with AVX2 but
+     * without AVX-512 supports SCALAR, SSSE3, and AVX2.
+     *
+     * SCALAR means that only the generic C++ code is used.
+     */
+    enum class SimdTier {
+        SCALAR = 0,
+        SSSE3 = 1,
+        AVX2 = 2,
+        AVX512 = 3,
+        NEON = 4,
+        ASIMD = 5,
+    };
+
+    /**
+     * The most threads, the calling thread included, that the Toolkit uses when the number of
+     * threads is left to it. Through empirical testing, we've found that more threads seldom
+     * help. Run toolkit_bench --thread-sweep to see how each op scales on a given machine.
+     */
+    static constexpr int kDefaultMaxThreads = 7;
+
     /**
      * Creates the pool threads that are used for processing the method calls.
+     *
+     * numberOfThreads is the number of threads that process the calls, the calling thread
+     * included. If 0, it's defaultNumberOfThreads(). The RENDERSCRIPT_TOOLKIT_MAX_THREADS
+     * environment variable, if set, replaces kDefaultMaxThreads as the cap of that default, with 0
+     * for no cap.
+     *
+     * The Toolkit uses the best SIMD tier supported by the processor. This can be overridden by
+     * setting the RENDERSCRIPT_TOOLKIT_SIMD_TIER environment variable to one of scalar, ssse3,
+     * avx2, avx512, neon, or asimd.
      */
     RenderScriptToolkit(int numberOfThreads = 0);
     /**
-     * Destroys the thread pool. This stops any in-progress work; the Toolkit methods called from
-     * other pool threads will return without having completed the work. Because of the undefined
-     * state of the output buffers, an application should avoid destroying the Toolkit if other pool
-     * threads are executing Toolkit methods.
+     * Same as above, but uses the specified SIMD tier, ignoring the environment. If the processor
+     * does not support that tier, the best supported tier below it is used instead.
+     */
+    RenderScriptToolkit(int numberOfThreads, SimdTier simdTier);
+    /**
+     * Destroys the thread pool. The pool threads first finish the work of the asynchronous calls
+     * in progress. An application should still avoid destroying the Toolkit if other threads are
+     * executing Toolkit methods or using TaskHandles.
      */
     ~RenderScriptToolkit();
 
+    /**
+     * Returns the SIMD tier used by this Toolkit.
+     */
+    SimdTier getSimdTier() const;
+
+    /**
+     * Returns the number of threads that process the method calls, the calling thread included.
+     */
+    int getNumberOfThreads() const;
+
+    /**
+     * Returns the number of threads used when it's left to the Toolkit: the number of CPUs the
+     * process can keep busy, at most maxThreads, or all of them if maxThreads is 0. The CPUs
+     * are those the calling thread may run on, e.g. as restricted by a cpuset, and no more than
+     * the CPU quota of its cgroup, so that a Toolkit in a container limited to 2 CPUs doesn't use
+     * a thread for each CPU of the host.
+     */
+    static int defaultNumberOfThreads(int maxThreads = kDefaultMaxThreads);
+
+    /**
+     * Changes the number of threads that process the method calls, the calling thread included,
+     * by starting or stopping pool threads. If numberOfThreads is 0, it's
+     * defaultNumberOfThreads(maxThreads). The settings, the statistics of the remaining threads,
+     * and the CPU affinity are kept, the threads added being pinned like the others.
+     *
+     * This waits for the calls in progress, asynchronous ones included, to be done. The calls
+     * made meanwhile wait for the pool to be resized. It must not be called from the callback of
+     * an asynchronous call, which would wait for itself.
+     */
+    void setNumberOfThreads(int numberOfThreads, int maxThreads = kDefaultMaxThreads);
+
+    /**
+     * How the tiles of a method call are distributed over the threads.
+     *
+     * SHARED_COUNTER: the threads take the next tile from a single counter. This is the default.
+     *
+     * WORK_STEALING: each thread starts with its own contiguous range of tiles, so that adjacent
+     * rows stay in the cache of one core. A thread that runs out steals the back half of the
+     * largest range left.
+     *
+     * NUMA_NODES: on machines with several NUMA nodes, the tiles are split into one band of rows
+     * per node, matching the node that holds the memory of the input rows, and each thread takes
+     * the tiles of the node it runs on. The threads help with the other nodes only once their
+     * own is done. Pin the threads with setCpuAffinity() to keep them on their nodes. The rows
+     * of resize and yuvToRgb are split into even bands. Same as SHARED_COUNTER on machines with
+     * a single node.
+     */
+    enum class Scheduler {
+        SHARED_COUNTER = 0,
+        WORK_STEALING = 1,
+        NUMA_NODES = 2,
+    };
+    /**
+     * Selects the scheduler used for the method calls started from now on.
+     */
+    void setScheduler(Scheduler scheduler);
+    Scheduler getScheduler() const;
+
+    /**
+     * What the pool threads do when they run out of work.
+     *
+     * PARK: they block until more work is posted. Waking them up goes through the kernel and the
+     * OS scheduler, which can take tens of microseconds per call. This is the default, and the
+     * idle threads don't use any CPU.
+     *
+     * SPIN: they first poll for new work during the spin budget, then park. A call made within
+     * that budget after the threads ran out of work starts without waking them up, at the cost
+     * of keeping their cores busy in the meantime. Good for back-to-back calls, e.g. the
+     * several calls made per frame of a video.
+     *
+     * YIELD: like SPIN, but the threads yield the processor between polls, so that other threads
+     * ready to run on those cores can.
+     */
+    enum class WaitPolicy {
+        PARK = 0,
+        SPIN = 1,
+        YIELD = 2,
+    };
+    static constexpr int kDefaultSpinMicroseconds = 100;
+    /**
+     * Selects the wait policy of the pool threads and, for SPIN and YIELD, how long they poll for
+     * work before parking. It applies from the next time they run out of work.
+     */
+    void setWaitPolicy(WaitPolicy policy, int spinMicroseconds = kDefaultSpinMicroseconds);
+    WaitPolicy getWaitPolicy() const;
+
+    /**
+     * How setCpuAffinity() places the pool threads on the CPUs. Either way, each thread gets a
+     * core of its own as long as there are enough cores.
+     *
+     * COMPACT: on neighboring cores, filling a cluster of cores, then a package, before the next,
+     * so that the threads share the caches of the cluster and the package.
+     *
+     * SCATTER: alternating between the packages and between the clusters of a package, so that
+     * each thread gets as much cache and memory bandwidth as possible.
+     */
+    enum class ThreadPlacement {
+        COMPACT = 0,
+        SCATTER = 1,
+    };
+    /**
+     * Pins each pool thread to one of the CPUs, e.g. to keep them off the cores of the
+     * latency-critical threads of the application, and so that the kernel doesn't migrate them.
+     * The threads that call the Toolkit methods keep their own affinity. If there are more pool
+     * threads than cores, the other hardware threads of the cores are used next, then the CPUs
+     * are used again.
+     *
+     * Returns false, leaving the affinity unchanged, if the list is empty or has a CPU that the
+     * thread that created the Toolkit could not run on. Returns false as well, with the pool
+     * threads unpinned, if the kernel refuses to pin them.
+     */
+    bool setCpuAffinity(const std::vector<int>& cpus,
+                        ThreadPlacement placement = ThreadPlacement::COMPACT);
+    /**
+     * Lets the pool threads run on the CPUs they could when the Toolkit was created.
+     */
+    void clearCpuAffinity();
+
+    /**
+     * The work of each method call is divided into tiles that the threads process. By default,
+     * their size is derived from an estimate of the cost of the op, so that each thread gets
+     * several tiles of similar duration.
+     *
+     * When tile autotuning is enabled, the Toolkit also measures how long each op takes per
+     * pixel, per range of image sizes, and sizes the tiles of the following calls from those
+     * measurements. Enabling it discards the previous measurements. It's off by default.
+     */
+    void enableTileAutotuning(bool enable);
+
+    /**
+     * The number of threads and the tile size to use for the calls of one method, for a range of
+     * image sizes. Ops limited by the memory bandwidth often run as fast with a few threads as
+     * with all of them. Limiting those leaves the other cores to the rest of the application.
+     *
+     * The image sizes are grouped in classes that span a factor of four: the settings apply to
+     * the calls of between pixels, rounded down to a power of four, and four times that. The
+     * number of pixels is that of the output, or of the input for the histograms.
+     */
+    struct Tuning {
+        /** The name of the method, e.g. "blur". */
+        std::string name;
+        size_t pixels = 0;
+        /** At most the number of threads of the Toolkit. 0 to use them all. */
+        int numberOfThreads = 0;
+        /** 0 to size the tiles as when not tuned. See enableTileAutotuning(). */
+        size_t pixelsPerTile = 0;
+    };
+    /**
+     * Sets the tuning of a method for a class of image sizes, replacing the previous one.
+     */
+    void setTuning(const Tuning& tuning);
+    std::vector<Tuning> getTuning() const;
+    void clearTuning();
+    /**
+     * Replaces the tuning by that of a profile file, as written by saveTuningProfile() or by
+     * toolkit_bench --autotune, which measures the best settings on the current machine. Returns
+     * false, keeping the current tuning, if the file can't be read.
+     *
+     * The Toolkit constructors load the profile named by the RENDERSCRIPT_TOOLKIT_TUNING_PROFILE
+     * environment variable, if it's set.
+     */
+    bool loadTuningProfile(const char* _Nonnull path);
+    bool saveTuningProfile(const char* _Nonnull path) const;
+
+    /**
+     * The hardware performance counters that can be captured around the Toolkit method calls.
+     * See enableHardwareCounters().
+     */
+    enum class HardwareCounter {
+        CYCLES = 0,
+        INSTRUCTIONS = 1,
+        L1D_READ_MISSES = 2,
+        LLC_MISSES = 3,
+        BRANCH_MISSES = 4,
+    };
+    static constexpr int kNumberOfHardwareCounters = 5;
+
+    /**
+     * The counts of the hardware events that occurred while the threads were processing the
+     * tiles of the method calls, summed over all the threads. Only the user space events are
+     * counted, so the time spent waiting for work is not included.
+     */
+    struct HardwareCounters {
+        /**
+         * The counts, indexed by HardwareCounter.
+         */
+        uint64_t values[kNumberOfHardwareCounters] = {};
+        /**
+         * Whether each counter is available. Processors, virtual machines, and kernel settings
+         * can prevent some or all of them from being opened.
+         */
+        bool available[kNumberOfHardwareCounters] = {};
+        /**
+         * The number of tiles that were counted.
+         */
+        uint64_t tiles = 0;
+
+        uint64_t get(HardwareCounter counter) const { return values[static_cast<int>(counter)]; }
+        bool has(HardwareCounter counter) const { return available[static_cast<int>(counter)]; }
+    };
+
+    /**
+     * Starts or stops capturing the hardware performance counters around the processing of each
+     * tile. This is meant for benchmarking; it adds two system calls per tile. It's only
+     * supported on Linux, through perf_event_open.
+     *
+     * Returns false if enable is true and none of the counters can be opened.
+     */
+    bool enableHardwareCounters(bool enable);
+    /**
+     * Returns the counts accumulated since the counters were enabled or last reset.
+     */
+    HardwareCounters getHardwareCounters() const;
+    /**
+     * Sets the accumulated counts back to zero.
+     */
+    void resetHardwareCounters();
+
+    /**
+     * Starts recording which thread processed each tile of the method calls, and when. The
+     * trace also shows how long the pool threads took to wake up once the work was available.
+     * Any events recorded before are discarded. When tracing is stopped, its cost is negligible.
+     */
+    void startTracing();
+    /**
+     * Stops recording. The events recorded so far are kept until the next startTracing().
+     */
+    void stopTracing();
+    /**
+     * Writes the recorded events to a file, in the Chrome trace event JSON format. The file can
+     * be opened with https://ui.perfetto.dev or chrome://tracing. Returns false if the file
+     * can't be written.
+     */
+    bool writeTrace(const char* _Nonnull path);
+
+    /**
+     * The statistics of the calls of one Toolkit method. See getStats().
+     *
+     * The latency is the time from the start of the processing of a call to its end. The wait is
+     * the time from the method being called to the start of the processing, e.g. to prepare the
+     * work.
+     * The percentiles are estimated from histograms and are within about 6% of the actual values.
+     */
+    struct OperationStats {
+        /** The name of the method, e.g. "blur". */
+        std::string name;
+        uint64_t calls = 0;
+        /** The number of pixels processed, i.e. the restricted area if there's a restriction. */
+        uint64_t pixels = 0;
+        double totalLatencyUs = 0;
+        double latencyP50Us = 0;
+        double latencyP95Us = 0;
+        double latencyP99Us = 0;
+        double latencyMaxUs = 0;
+        double totalWaitUs = 0;
+        double waitP50Us = 0;
+        double waitP95Us = 0;
+        double waitP99Us = 0;
+        double waitMaxUs = 0;
+        /**
+         * How unevenly the work of a call was spread over the threads: the time the busiest
+         * thread spent processing tiles divided by the mean over the threads that processed
+         * tiles of the call. 1 is a perfect balance, as for a call processed by the calling
+         * thread alone; n means that one of the n threads did almost all the work.
+         */
+        double imbalanceMean = 0;
+        double imbalanceMax = 0;
+    };
+
+    /**
+     * What one thread of the Toolkit has been doing. See getWorkerStats().
+     */
+    struct WorkerStats {
+        /**
+         * 0 for the threads that call the Toolkit methods, which process tiles too. The pool
+         * threads are numbered from 1.
+         */
+        unsigned int threadIndex = 0;
+        /** The number of tiles processed. */
+        uint64_t tiles = 0;
+        /** The time spent processing tiles. */
+        double busyUs = 0;
+        /** The time spent waiting for work. Always 0 for thread 0. */
+        double idleUs = 0;
+        /**
+         * The number of times the thread picked up the work of a call, and the time from the
+         * work being made available to the thread picking it up. Always 0 for thread 0.
+         */
+        uint64_t wakeUps = 0;
+        double totalWakeLatencyUs = 0;
+        double maxWakeLatencyUs = 0;
+        /** The CPU the thread is pinned to, or -1 if it's not. See setCpuAffinity(). */
+        int cpu = -1;
+    };
+
+    /**
+     * Returns the statistics of the methods called since this Toolkit was created or since
+     * resetStats() was last called. There's one entry per method called. The stats are always
+     * collected; it costs a few clock reads and a map lookup per call.
+     */
+    std::vector<OperationStats> getStats() const;
+    /**
+     * Returns the statistics of each thread of the Toolkit, indexed by threadIndex. They cover
+     * the same period as getStats().
+     */
+    std::vector<WorkerStats> getWorkerStats() const;
+    /**
+     * Discards the statistics collected so far, including those of the threads.
+     */
+    void resetStats();
+
+    /**
+     * How urgent a method call is. When calls of different priorities are in progress, the pool
+     * threads work on the most urgent ones first: a thread looking for work picks the most urgent
+     * call with tiles left, and a thread working on a less urgent call moves to a more urgent one
+     * that was just made as soon as it's done with its current tile. The less urgent calls get
+     * the threads back once the more urgent ones have no tiles left to start, so they still
+     * progress at full speed when nothing more urgent is going on.
+     *
+     * The calling thread of a synchronous method always works on its own call, whatever its
+     * priority.
+     */
+    enum class Priority {
+        BACKGROUND = 0,
+        NORMAL = 1,
+        INTERACTIVE = 2,
+    };
+
+    /**
+     * Lets method calls be stopped from another thread, e.g. when the frame they're processing
+     * has become stale. The threads check it between tiles, so a call stops within about one
+     * tile of cancel() being called. A token can be shared by several calls, which cancel() then
+     * stops together.
+     */
+    class CancellationToken {
+       public:
+        void cancel() { mCancelled.store(true, std::memory_order_relaxed); }
+        bool isCancelled() const { return mCancelled.load(std::memory_order_relaxed); }
+        /**
+         * Makes the token usable again, for calls made after this.
+         */
+        void reset() { mCancelled.store(false, std::memory_order_relaxed); }
+
+       private:
+        std::atomic<bool> mCancelled{false};
+    };
+
+    /**
+     * The options of a method call, passed as its last argument. A null pointer is the same as a
+     * default constructed TaskOptions. They're copied, so they don't need to outlive the call,
+     * but the cancellation token does.
+     */
+    struct TaskOptions {
+        Priority priority = Priority::NORMAL;
+        /**
+         * When not null, the call stops once the token is cancelled.
+         */
+        const CancellationToken* _Nullable cancellationToken = nullptr;
+        /**
+         * The call stops if it's not done by then. By default, there's no deadline.
+         */
+        std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::time_point::max();
+    };
+
+    /**
+     * How a method call ended. The synchronous methods return it, and so does TaskHandle::wait().
+     *
+     * A call that's stopped, by its cancellation token or its deadline, processes no more tiles:
+     * the tiles in progress are completed but the others are skipped, so the output is only
+     * partly written, or not at all for the histograms. Only COMPLETE means that the whole output
+     * was written.
+     */
+    enum class TaskStatus {
+        COMPLETE = 0,
+        CANCELLED = 1,
+        DEADLINE_EXCEEDED = 2,
+        /**
+         * The arguments are invalid, so nothing was done. See the error logged.
+         */
+        INVALID_ARGUMENTS = 3,
+    };
+
     /**
      * Determines how a source buffer is blended into a destination buffer.
      *
@@ -206,9 +632,12 @@ class RenderScriptToolkit {
      * @param sizeX The width of both buffers, as a number of RGBA values.
      * @param sizeY The height of both buffers, as a number of RGBA values.
      * @param restriction When not null, restricts the operation to a 2D range of pixels.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void blend(BlendingMode mode, const uint8_t* _Nonnull source, uint8_t* _Nonnull dst,
-               size_t sizeX, size_t sizeY, const Restriction* _Nullable restriction = nullptr);
+    TaskStatus blend(BlendingMode mode, const uint8_t* _Nonnull source, uint8_t* _Nonnull dst,
+                     size_t sizeX, size_t sizeY, const Restriction* _Nullable restriction = nullptr,
+                     const TaskOptions* _Nullable options = nullptr);
 
     /**
      * Blur an image.
@@ -237,9 +666,13 @@ class RenderScriptToolkit {
      * @param vectorSize Either 1 or 4, the number of bytes in each cell, i.e. A vs. RGBA.
      * @param radius The radius of the pixels used to blur.
      * @param restriction When not null, restricts the operation to a 2D range of pixels.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void blur(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX, size_t sizeY,
-              size_t vectorSize, int radius, const Restriction* _Nullable restriction = nullptr);
+    TaskStatus blur(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX, size_t sizeY,
+                    size_t vectorSize, int radius,
+                    const Restriction* _Nullable restriction = nullptr,
+                    const TaskOptions* _Nullable options = nullptr);
 
     /**
      * Identity matrix that can be passed to the {@link RenderScriptToolkit::colorMatrix} method.
@@ -329,11 +762,14 @@ class RenderScriptToolkit {
      * @param matrix The 4x4 matrix to multiply, in row major format.
      * @param addVector A vector of four floats that's added to the result of the multiplication.
      * @param restriction When not null, restricts the operation to a 2D range of pixels.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void colorMatrix(const void* _Nonnull in, void* _Nonnull out, size_t inputVectorSize,
-                     size_t outputVectorSize, size_t sizeX, size_t sizeY,
-                     const float* _Nonnull matrix, const float* _Nullable addVector = nullptr,
-                     const Restriction* _Nullable restriction = nullptr);
+    TaskStatus colorMatrix(const void* _Nonnull in, void* _Nonnull out, size_t inputVectorSize,
+                           size_t outputVectorSize, size_t sizeX, size_t sizeY,
+                           const float* _Nonnull matrix, const float* _Nullable addVector = nullptr,
+                           const Restriction* _Nullable restriction = nullptr,
+                           const TaskOptions* _Nullable options = nullptr);
 
     /**
      * Convolve a ByteArray.
@@ -363,14 +799,18 @@ class RenderScriptToolkit {
      * @param sizeY The height of both buffers, as a number of 1 or 4 byte cells.
      * @param coefficients 9 or 25 multipliers.
      * @param restriction When not null, restricts the operation to a 2D range of pixels.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void convolve3x3(const void* _Nonnull in, void* _Nonnull out, size_t vectorSize, size_t sizeX,
-                     size_t sizeY, const float* _Nonnull coefficients,
-                     const Restriction* _Nullable restriction = nullptr);
+    TaskStatus convolve3x3(const void* _Nonnull in, void* _Nonnull out, size_t vectorSize,
+                           size_t sizeX, size_t sizeY, const float* _Nonnull coefficients,
+                           const Restriction* _Nullable restriction = nullptr,
+                           const TaskOptions* _Nullable options = nullptr);
 
-    void convolve5x5(const void* _Nonnull in, void* _Nonnull out, size_t vectorSize, size_t sizeX,
-                     size_t sizeY, const float* _Nonnull coefficients,
-                     const Restriction* _Nullable restriction = nullptr);
+    TaskStatus convolve5x5(const void* _Nonnull in, void* _Nonnull out, size_t vectorSize,
+                           size_t sizeX, size_t sizeY, const float* _Nonnull coefficients,
+                           const Restriction* _Nullable restriction = nullptr,
+                           const TaskOptions* _Nullable options = nullptr);
 
     /**
      * Compute the histogram of an image.
@@ -395,9 +835,13 @@ class RenderScriptToolkit {
      * @param sizeY The height of the input buffers, as a number of 1 or 4 byte cells.
      * @param vectorSize The number of bytes in each cell, a value from 1 to 4.
      * @param restriction When not null, restricts the operation to a 2D range of pixels.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void histogram(const uint8_t* _Nonnull in, int32_t* _Nonnull out, size_t sizeX, size_t sizeY,
-                   size_t vectorSize, const Restriction* _Nullable restriction = nullptr);
+    TaskStatus histogram(const uint8_t* _Nonnull in, int32_t* _Nonnull out, size_t sizeX,
+                         size_t sizeY, size_t vectorSize,
+                         const Restriction* _Nullable restriction = nullptr,
+                         const TaskOptions* _Nullable options = nullptr);
 
     /**
      * Compute the histogram of the dot product of an image.
@@ -426,10 +870,13 @@ class RenderScriptToolkit {
      * @param vectorSize The number of bytes in each cell, a value from 1 to 4.
      * @param coefficients The values used for the dot product. Can be nullptr.
      * @param restriction When not null, restricts the operation to a 2D range of pixels.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void histogramDot(const uint8_t* _Nonnull in, int32_t* _Nonnull out, size_t sizeX, size_t sizeY,
-                      size_t vectorSize, const float* _Nullable coefficients,
-                      const Restriction* _Nullable restriction = nullptr);
+    TaskStatus histogramDot(const uint8_t* _Nonnull in, int32_t* _Nonnull out, size_t sizeX,
+                            size_t sizeY, size_t vectorSize, const float* _Nullable coefficients,
+                            const Restriction* _Nullable restriction = nullptr,
+                            const TaskOptions* _Nullable options = nullptr);
 
     /**
      * Transform an image using a look up table
@@ -456,11 +903,14 @@ class RenderScriptToolkit {
      * @param blue An array of 256 values that's used to convert the B channel.
      * @param alpha An array of 256 values that's used to convert the A channel.
      * @param restriction When not null, restricts the operation to a 2D range of pixels.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void lut(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX, size_t sizeY,
-             const uint8_t* _Nonnull red, const uint8_t* _Nonnull green,
-             const uint8_t* _Nonnull blue, const uint8_t* _Nonnull alpha,
-             const Restriction* _Nullable restriction = nullptr);
+    TaskStatus lut(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX, size_t sizeY,
+                   const uint8_t* _Nonnull red, const uint8_t* _Nonnull green,
+                   const uint8_t* _Nonnull blue, const uint8_t* _Nonnull alpha,
+                   const Restriction* _Nullable restriction = nullptr,
+                   const TaskOptions* _Nullable options = nullptr);
 
     /**
      * Transform an image using a 3D look up table
@@ -489,10 +939,13 @@ class RenderScriptToolkit {
      * @param cubeSizeY The number of RGBA entries in the cube in the Y direction.
      * @param cubeSizeZ The number of RGBA entries in the cube in the Z direction.
      * @param restriction When not null, restricts the operation to a 2D range of pixels.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void lut3d(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX, size_t sizeY,
-               const uint8_t* _Nonnull cube, size_t cubeSizeX, size_t cubeSizeY, size_t cubeSizeZ,
-               const Restriction* _Nullable restriction = nullptr);
+    TaskStatus lut3d(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX, size_t sizeY,
+                     const uint8_t* _Nonnull cube, size_t cubeSizeX, size_t cubeSizeY,
+                     size_t cubeSizeZ, const Restriction* _Nullable restriction = nullptr,
+                     const TaskOptions* _Nullable options = nullptr);
 
     /**
      * Resize an image.
@@ -518,10 +971,13 @@ class RenderScriptToolkit {
      * @param outputSizeX The width of the output buffer, as a number of 1-4 byte cells.
      * @param outputSizeY The height of the output buffer, as a number of 1-4 byte cells.
      * @param restriction When not null, restricts the operation to a 2D range of pixels.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void resize(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t inputSizeX,
-                size_t inputSizeY, size_t vectorSize, size_t outputSizeX, size_t outputSizeY,
-                const Restriction* _Nullable restriction = nullptr);
+    TaskStatus resize(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t inputSizeX,
+                      size_t inputSizeY, size_t vectorSize, size_t outputSizeX, size_t outputSizeY,
+                      const Restriction* _Nullable restriction = nullptr,
+                      const TaskOptions* _Nullable options = nullptr);
 
     /**
      * The YUV formats supported by yuvToRgb.
@@ -547,9 +1003,176 @@ class RenderScriptToolkit {
      * @param sizeX The width in pixels of the image. Must be even.
      * @param sizeY The height in pixels of the image.
      * @param format Either YV12 or NV21.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
+     */
+    TaskStatus yuvToRgb(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX,
+                        size_t sizeY, YuvFormat format,
+                        const TaskOptions* _Nullable options = nullptr);
+
+    /**
+     * A method call started by one of the Async methods, e.g. blurAsync(). Copies of a handle
+     * refer to the same call. A default constructed handle, like the one returned when the
+     * arguments are invalid, refers to no call and is always done.
+     *
+     * The Toolkit must outlive the handles that are used.
+     */
+    class TaskHandle {
+       public:
+        TaskHandle() = default;
+
+        /**
+         * Returns whether the call is done, i.e. the output has been written and the callback,
+         * if any, has returned.
+         */
+        bool isDone() const;
+        /**
+         * Waits for the call to be done. Unless another thread is already doing so, the calling
+         * thread processes tiles of the call while waiting, as the synchronous methods do.
+         * Must not be called from the callback of the same call. Returns whether the output is
+         * complete, or INVALID_ARGUMENTS for a default constructed handle.
+         */
+        TaskStatus wait();
+
+       private:
+        friend class RenderScriptToolkit;
+        explicit TaskHandle(std::shared_ptr<ActiveTask> task) : mTask{std::move(task)} {}
+
+        std::shared_ptr<ActiveTask> mTask;
+    };
+
+    /**
+     * Called once an asynchronous method call is done, on the thread that completed it. That's
+     * usually a pool thread, so the callback should be quick and must not wait for other calls.
+     */
+    using Callback = std::function<void()>;
+
+    /**
+     * Asynchronous versions of the methods above. They validate the arguments like the
+     * synchronous methods, then start the work on the pool threads and return without waiting for
+     * it. The input and output buffers, and the tables of lut() and lut3d(), must remain valid
+     * until the call is done. The other arguments, including the restriction and the options,
+     * are copied. The options come after the callback.
+     *
+     * When the Toolkit has a single thread, there's no pool thread to do the work, so the call
+     * is done before the method returns.
+     */
+    TaskHandle blendAsync(BlendingMode mode, const uint8_t* _Nonnull source, uint8_t* _Nonnull dst,
+                          size_t sizeX, size_t sizeY,
+                          const Restriction* _Nullable restriction = nullptr,
+                          Callback callback = nullptr,
+                          const TaskOptions* _Nullable options = nullptr);
+    TaskHandle blurAsync(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX,
+                         size_t sizeY, size_t vectorSize, int radius,
+                         const Restriction* _Nullable restriction = nullptr,
+                         Callback callback = nullptr,
+                         const TaskOptions* _Nullable options = nullptr);
+    TaskHandle colorMatrixAsync(const void* _Nonnull in, void* _Nonnull out,
+                                size_t inputVectorSize, size_t outputVectorSize, size_t sizeX,
+                                size_t sizeY, const float* _Nonnull matrix,
+                                const float* _Nullable addVector = nullptr,
+                                const Restriction* _Nullable restriction = nullptr,
+                                Callback callback = nullptr,
+                                const TaskOptions* _Nullable options = nullptr);
+    TaskHandle convolve3x3Async(const void* _Nonnull in, void* _Nonnull out, size_t vectorSize,
+                                size_t sizeX, size_t sizeY, const float* _Nonnull coefficients,
+                                const Restriction* _Nullable restriction = nullptr,
+                                Callback callback = nullptr,
+                                const TaskOptions* _Nullable options = nullptr);
+    TaskHandle convolve5x5Async(const void* _Nonnull in, void* _Nonnull out, size_t vectorSize,
+                                size_t sizeX, size_t sizeY, const float* _Nonnull coefficients,
+                                const Restriction* _Nullable restriction = nullptr,
+                                Callback callback = nullptr,
+                                const TaskOptions* _Nullable options = nullptr);
+    TaskHandle histogramAsync(const uint8_t* _Nonnull in, int32_t* _Nonnull out, size_t sizeX,
+                              size_t sizeY, size_t vectorSize,
+                              const Restriction* _Nullable restriction = nullptr,
+                              Callback callback = nullptr,
+                              const TaskOptions* _Nullable options = nullptr);
+    TaskHandle histogramDotAsync(const uint8_t* _Nonnull in, int32_t* _Nonnull out, size_t sizeX,
+                                 size_t sizeY, size_t vectorSize,
+                                 const float* _Nullable coefficients,
+                                 const Restriction* _Nullable restriction = nullptr,
+                                 Callback callback = nullptr,
+                                 const TaskOptions* _Nullable options = nullptr);
+    TaskHandle lutAsync(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX,
+                        size_t sizeY, const uint8_t* _Nonnull red, const uint8_t* _Nonnull green,
+                        const uint8_t* _Nonnull blue, const uint8_t* _Nonnull alpha,
+                        const Restriction* _Nullable restriction = nullptr,
+                        Callback callback = nullptr,
+                        const TaskOptions* _Nullable options = nullptr);
+    TaskHandle lut3dAsync(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX,
+                          size_t sizeY, const uint8_t* _Nonnull cube, size_t cubeSizeX,
+                          size_t cubeSizeY, size_t cubeSizeZ,
+                          const Restriction* _Nullable restriction = nullptr,
+                          Callback callback = nullptr,
+                          const TaskOptions* _Nullable options = nullptr);
+    TaskHandle resizeAsync(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t inputSizeX,
+                           size_t inputSizeY, size_t vectorSize, size_t outputSizeX,
+                           size_t outputSizeY, const Restriction* _Nullable restriction = nullptr,
+                           Callback callback = nullptr,
+                           const TaskOptions* _Nullable options = nullptr);
+    TaskHandle yuvToRgbAsync(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX,
+                             size_t sizeY, YuvFormat format, Callback callback = nullptr,
+                             const TaskOptions* _Nullable options = nullptr);
+
+    /**
+     * One image of a blurBatch() call. See blur() for the meaning of the fields.
+     */
+    struct BlurJob {
+        const uint8_t* _Nonnull in;
+        uint8_t* _Nonnull out;
+        size_t sizeX;
+        size_t sizeY;
+    };
+
+    /**
+     * Blurs a batch of images, with the same vectorSize and radius. The images can differ in size.
+     *
+     * This is equivalent to calling blur() for each job, but the tiles of all the images are
+     * processed in one go. That's much faster for many small images, each of which would not
+     * have enough tiles to keep all the threads busy, and would pay the cost of waking up the
+     * pool. Returns once all the images are blurred. If the arguments of a job are invalid,
+     * no image is processed.
+     *
+     * @param jobs The images to blur.
+     * @param numberOfJobs The number of entries of jobs.
+     * @param vectorSize Either 1 or 4, the number of bytes in each cell, i.e. A vs. RGBA.
+     * @param radius The radius of the pixels used to blur, a value from 1 to 25.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
+     */
+    TaskStatus blurBatch(const BlurJob* _Nonnull jobs, size_t numberOfJobs, size_t vectorSize,
+                         int radius, const TaskOptions* _Nullable options = nullptr);
+
+    /**
+     * One image of a resizeBatch() call. See resize() for the meaning of the fields.
+     */
+    struct ResizeJob {
+        const uint8_t* _Nonnull in;
+        uint8_t* _Nonnull out;
+        size_t inputSizeX;
+        size_t inputSizeY;
+        size_t outputSizeX;
+        size_t outputSizeY;
+    };
+
+    /**
+     * Resizes a batch of images, with the same vectorSize. The images can differ in size, e.g.
+     * to make thumbnails of many photos.
+     *
+     * Like blurBatch(), this is equivalent to calling resize() for each job, but the tiles of all
+     * the images are processed in one go. If the arguments of a job are invalid, no image is
+     * processed.
+     *
+     * @param jobs The images to resize.
+     * @param numberOfJobs The number of entries of jobs.
+     * @param vectorSize The number of bytes in each cell of all the buffers. A value from 1 to 4.
+     * @param options When not null, the priority, cancellation token, and deadline of the call.
+     * @return Whether the output is complete. See TaskStatus.
      */
-    void yuvToRgb(const uint8_t* _Nonnull in, uint8_t* _Nonnull out, size_t sizeX, size_t sizeY,
-                  YuvFormat format);
+    TaskStatus resizeBatch(const ResizeJob* _Nonnull jobs, size_t numberOfJobs, size_t vectorSize,
+                           const TaskOptions* _Nullable options = nullptr);
 };
 
 }  // namespace renderscript
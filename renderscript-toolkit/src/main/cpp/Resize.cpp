@@ -17,6 +17,7 @@
 #include <math.h>
 
 #include <cstdint>
+#include <functional>
 
 #include "RenderScriptToolkit.h"
 #include "TaskProcessor.h"
@@ -54,6 +55,10 @@ class ResizeTask : public Task {
                      size_t endY) override;
 
    public:
+    const char* name() const override { return "resize"; }
+    // The bicubic interpolation reads 4x4 input cells.
+    size_t costPerCell() const override { return mVectorSize * 16; }
+
     ResizeTask(const uchar* input, uchar* output, size_t inputSizeX, size_t inputSizeY,
                size_t vectorSize, size_t outputSizeX, size_t outputSizeY,
                const Restriction* restriction)
@@ -218,6 +223,84 @@ static uchar OneBiCubic(const uchar *yp0, const uchar *yp1, const uchar *yp2, co
     return (uchar)p;
 }
 
+/**
+ * Returns floor(v) for the coordinates used here, without calling the C library.
+ */
+static inline int floorToInt(float v) {
+    int i = static_cast<int>(v);
+    return i - (v < static_cast<float>(i) ? 1 : 0);
+}
+
+/**
+ * Bicubic interpolation of the cells [x1, x2) of an output line. This is used for uchar, uchar2,
+ * and uchar4 vectors.
+ *
+ * The cells are computed in blocks. Only the blocks that read past the left or right edge of
+ * the input need their input clamped, which is done by OneBiCubic(). The other blocks compute
+ * the same values without clamping.
+ *
+ * @param out Where to store the value of x1.
+ * @param yp0 The start of the first of the four input rows.
+ * @param scaleX The ratio of the input width to the output width.
+ * @param yf The vertical position of the line between the second and third input rows.
+ * @param width The number of cells of one input row.
+ */
+template <typename InputOutputType, typename ComputationType>
+static void resizeLine(InputOutputType* out, uint32_t x1, uint32_t x2, const InputOutputType* yp0,
+                       const InputOutputType* yp1, const InputOutputType* yp2,
+                       const InputOutputType* yp3, float scaleX, float yf, int width) {
+    constexpr uint32_t kBlockSize = 8;
+    // Blocks that read more input cells than this, when downscaling, are done by OneBiCubic().
+    constexpr int kMaxSpan = 2 * kBlockSize + 4;
+    while (x1 < x2) {
+        const uint32_t count = std::min(kBlockSize, x2 - x1);
+        int startx[kBlockSize];
+        float xf[kBlockSize];
+        for (uint32_t i = 0; i < count; i++) {
+            float f = (x1 + i + 0.5f) * scaleX - 0.5f;
+            startx[i] = floorToInt(f - 1);
+            xf[i] = f - static_cast<float>(floorToInt(f));
+        }
+
+        // startx grows with x, so checking the first and last cells is enough. Only a full
+        // block has a last cell.
+        const int first = startx[0];
+        int span = 0;
+        bool unclamped = false;
+        if (count == kBlockSize) {
+            span = startx[kBlockSize - 1] + 4 - first;
+            unclamped = first >= 0 && first + span <= width && span <= kMaxSpan;
+        }
+        if (unclamped) {
+            // Convert the input cells of the block once, rather than once per output cell.
+            ComputationType in[4][kMaxSpan];
+            const InputOutputType* rows[4] = {yp0, yp1, yp2, yp3};
+            for (int r = 0; r < 4; r++) {
+                for (int j = 0; j < span; j++) {
+                    in[r][j] = convert<ComputationType>(rows[r][first + j]);
+                }
+            }
+            for (uint32_t i = 0; i < kBlockSize; i++) {
+                const int j = startx[i] - first;
+                ComputationType p[4];
+                for (int r = 0; r < 4; r++) {
+                    p[r] = cubicInterpolate(in[r][j], in[r][j + 1], in[r][j + 2], in[r][j + 3],
+                                            xf[i]);
+                }
+                ComputationType v = cubicInterpolate(p[0], p[1], p[2], p[3], yf);
+                out[i] = convert<InputOutputType>(clamp(v + 0.5f, 0.f, 255.f));
+            }
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                float f = (x1 + i + 0.5f) * scaleX - 0.5f;
+                out[i] = OneBiCubic(yp0, yp1, yp2, yp3, f, yf, width);
+            }
+        }
+        out += count;
+        x1 += count;
+    }
+}
+
 extern "C" uint64_t rsdIntrinsicResize_oscctl_K(uint32_t xinc);
 
 extern "C" void rsdIntrinsicResizeB4_K(
@@ -405,17 +488,7 @@ void ResizeTask::kernelU4(uchar *outPtr, uint32_t xstart, uint32_t xend, uint32_
     }
 #endif
 
-    while(x1 < x2) {
-#if defined(ARCH_X86_HAVE_AVX2)
-        float xf = _mm_cvtss_f32(_mm_fmsub_ss(_mm_set1_ps(x1 + 0.5f) , _mm_set1_ps(scaleX) ,
-                                              _mm_set1_ps(0.5f)));
-#else
-        float xf = (x1 + 0.5f) * mScaleX - 0.5f;
-#endif
-        *out = OneBiCubic(yp0, yp1, yp2, yp3, xf, yf, srcWidth);
-        out++;
-        x1++;
-    }
+    resizeLine<uchar4, float4>(out, x1, x2, yp0, yp1, yp2, yp3, mScaleX, yf, srcWidth);
 }
 
 void ResizeTask::kernelU2(uchar* outPtr, uint32_t xstart, uint32_t xend, uint32_t currentY) {
@@ -476,18 +549,7 @@ void ResizeTask::kernelU2(uchar* outPtr, uint32_t xstart, uint32_t xend, uint32_
     }
 #endif
 
-    while(x1 < x2) {
-
-#if defined(ARCH_X86_HAVE_AVX2)
-        float xf = _mm_cvtss_f32(_mm_fmsub_ss(_mm_set1_ps(x1 + 0.5f) , _mm_set1_ps(scaleX) ,
-                                              _mm_set1_ps(0.5f)));
-#else
-        float xf = (x1 + 0.5f) * mScaleX - 0.5f;
-#endif
-        *out = OneBiCubic(yp0, yp1, yp2, yp3, xf, yf, srcWidth);
-        out++;
-        x1++;
-    }
+    resizeLine<uchar2, float2>(out, x1, x2, yp0, yp1, yp2, yp3, mScaleX, yf, srcWidth);
 }
 
 void ResizeTask::kernelU1(uchar* outPtr, uint32_t xstart, uint32_t xend, uint32_t currentY) {
@@ -559,19 +621,7 @@ void ResizeTask::kernelU1(uchar* outPtr, uint32_t xstart, uint32_t xend, uint32_
     }
 #endif
 
-    while(x1 < x2) {
-
-#if defined(ARCH_X86_HAVE_AVX2)
-        float xf = _mm_cvtss_f32(_mm_fmsub_ss(_mm_set1_ps(x1 + 0.5f) , _mm_set1_ps(scaleX) ,
-                                              _mm_set1_ps(0.5f)));
-#else
-        float xf = (x1 + 0.5f) * mScaleX - 0.5f;
-#endif
-
-        *out = OneBiCubic(yp0, yp1, yp2, yp3, xf, yf, srcWidth);
-        out++;
-        x1++;
-    }
+    resizeLine<uchar, float>(out, x1, x2, yp0, yp1, yp2, yp3, mScaleX, yf, srcWidth);
 }
 
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_SUPPORTS_FLOAT
@@ -746,22 +796,76 @@ void ResizeTask::preLaunch(uint32_t slot, const RsScriptCall *sc)
 }
 #endif  // ANDROID_RENDERSCRIPT_TOOLKIT_SUPPORTS_FLOAT
 
-void RenderScriptToolkit::resize(const uint8_t* input, uint8_t* output, size_t inputSizeX,
-                                 size_t inputSizeY, size_t vectorSize, size_t outputSizeX,
-                                 size_t outputSizeY, const Restriction* restriction) {
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+static bool validResizeArguments(size_t vectorSize, size_t outputSizeX, size_t outputSizeY,
+                                 const Restriction* restriction) {
     if (!validRestriction(LOG_TAG, outputSizeX, outputSizeY, restriction)) {
-        return;
+        return false;
     }
     if (vectorSize < 1 || vectorSize > 4) {
         ALOGE("The vectorSize should be between 1 and 4. %zu provided.", vectorSize);
-        return;
+        return false;
+    }
+    return true;
+}
+#endif
+
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::resize(const uint8_t* input, uint8_t* output,
+                                                            size_t inputSizeX, size_t inputSizeY,
+                                                            size_t vectorSize, size_t outputSizeX,
+                                                            size_t outputSizeY,
+                                                            const Restriction* restriction,
+                                                            const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validResizeArguments(vectorSize, outputSizeX, outputSizeY, restriction)) {
+        return TaskStatus::INVALID_ARGUMENTS;
     }
 #endif
 
     ResizeTask task((const uchar*)input, (uchar*)output, inputSizeX, inputSizeY, vectorSize,
                     outputSizeX, outputSizeY, restriction);
-    processor->doTask(&task);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::resizeBatch(const ResizeJob* jobs,
+                                                                 size_t numberOfJobs,
+                                                                 size_t vectorSize,
+                                                                 const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    for (size_t i = 0; i < numberOfJobs; i++) {
+        if (!validResizeArguments(vectorSize, jobs[i].outputSizeX, jobs[i].outputSizeY,
+                                  nullptr)) {
+            return TaskStatus::INVALID_ARGUMENTS;
+        }
+    }
+#endif
+
+    std::vector<std::unique_ptr<Task>> tasks;
+    tasks.reserve(numberOfJobs);
+    for (size_t i = 0; i < numberOfJobs; i++) {
+        const ResizeJob& job = jobs[i];
+        tasks.push_back(std::make_unique<ResizeTask>(job.in, job.out, job.inputSizeX,
+                                                     job.inputSizeY, vectorSize, job.outputSizeX,
+                                                     job.outputSizeY, nullptr));
+    }
+    return processor->doTasks(tasks, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::resizeAsync(
+        const uint8_t* input, uint8_t* output, size_t inputSizeX, size_t inputSizeY,
+        size_t vectorSize, size_t outputSizeX, size_t outputSizeY, const Restriction* restriction,
+        Callback callback, const TaskOptions* options) {
+#ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
+    if (!validResizeArguments(vectorSize, outputSizeX, outputSizeY, restriction)) {
+        return TaskHandle();
+    }
+#endif
+
+    return TaskHandle(processor->startTask(
+            std::make_unique<ResizeTask>((const uchar*)input, (uchar*)output, inputSizeX,
+                                         inputSizeY, vectorSize, outputSizeX, outputSizeY,
+                                         restriction),
+            std::move(callback), options));
 }
 
 }  // namespace renderscript
@@ -16,8 +16,16 @@
 
 #include "TaskProcessor.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
 
 #include "RenderScriptToolkit.h"
 #include "Utils.h"
@@ -26,67 +34,130 @@
 
 namespace renderscript {
 
-int Task::setTiling(unsigned int targetTileSizeInBytes) {
-    // Empirically, values smaller than 1000 are unlikely to give good performance.
-    targetTileSizeInBytes = std::max(1000u, targetTileSizeInBytes);
-    const size_t cellSizeInBytes =
-            mVectorSize;  // If we add float support, vectorSize * 4 for that.
-    const size_t targetCellsPerTile = targetTileSizeInBytes / cellSizeInBytes;
-    assert(targetCellsPerTile > 0);
+/**
+ * The range of durations we're hoping each tile will take. If the tiles are too short, we'll
+ * spend too much time in synchronization. If they're too long, some cores may be idle while others
+ * still have a lot of work to do. Between the two, we aim for kTilesPerThread tiles per thread.
+ */
+static constexpr double kMinTileNs = 4 * 1000;
+static constexpr double kMaxTileNs = 250 * 1000;
+static constexpr size_t kTilesPerThread = 8;
+
+/**
+ * The width in bytes above which a row is split into several tiles. The SIMD blur and convolve
+ * kernels stop short of the end of a tile and leave the last cells to the generic code, which
+ * rounds differently. So that the results don't depend on the timings or the tuning profile, the
+ * rows are split by this fixed rule only, the one RenderScript used.
+ */
+static constexpr size_t kMaxTileRowBytes = 16 * 1024;
+
+/**
+ * A rough conversion of Task::costPerCell() into nanoseconds, for when the tiles have not been
+ * measured. With it, a 16 KB tile of a simple op like lut takes kMinTileNs, which is the tile
+ * size RenderScript used.
+ */
+static constexpr double kEstimatedNsPerCostUnit = 0.25;
+
+/**
+ * The cost, see Task::getCost(), below which doTask() processes a task on the calling thread
+ * rather than sharing it with the pool. Waking up a pool thread and waiting for it to finish
+ * takes tens of microseconds, which is about the time needed for this much work.
+ */
+static constexpr size_t kInlineCostThreshold = 64 * 1024;
 
+/**
+ * Whether the thread is running the callback of an asynchronous task.
+ */
+static thread_local bool tRunningCallback = false;
+
+int Task::setTiling(unsigned int numberOfThreads, double nsPerCell, size_t cellsPerTile) {
     size_t cellsToProcessY;
     size_t cellsToProcessX;
-    if (mRestriction == nullptr) {
+    if (!mHasRestriction) {
         cellsToProcessX = mSizeX;
         cellsToProcessY = mSizeY;
     } else {
-        assert(mRestriction->endX > mRestriction->startX);
-        assert(mRestriction->endY > mRestriction->startY);
-        cellsToProcessX = mRestriction->endX - mRestriction->startX;
-        cellsToProcessY = mRestriction->endY - mRestriction->startY;
+        assert(mRestriction.endX > mRestriction.startX);
+        assert(mRestriction.endY > mRestriction.startY);
+        cellsToProcessX = mRestriction.endX - mRestriction.startX;
+        cellsToProcessY = mRestriction.endY - mRestriction.startY;
+    }
+
+    if (nsPerCell <= 0) {
+        nsPerCell = static_cast<double>(costPerCell()) * kEstimatedNsPerCostUnit;
+    }
+    const size_t minCellsPerTile = std::max<size_t>(1, kMinTileNs / nsPerCell);
+    const size_t maxCellsPerTile = std::max<size_t>(minCellsPerTile, kMaxTileNs / nsPerCell);
+    size_t targetCellsPerTile =
+            std::clamp(cellsToProcessX * cellsToProcessY / (numberOfThreads * kTilesPerThread),
+                       minCellsPerTile, maxCellsPerTile);
+    if (cellsPerTile > 0) {
+        // The size measured to be the fastest takes precedence over the estimates.
+        targetCellsPerTile = cellsPerTile;
     }
 
     // We want rows as large as possible, as the SIMD code we have is more efficient with
-    // large rows.
-    mTilesPerRow = divideRoundingUp(cellsToProcessX, targetCellsPerTile);
+    // large rows. Only the durations decide the height of the tiles, not where a row is split.
+    mTilesPerRow = divideRoundingUp(cellsToProcessX, kMaxTileRowBytes / mVectorSize);
     // Once we know the number of tiles per row, we divide that row evenly. We round up to make
     // sure all cells are included in the last tile of the row.
     mCellsPerTileX = divideRoundingUp(cellsToProcessX, mTilesPerRow);
 
-    // We do the same thing for the Y direction.
+    // We do the same thing for the Y direction, making the tiles as tall as the task prefers
+    // as long as each thread still gets several of them.
     size_t targetRowsPerTile = divideRoundingUp(targetCellsPerTile, mCellsPerTileX);
+    targetRowsPerTile = std::max(
+            targetRowsPerTile,
+            std::min(preferredMinTileRows(),
+                     std::max<size_t>(1, cellsToProcessY / (numberOfThreads * kTilesPerThread))));
     mTilesPerColumn = divideRoundingUp(cellsToProcessY, targetRowsPerTile);
     mCellsPerTileY = divideRoundingUp(cellsToProcessY, mTilesPerColumn);
 
     return mTilesPerRow * mTilesPerColumn;
 }
 
-void Task::processTile(unsigned int threadIndex, size_t tileIndex) {
+size_t Task::getNumberOfCells() const {
+    if (!mHasRestriction) {
+        return mSizeX * mSizeY;
+    }
+    return (mRestriction.endX - mRestriction.startX) * (mRestriction.endY - mRestriction.startY);
+}
+
+void Task::getTileBounds(size_t tileIndex, size_t* startX, size_t* startY, size_t* endX,
+                         size_t* endY) const {
     // Figure out the overall boundaries.
     size_t startWorkX;
     size_t startWorkY;
     size_t endWorkX;
     size_t endWorkY;
-    if (mRestriction == nullptr) {
+    if (!mHasRestriction) {
         startWorkX = 0;
         startWorkY = 0;
         endWorkX = mSizeX;
         endWorkY = mSizeY;
     } else {
-        startWorkX = mRestriction->startX;
-        startWorkY = mRestriction->startY;
-        endWorkX = mRestriction->endX;
-        endWorkY = mRestriction->endY;
+        startWorkX = mRestriction.startX;
+        startWorkY = mRestriction.startY;
+        endWorkX = mRestriction.endX;
+        endWorkY = mRestriction.endY;
     }
     // Figure out the rectangle for this tileIndex. All our tiles form a 2D grid. Identify
     // first the X, Y coordinate of our tile in that grid.
     size_t tileIndexY = tileIndex / mTilesPerRow;
     size_t tileIndexX = tileIndex % mTilesPerRow;
     // Calculate the starting and ending point of that tile.
-    size_t startCellX = startWorkX + tileIndexX * mCellsPerTileX;
-    size_t startCellY = startWorkY + tileIndexY * mCellsPerTileY;
-    size_t endCellX = std::min(startCellX + mCellsPerTileX, endWorkX);
-    size_t endCellY = std::min(startCellY + mCellsPerTileY, endWorkY);
+    *startX = startWorkX + tileIndexX * mCellsPerTileX;
+    *startY = startWorkY + tileIndexY * mCellsPerTileY;
+    *endX = std::min(*startX + mCellsPerTileX, endWorkX);
+    *endY = std::min(*startY + mCellsPerTileY, endWorkY);
+}
+
+void Task::processTile(unsigned int threadIndex, size_t tileIndex) {
+    size_t startCellX;
+    size_t startCellY;
+    size_t endCellX;
+    size_t endCellY;
+    getTileBounds(tileIndex, &startCellX, &startCellY, &endCellX, &endCellY);
 
     // Call the derived class to do the specific work.
     if (mPrefersDataAsOneRow && startCellX == 0 && endCellX == mSizeX) {
@@ -97,21 +168,36 @@ void Task::processTile(unsigned int threadIndex, size_t tileIndex) {
     }
 }
 
-TaskProcessor::TaskProcessor(unsigned int numThreads)
-    : mUsesSimd{cpuSupportsSimd()},
-      /* If the requested number of threads is 0, we'll decide based on the number of cores.
-       * Through empirical testing, we've found that using more than 6 threads does not help.
-       * There may be more optimal choices to make depending on the SoC but we'll stick to
-       * this simple heuristic for now.
+TaskProcessor::TaskProcessor(unsigned int numThreads, SimdTier simdTier)
+    : mKernels{kernelTableFor(selectSimdTier(simdTier))},
+      /* If the requested number of threads is 0, we'll decide based on the number of CPUs we
+       * may use, up to kDefaultMaxThreads.
        *
        * We'll re-use the thread that calls the processor doTask method, so we'll spawn one less
        * worker pool thread than the total number of threads.
        */
-      mNumberOfPoolThreads{numThreads ? numThreads - 1
-                                      : std::min(6u, std::thread::hardware_concurrency() - 1)} {
+      mNumberOfPoolThreads{
+              (numThreads ? numThreads
+                          : defaultNumberOfThreads(RenderScriptToolkit::kDefaultMaxThreads)) -
+              1},
+      mTracer(mNumberOfPoolThreads + 1),
+      mWorkerActivity(mNumberOfPoolThreads + 1),
+      mPoolThreadIds(mNumberOfPoolThreads, 0),
+      mNuma{readNumaTopology()},
+      mThreadCounters(mNumberOfPoolThreads + 1) {
+    if (sched_getaffinity(0, sizeof(mInheritedAffinity), &mInheritedAffinity) != 0) {
+        ALOGW("Can't get the affinity of the thread: %s", strerror(errno));
+        CPU_ZERO(&mInheritedAffinity);
+    }
+    mNodeHasThreads.resize(mNuma.numberOfNodes, false);
+    for (size_t cpu = 0; cpu < mNuma.nodeOfCpu.size() && cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &mInheritedAffinity)) {
+            mNodeHasThreads[mNuma.nodeOfCpu[cpu]] = true;
+        }
+    }
     for (size_t i = 0; i < mNumberOfPoolThreads; i++) {
         mPoolThreads.emplace_back(
-                std::bind(&TaskProcessor::processTilesOfWork, this, i + 1, false));
+                std::bind(&TaskProcessor::processTilesOfWork, this, i + 1));
     }
 }
 
@@ -119,6 +205,7 @@ TaskProcessor::~TaskProcessor() {
     {
         std::lock_guard<std::mutex> lock(mQueueMutex);
         mStopThreads = true;
+        mWorkGeneration++;
         mWorkAvailableOrStop.notify_all();
     }
 
@@ -127,93 +214,851 @@ TaskProcessor::~TaskProcessor() {
     }
 }
 
-void TaskProcessor::processTilesOfWork(int threadIndex, bool returnWhenNoWork) {
-    if (threadIndex != 0) {
-        // Set the name of the thread, except for thread 0, which is not part of the pool.
-        // PR_SET_NAME takes a maximum of 16 characters, including the terminating null.
-        char name[16]{"RenderScToolkit"};
-        prctl(PR_SET_NAME, name, 0, 0, 0);
-        // ALOGI("Starting thread%d", threadIndex);
+unsigned int TaskProcessor::defaultNumberOfThreads(unsigned int maxThreads) {
+    const unsigned int cpus = static_cast<unsigned int>(usableCpuCount());
+    return maxThreads == 0 ? cpus : std::min(cpus, maxThreads);
+}
+
+void TaskProcessor::beginCall() {
+    std::unique_lock<std::mutex> lock(mCallsMutex);
+    if (!tRunningCallback) {
+        mCallsChanged.wait(lock, [this]() /*REQUIRES(mCallsMutex)*/ { return !mResizing; });
+    }
+    mCallsInProgress++;
+}
+
+void TaskProcessor::endCall() {
+    std::lock_guard<std::mutex> lock(mCallsMutex);
+    mCallsInProgress--;
+    if (mCallsInProgress == 0 && mResizing) {
+        mCallsChanged.notify_all();
+    }
+}
+
+void TaskProcessor::setNumberOfThreads(unsigned int numberOfThreads) {
+    std::lock_guard<std::mutex> resizeGuard(mResizeMutex);
+    const unsigned int oldPoolThreads = mNumberOfPoolThreads;
+    const unsigned int newPoolThreads = numberOfThreads - 1;
+    if (newPoolThreads == oldPoolThreads) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mCallsMutex);
+        mResizing = true;
+        mCallsChanged.wait(lock, [this]() /*REQUIRES(mCallsMutex)*/ {
+            return mCallsInProgress == 0;
+        });
+    }
+    // No task is in progress, so the pool threads are all waiting for work and only touch their
+    // own entries of the per-thread data.
+    if (newPoolThreads < oldPoolThreads) {
+        {
+            std::lock_guard<std::mutex> lock(mQueueMutex);
+            mNumberOfPoolThreads = newPoolThreads;
+            mWorkGeneration++;
+            mWorkAvailableOrStop.notify_all();
+        }
+        // The threads removed may still be starting, so we can't hold mSettingsMutex here.
+        for (unsigned int i = newPoolThreads; i < oldPoolThreads; i++) {
+            mPoolThreads[i].join();
+        }
+        mPoolThreads.resize(newPoolThreads);
+    }
+
+    std::unique_lock<std::mutex> settingsLock(mSettingsMutex);
+    mTracer.setNumberOfThreads(numberOfThreads);
+    while (mWorkerActivity.size() > numberOfThreads) {
+        mWorkerActivity.pop_back();
+    }
+    while (mThreadCounters.size() > numberOfThreads) {
+        // We keep the counts of the threads removed in the totals.
+        const ThreadCounters& removed = mThreadCounters.back();
+        ThreadCounters& kept = mThreadCounters[0];
+        for (int i = 0; i < kNumberOfHardwareCounters; i++) {
+            kept.values[i] += removed.values[i].load(std::memory_order_relaxed);
+        }
+        kept.tiles += removed.tiles.load(std::memory_order_relaxed);
+        mThreadCounters.pop_back();
+    }
+    while (mWorkerActivity.size() < numberOfThreads) {
+        mWorkerActivity.emplace_back();
+    }
+    while (mThreadCounters.size() < numberOfThreads) {
+        mThreadCounters.emplace_back();
+    }
+    mPoolThreadIds.resize(newPoolThreads, 0);
+    mPinnedCpus.clear();
+    for (unsigned int i = 0; !mPinningOrder.empty() && i < newPoolThreads; i++) {
+        mPinnedCpus.push_back(mPinningOrder[i % mPinningOrder.size()]);
+    }
+    settingsLock.unlock();
+
+    if (newPoolThreads > oldPoolThreads) {
+        {
+            std::lock_guard<std::mutex> lock(mQueueMutex);
+            mNumberOfPoolThreads = newPoolThreads;
+        }
+        // The new threads pin themselves when they start.
+        for (unsigned int i = oldPoolThreads; i < newPoolThreads; i++) {
+            mPoolThreads.emplace_back(
+                    std::bind(&TaskProcessor::processTilesOfWork, this, i + 1));
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mCallsMutex);
+        mResizing = false;
+    }
+    mCallsChanged.notify_all();
+}
+
+void TaskProcessor::processTilesOfWork(int threadIndex) {
+    // Set the name of the thread. Thread 0, which is not part of the pool, doesn't come here.
+    // PR_SET_NAME takes a maximum of 16 characters, including the terminating null.
+    char name[16]{"RenderScToolkit"};
+    prctl(PR_SET_NAME, name, 0, 0, 0);
+    // ALOGI("Starting thread%d", threadIndex);
+    WorkerActivity* activity;
+    {
+        // The affinity may have been set before this thread had started.
+        std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+        mPoolThreadIds[threadIndex - 1] = static_cast<pid_t>(syscall(SYS_gettid));
+        if (!mPinnedCpus.empty()) {
+            applyAffinity(threadIndex);
+        }
+        // The entry doesn't move if threads are added, but the deque can't be read meanwhile.
+        activity = &mWorkerActivity[threadIndex];
     }
 
     std::unique_lock<std::mutex> lock(mQueueMutex);
+    // When we last woke up after waiting for work, or 0 if we've since accounted for it.
+    int64_t woken = 0;
     while (true) {
-        mWorkAvailableOrStop.wait(lock, [this, returnWhenNoWork]() /*REQUIRES(mQueueMutex)*/ {
-            return mStopThreads || (mTilesNotYetStarted > 0) ||
-                   (returnWhenNoWork && (mTilesNotYetStarted == 0));
-        });
-        // ALOGI("Woke thread%d", threadIndex);
-
-        // This ScopedLockAssertion is to help the compiler when it checks thread annotations
-        // to realize that we have the lock. It's however not completely true; we don't
-        // hold the lock while processing the tile.
-        // TODO Figure out how to fix that.
-        // android::base::ScopedLockAssertion lockAssert(mQueueMutex);
-        if (mStopThreads || (returnWhenNoWork && mTilesNotYetStarted == 0)) {
-            break;
+        ActiveTask* active = findTaskToHelpWith();
+        if (active == nullptr) {
+            // We keep going when asked to stop until the asynchronous tasks are done, as no
+            // client thread may be there to do them. We also stop when the pool shrinks below
+            // us, which only happens once all the tasks are done.
+            const bool removed = static_cast<unsigned int>(threadIndex) > mNumberOfPoolThreads;
+            if (mStopThreads || removed) {
+                break;
+            }
+            const int64_t waitStart = nowInNanoseconds();
+            const uint64_t generation = mWorkGeneration.load(std::memory_order_relaxed);
+            bool workPosted = false;
+            if (mWaitPolicy.load(std::memory_order_relaxed) != WaitPolicy::PARK) {
+                lock.unlock();
+                workPosted = spinForWork(generation);
+                lock.lock();
+            }
+            // If the work was posted or the stop requested after we stopped polling, we already
+            // missed the notification.
+            if (!workPosted && mWorkGeneration.load(std::memory_order_relaxed) == generation &&
+                !mStopThreads && static_cast<unsigned int>(threadIndex) <= mNumberOfPoolThreads) {
+                mWorkAvailableOrStop.wait(lock);
+            }
+            woken = nowInNanoseconds();
+            // ALOGI("Woke thread%d", threadIndex);
+            activity->addIdle(woken - waitStart);
+            continue;
+        }
+        if (woken != 0) {
+            activity->addWakeUp(woken - active->postedTime);
+            if (mTracer.isEnabled()) {
+                mTracer.addWake(threadIndex, active->postedTime, woken);
+            }
+            woken = 0;
         }
 
-        while (mTilesNotYetStarted > 0 && !mStopThreads) {
-            // This picks the tiles in decreasing order but that does not matter.
-            int myTile = --mTilesNotYetStarted;
-            mTilesInProcess++;
+        active->helpersWorking++;
+        updateNeedsHelp(active);
+        lock.unlock();
+        const TileRun run = claimAndRunTiles(threadIndex, active);
+        lock.lock();
+        active->helpersWorking--;
+        if (finishTiles(active, run)) {
             lock.unlock();
-            {
-                // We won't be executing this code unless the main thread is
-                // holding the mTaskMutex lock, which guards mCurrentTask.
-                // The compiler can't figure this out.
-                // android::base::ScopedLockAssertion lockAssert(mTaskMutex);
-                mCurrentTask->processTile(threadIndex, myTile);
-            }
+            completeAsyncTask(threadIndex, active);
             lock.lock();
-            mTilesInProcess--;
-            if (mTilesInProcess == 0 && mTilesNotYetStarted == 0) {
-                mWorkIsFinished.notify_one();
-            }
         }
     }
-    // if (threadIndex != 0) {
-    //     ALOGI("Ending thread%d", threadIndex);
-    // }
+    // ALOGI("Ending thread%d", threadIndex);
+}
+
+/**
+ * Tells the processor that we're busy waiting, e.g. so that it can let the other hardware thread
+ * of the core run.
+ */
+static inline void relaxCpu() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+bool TaskProcessor::spinForWork(uint64_t generation) {
+    const bool yield = mWaitPolicy.load(std::memory_order_relaxed) == WaitPolicy::YIELD;
+    const int64_t deadline = nowInNanoseconds() + mSpinBudgetNs.load(std::memory_order_relaxed);
+    mSpinningThreads.fetch_add(1, std::memory_order_relaxed);
+    bool found = false;
+    // Reading the clock costs more than polling, so we only do it every few polls.
+    for (int polls = 1;; polls++) {
+        if (mWorkGeneration.load(std::memory_order_relaxed) != generation) {
+            found = true;
+            break;
+        }
+        if (polls % 16 == 0 && nowInNanoseconds() >= deadline) {
+            break;
+        }
+        if (yield) {
+            std::this_thread::yield();
+        } else {
+            relaxCpu();
+        }
+    }
+    mSpinningThreads.fetch_sub(1, std::memory_order_relaxed);
+    return found;
+}
+
+ActiveTask* TaskProcessor::findTaskToHelpWith() {
+    ActiveTask* best = nullptr;
+    for (ActiveTask* active : mActiveTasks) {
+        if (!active->hasTilesLeft() || active->helpersWorking >= active->maxHelpers) {
+            continue;
+        }
+        if (best == nullptr || active->priority > best->priority ||
+            (active->priority == best->priority &&
+             active->helpersWorking < best->helpersWorking)) {
+            best = active;
+        }
+    }
+    return best;
+}
+
+bool TaskProcessor::hasMoreUrgentTask(Priority priority) {
+    bool mayHaveOne = false;
+    for (int p = static_cast<int>(priority) + 1; p < kNumberOfPriorities; p++) {
+        mayHaveOne = mayHaveOne || mTasksNeedingHelp[p].load(std::memory_order_relaxed) > 0;
+    }
+    if (!mayHaveOne) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mQueueMutex);
+    const ActiveTask* best = findTaskToHelpWith();
+    return best != nullptr && best->priority > priority;
+}
+
+void TaskProcessor::addActiveTask(ActiveTask* active) {
+    mActiveTasks.push_back(active);
+    updateNeedsHelp(active);
+}
+
+void TaskProcessor::removeActiveTask(ActiveTask* active) {
+    mActiveTasks.erase(std::find(mActiveTasks.begin(), mActiveTasks.end(), active));
+    stopCountingAsNeedingHelp(active);
 }
 
-void TaskProcessor::doTask(Task* task) {
-    std::lock_guard<std::mutex> lockGuard(mTaskMutex);
-    task->setUsesSimd(mUsesSimd);
-    mCurrentTask = task;
+void TaskProcessor::updateNeedsHelp(ActiveTask* active) {
+    if (!active->hasTilesLeft() || active->helpersWorking >= active->maxHelpers) {
+        stopCountingAsNeedingHelp(active);
+    } else if (!active->countedAsNeedingHelp.exchange(true, std::memory_order_relaxed)) {
+        mTasksNeedingHelp[static_cast<int>(active->priority)]++;
+    }
+}
+
+void TaskProcessor::stopCountingAsNeedingHelp(ActiveTask* active) {
+    // The exchange makes sure that only one thread decrements the count.
+    if (active->countedAsNeedingHelp.exchange(false, std::memory_order_relaxed)) {
+        mTasksNeedingHelp[static_cast<int>(active->priority)]--;
+    }
+}
+
+TaskProcessor::TileRun TaskProcessor::claimAndRunTiles(int threadIndex, ActiveTask* active) {
+    TileRun run;
+    // Only the NUMA_NODES scheduler needs to know where the thread runs.
+    const int node = active->nodeTiles != nullptr ? mNuma.nodeOfThisThread() : 0;
+    int myTile;
+    while (active->claim(threadIndex, node, &myTile)) {
+        // The tiles of a stopped task still have to be claimed, to account for them.
+        if (active->countedAsNeedingHelp.load(std::memory_order_relaxed) &&
+            !active->hasTilesLeft()) {
+            // We took the last tile, so the task no longer draws pool threads from less urgent
+            // ones.
+            stopCountingAsNeedingHelp(active);
+        }
+        if (active->shouldStop()) {
+            run.skipped++;
+            continue;
+        }
+        if (run.tiles == 0) {
+            run.start = nowInNanoseconds();
+        }
+        run.busyNs += runTile(threadIndex, active, myTile);
+        run.tiles++;
+        // The client threads stay with their own task. A pool thread leaves the tiles it would
+        // have claimed next to the other threads, and comes back for them later.
+        if (threadIndex != 0 && hasMoreUrgentTask(active->priority)) {
+            break;
+        }
+    }
+    mWorkerActivity[threadIndex].addTiles(run.tiles, run.busyNs);
+    return run;
+}
+
+bool TaskProcessor::finishTiles(ActiveTask* active, const TileRun& run) {
+    // The thread may have freed a helper slot. This also catches the last tile being claimed
+    // while updateNeedsHelp() was counting the task.
+    updateNeedsHelp(active);
+    active->tilesNotYetFinished -= run.tiles + run.skipped;
+    active->totalBusyNs += run.busyNs;
+    active->maxBusyNs = std::max(active->maxBusyNs, run.busyNs);
+    if (run.tiles > 0) {
+        active->firstTileTime = std::min(active->firstTileTime, run.start);
+        active->threadsWithTiles++;
+    }
+    if (!active->allTilesDone()) {
+        return false;
+    }
+    if (!active->isAsync()) {
+        // The client thread of doTask() takes it from here.
+        active->isFinished.notify_one();
+        return false;
+    }
+    removeActiveTask(active);
+    return true;
+}
+
+void TaskProcessor::completeTask(int threadIndex, ActiveTask* active) {
+    Task* task = active->task;
+    const bool stopped = active->isStopped();
+    size_t cells = 0;
+    size_t cost = 0;
+    for (size_t i = 0; i < active->numberOfTasks; i++) {
+        // The partial results of a stopped task are of no use.
+        if (!stopped) {
+            active->tasks[i]->finish();
+        }
+        cells += active->tasks[i]->getNumberOfCells();
+        cost += active->tasks[i]->getCost();
+    }
+    const int64_t end = nowInNanoseconds();
+    // The start is unknown if the task was stopped before its first tile.
+    const int64_t start = std::min(active->firstTileTime, end);
+    if (mTracer.isEnabled()) {
+        mTracer.addTask(threadIndex, task->name(), start, end, task->getSizeX(),
+                        task->getSizeY(), active->numberOfTiles);
+    }
+    if (stopped) {
+        // Its timings would skew the statistics and the autotuner.
+        return;
+    }
+    // How much longer the busiest thread worked than the average of those that processed tiles.
+    // The threads that didn't get to the task, e.g. because the call ran inline or its tuning
+    // limits its threads, don't count against it.
+    const double imbalance =
+            active->totalBusyNs == 0
+                    ? 1.0
+                    : static_cast<double>(active->maxBusyNs) *
+                              static_cast<double>(active->threadsWithTiles) /
+                              static_cast<double>(active->totalBusyNs);
+    mStats.record(task->name(), cells, start - active->submittedTime, end - start, imbalance);
+    if (mTileAutotuning.load(std::memory_order_relaxed)) {
+        // The tasks of a batch are tiled separately, so we record their average size.
+        mAutotuner.record(task->name(), cells / active->numberOfTasks, cost,
+                          active->totalBusyNs);
+    }
+}
+
+void TaskProcessor::completeAsyncTask(int threadIndex, ActiveTask* active) {
+    // Once done is set, the TaskHandles may go away, so we hold on to the task until we're
+    // done with it.
+    std::shared_ptr<ActiveTask> keepAlive = std::move(active->self);
+    completeTask(threadIndex, active);
+    if (active->callback) {
+        // The callback may call the Toolkit, which must not wait for a resize that's waiting
+        // for this call.
+        tRunningCallback = true;
+        active->callback();
+        tRunningCallback = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        active->done = true;
+    }
+    active->isFinished.notify_all();
+    endCall();
+}
+
+int TaskProcessor::prepareTask(Task* task, unsigned int* numberOfThreads) {
+    task->setKernels(mKernels);
+    task->allocateThreadStorage(getNumberOfThreads());
+    const TuningProfile::Setting tuning = mTuning.find(task->name(), task->getNumberOfCells());
+    *numberOfThreads = tuning.numberOfThreads == 0
+                               ? getNumberOfThreads()
+                               : std::min(tuning.numberOfThreads, getNumberOfThreads());
+    double nsPerCell = 0;
+    if (mTileAutotuning.load(std::memory_order_relaxed)) {
+        nsPerCell = mAutotuner.nsPerCostUnit(task->name(), task->getNumberOfCells()) *
+                    static_cast<double>(task->costPerCell());
+    }
+    return task->setTiling(*numberOfThreads, nsPerCell, tuning.cellsPerTile);
+}
+
+/**
+ * Returns the priority of a call made with these options.
+ */
+static Priority priorityOf(const TaskOptions* options) {
+    return options != nullptr ? options->priority : Priority::NORMAL;
+}
+
+/**
+ * Sets the priority, the cancellation token, and the deadline of the task from the options of
+ * the call, which may be null.
+ */
+static void applyOptions(const TaskOptions* options, ActiveTask* active) {
+    active->priority = priorityOf(options);
+    if (options == nullptr) {
+        return;
+    }
+    active->cancellationToken = options->cancellationToken;
+    // Both nowInNanoseconds() and the deadline are based on std::chrono::steady_clock.
+    // time_point::max() becomes INT64_MAX, i.e. no deadline.
+    const auto sinceEpoch = options->deadline.time_since_epoch();
+    active->deadline = std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count();
+}
+
+bool ActiveTask::shouldStop() {
+    if (isStopped()) {
+        return true;
+    }
+    TaskStatus reason;
+    if (cancellationToken != nullptr && cancellationToken->isCancelled()) {
+        reason = TaskStatus::CANCELLED;
+    } else if (deadline != INT64_MAX && nowInNanoseconds() >= deadline) {
+        reason = TaskStatus::DEADLINE_EXCEEDED;
+    } else {
+        return false;
+    }
+    // If several threads see it at once, the first one to get here picks the reason.
+    TaskStatus expected = TaskStatus::COMPLETE;
+    status.compare_exchange_strong(expected, reason, std::memory_order_relaxed);
+    return true;
+}
+
+TaskStatus TaskProcessor::doTask(Task* task, const TaskOptions* options) {
+    const int64_t submitted = nowInNanoseconds();
+    beginCall();
+    unsigned int numberOfThreads;
+    const int numberOfTiles = prepareTask(task, &numberOfThreads);
+    TaskStatus status;
+    if (shouldRunInline(numberOfTiles, task->getCost(), numberOfThreads)) {
+        // No need to distribute the tiles between threads.
+        ActiveTask active(this, task, numberOfTiles, submitted, Scheduler::SHARED_COUNTER, 1);
+        applyOptions(options, &active);
+        runInline(&active);
+        status = active.status;
+    } else {
+        ActiveTask active(this, task, numberOfTiles, submitted, mScheduler, getNumberOfThreads());
+        active.maxHelpers = static_cast<int>(numberOfThreads) - 1;
+        applyOptions(options, &active);
+        runClientTask(&active);
+        status = active.status;
+    }
+    endCall();
+    return status;
+}
+
+TaskStatus TaskProcessor::doTasks(const std::vector<std::unique_ptr<Task>>& tasks,
+                                  const TaskOptions* options) {
+    if (tasks.empty()) {
+        return TaskStatus::COMPLETE;
+    }
+    const int64_t submitted = nowInNanoseconds();
+    beginCall();
+    std::vector<Task*> batch;
+    std::vector<int> firstTileOfTask;
+    batch.reserve(tasks.size());
+    firstTileOfTask.reserve(tasks.size());
+    int numberOfTiles = 0;
+    size_t cost = 0;
+    // The batch gets as many threads as the task that may use the most.
+    unsigned int numberOfThreads = 1;
+    for (const std::unique_ptr<Task>& task : tasks) {
+        // Each task is tiled as if it was done on its own.
+        batch.push_back(task.get());
+        firstTileOfTask.push_back(numberOfTiles);
+        unsigned int threadsOfTask;
+        numberOfTiles += prepareTask(task.get(), &threadsOfTask);
+        numberOfThreads = std::max(numberOfThreads, threadsOfTask);
+        cost += task->getCost();
+    }
+    const bool runsInline = shouldRunInline(numberOfTiles, cost, numberOfThreads);
+    ActiveTask active(this, batch[0], numberOfTiles, submitted,
+                      runsInline ? Scheduler::SHARED_COUNTER : mScheduler.load(),
+                      runsInline ? 1 : getNumberOfThreads());
+    active.maxHelpers = static_cast<int>(numberOfThreads) - 1;
+    applyOptions(options, &active);
+    active.tasks = batch.data();
+    active.numberOfTasks = batch.size();
+    active.firstTileOfTask = std::move(firstTileOfTask);
+    if (runsInline) {
+        runInline(&active);
+    } else {
+        runClientTask(&active);
+    }
+    endCall();
+    return active.status;
+}
+
+bool TaskProcessor::shouldRunInline(int numberOfTiles, size_t cost,
+                                    unsigned int numberOfThreads) const {
+    // With a single tile, the pool threads would have nothing to do.
+    return mNumberOfPoolThreads == 0 || numberOfThreads <= 1 || numberOfTiles <= 1 ||
+           cost < kInlineCostThreshold;
+}
+
+void TaskProcessor::runInline(ActiveTask* active) {
+    // No other thread knows of the task, so we don't need mQueueMutex to update it.
+    active->clientIsWorking = true;
+    const TileRun run = claimAndRunTiles(0, active);
+    active->tilesNotYetFinished -= run.tiles + run.skipped;
+    active->totalBusyNs = run.busyNs;
+    active->maxBusyNs = run.busyNs;
+    active->firstTileTime = run.start;
+    active->threadsWithTiles = 1;
+    completeTask(0, active);
+}
+
+void TaskProcessor::runClientTask(ActiveTask* active) {
+    active->clientIsWorking = true;
     // Notify the thread pool of available work.
-    startWork(task);
-    // Start processing some of the tiles on the calling thread.
-    processTilesOfWork(0, true);
+    startWork(active);
+    // Process as many tiles as we can on the calling thread.
+    const TileRun run = claimAndRunTiles(0, active);
     // Wait for all the pool workers to complete.
-    waitForPoolWorkersToComplete();
-    mCurrentTask = nullptr;
+    waitForPoolWorkersToComplete(active, run);
+    completeTask(0, active);
 }
 
-void TaskProcessor::startWork(Task* task) {
-    /**
-     * The size in bytes that we're hoping each tile will be. If this value is too small,
-     * we'll spend too much time in synchronization. If it's too large, some cores may be
-     * idle while others still have a lot of work to do. Ideally, it would depend on the
-     * device we're running. 16k is the same value used by RenderScript and seems reasonable
-     * from ad-hoc tests.
-     */
-    const size_t targetTileSize = 16 * 1024;
+std::shared_ptr<ActiveTask> TaskProcessor::startTask(std::unique_ptr<Task> task,
+                                                     std::function<void()> callback,
+                                                     const TaskOptions* options) {
+    const int64_t submitted = nowInNanoseconds();
+    // Ended by completeAsyncTask().
+    beginCall();
+    unsigned int numberOfThreads;
+    const int numberOfTiles = prepareTask(task.get(), &numberOfThreads);
+    auto active = std::make_shared<ActiveTask>(this, task.get(), numberOfTiles, submitted,
+                                               mScheduler, getNumberOfThreads());
+    // No client thread works on the task unless one waits for it.
+    active->maxHelpers = static_cast<int>(numberOfThreads);
+    applyOptions(options, active.get());
+    active->ownedTask = std::move(task);
+    active->callback = std::move(callback);
+    active->self = active;
+    startWork(active.get());
+    if (mNumberOfPoolThreads == 0) {
+        // Nobody else would do the work.
+        waitFor(active.get());
+    }
+    return active;
+}
 
+void TaskProcessor::waitFor(ActiveTask* active) {
+    std::unique_lock<std::mutex> lock(mQueueMutex);
+    if (!active->done && !active->clientIsWorking && active->hasTilesLeft()) {
+        active->clientIsWorking = true;
+        active->helpersWorking++;
+        updateNeedsHelp(active);
+        lock.unlock();
+        const TileRun run = claimAndRunTiles(0, active);
+        lock.lock();
+        active->helpersWorking--;
+        if (finishTiles(active, run)) {
+            lock.unlock();
+            completeAsyncTask(0, active);
+            return;
+        }
+    }
+    active->isFinished.wait(lock, [active]() /*REQUIRES(mQueueMutex)*/ {
+        return active->done.load();
+    });
+}
+
+std::unique_ptr<NodeTiles> TaskProcessor::assignTilesToNodes(ActiveTask* active) const {
+    const int numberOfNodes = mNuma.numberOfNodes;
+    const int numberOfTiles = active->numberOfTiles;
+    if (numberOfNodes < 2) {
+        return nullptr;
+    }
+    // Where the first row of each tile is. The other rows of the tile are most likely on the
+    // same node, as the memory of a buffer is usually placed in large chunks.
+    std::vector<const void*> addresses;
+    addresses.reserve(numberOfTiles);
+    for (int i = 0; i < numberOfTiles; i++) {
+        int tileIndex = i;
+        const Task* task = active->taskOfTile(&tileIndex);
+        size_t startX, startY, endX, endY;
+        task->getTileBounds(tileIndex, &startX, &startY, &endX, &endY);
+        const void* row = task->dataOfRow(startY);
+        if (row == nullptr) {
+            break;
+        }
+        addresses.push_back(row);
+    }
+    std::vector<int> nodeOfTile;
+    if (addresses.size() != static_cast<size_t>(numberOfTiles) ||
+        !findNodesOfPages(addresses, &nodeOfTile)) {
+        nodeOfTile.assign(numberOfTiles, -1);
+    }
+    // The tiles on nodes without threads are handled like those not placed yet.
+    for (int& node : nodeOfTile) {
+        if (node >= numberOfNodes || (node >= 0 && !mNodeHasThreads[node])) {
+            node = -1;
+        }
+    }
+    auto known = std::find_if(nodeOfTile.begin(), nodeOfTile.end(),
+                              [](int node) { return node >= 0; });
+    if (known == nodeOfTile.end()) {
+        // Nothing is known, so we give one contiguous band of rows to each node with threads.
+        std::vector<int> nodes;
+        for (int node = 0; node < numberOfNodes; node++) {
+            if (mNodeHasThreads[node]) {
+                nodes.push_back(node);
+            }
+        }
+        if (nodes.empty()) {
+            nodes.push_back(0);
+        }
+        for (int i = 0; i < numberOfTiles; i++) {
+            nodeOfTile[i] = nodes[static_cast<size_t>(i) * nodes.size() / numberOfTiles];
+        }
+    } else {
+        // The tiles not placed yet go with the tiles before them, or after them for the first.
+        int previous = *known;
+        for (int& node : nodeOfTile) {
+            if (node < 0) {
+                node = previous;
+            }
+            previous = node;
+        }
+    }
+    return std::make_unique<NodeTiles>(nodeOfTile, numberOfNodes);
+}
+
+void TaskProcessor::startWork(ActiveTask* active) {
+    if (active->scheduler == Scheduler::NUMA_NODES) {
+        // No other thread knows of the task yet.
+        active->nodeTiles = assignTilesToNodes(active);
+    }
     std::lock_guard<std::mutex> lock(mQueueMutex);
-    assert(mTilesInProcess == 0);
-    mTilesNotYetStarted = task->setTiling(targetTileSize);
-    mWorkAvailableOrStop.notify_all();
+    addActiveTask(active);
+    active->postedTime = nowInNanoseconds();
+    mWorkGeneration++;
+    // The client thread of doTask() processes tiles too, and the pool threads polling for work
+    // will see it without being notified.
+    const int pool = static_cast<int>(mNumberOfPoolThreads);
+    const int toWake = std::min({active->numberOfTiles - (active->clientIsWorking ? 1 : 0), pool,
+                                 active->maxHelpers}) -
+                       mSpinningThreads.load(std::memory_order_relaxed);
+    if (toWake >= pool) {
+        mWorkAvailableOrStop.notify_all();
+    } else {
+        for (int i = 0; i < toWake; i++) {
+            mWorkAvailableOrStop.notify_one();
+        }
+    }
 }
 
-void TaskProcessor::waitForPoolWorkersToComplete() {
+void TaskProcessor::waitForPoolWorkersToComplete(ActiveTask* active, const TileRun& run) {
     std::unique_lock<std::mutex> lock(mQueueMutex);
+    finishTiles(active, run);
     // The predicate, i.e. the lambda, will make sure that
     // we terminate even if the main thread calls this after
-    // mWorkIsFinished is signaled.
-    mWorkIsFinished.wait(lock, [this]() /*REQUIRES(mQueueMutex)*/ {
-        return mTilesNotYetStarted == 0 && mTilesInProcess == 0;
+    // isFinished is signaled.
+    active->isFinished.wait(lock, [active]() /*REQUIRES(mQueueMutex)*/ {
+        return active->allTilesDone();
     });
+    removeActiveTask(active);
+}
+
+int64_t TaskProcessor::runTile(int threadIndex, ActiveTask* active, int tileIndex) {
+    Task* task = active->taskOfTile(&tileIndex);
+    const int64_t start = nowInNanoseconds();
+    if (mCountHardwareEvents.load(std::memory_order_relaxed)) {
+        processTileWithCounters(threadIndex, task, tileIndex);
+    } else {
+        task->processTile(threadIndex, tileIndex);
+    }
+    const int64_t end = nowInNanoseconds();
+    if (mTracer.isEnabled()) {
+        size_t startX, startY, endX, endY;
+        task->getTileBounds(tileIndex, &startX, &startY, &endX, &endY);
+        mTracer.addTile(threadIndex, task->name(), tileIndex, startX, startY, endX, endY, start,
+                        end);
+    }
+    return end - start;
+}
+
+void TaskProcessor::processTileWithCounters(int threadIndex, Task* task, int tileIndex) {
+    const PerfCounterGroup* group = perfCounterGroupOfThisThread();
+    uint64_t before[kNumberOfHardwareCounters];
+    uint64_t after[kNumberOfHardwareCounters];
+    const bool counting = group != nullptr && group->read(before);
+    task->processTile(threadIndex, tileIndex);
+    if (!counting || !group->read(after)) {
+        return;
+    }
+    ThreadCounters& counters = mThreadCounters[threadIndex];
+    for (int i = 0; i < kNumberOfHardwareCounters; i++) {
+        // The scaling of multiplexed counts can make them go slightly backward.
+        counters.values[i].fetch_add(after[i] > before[i] ? after[i] - before[i] : 0,
+                                     std::memory_order_relaxed);
+    }
+    counters.tiles.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool TaskProcessor::enableHardwareCounters(bool enable) {
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    if (enable) {
+        // The pool threads open their own counters when they process their first tile. We
+        // assume they can open the same ones as this thread.
+        const PerfCounterGroup* group = perfCounterGroupOfThisThread();
+        if (group == nullptr) {
+            mCountHardwareEvents = false;
+            return false;
+        }
+        for (int i = 0; i < kNumberOfHardwareCounters; i++) {
+            mAvailableHardwareCounters[i] = group->isAvailable(static_cast<HardwareCounter>(i));
+        }
+    }
+    mCountHardwareEvents = enable;
+    return true;
+}
+
+HardwareCounters TaskProcessor::getHardwareCounters() {
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    HardwareCounters total;
+    for (int i = 0; i < kNumberOfHardwareCounters; i++) {
+        total.available[i] = mAvailableHardwareCounters[i];
+    }
+    for (const ThreadCounters& counters : mThreadCounters) {
+        for (int i = 0; i < kNumberOfHardwareCounters; i++) {
+            total.values[i] += counters.values[i].load(std::memory_order_relaxed);
+        }
+        total.tiles += counters.tiles.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void TaskProcessor::resetHardwareCounters() {
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    for (ThreadCounters& counters : mThreadCounters) {
+        for (std::atomic<uint64_t>& value : counters.values) {
+            value.store(0, std::memory_order_relaxed);
+        }
+        counters.tiles.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::vector<WorkerStats> TaskProcessor::getWorkerStats() {
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    std::vector<WorkerStats> stats;
+    for (size_t i = 0; i < mWorkerActivity.size(); i++) {
+        stats.push_back(mWorkerActivity[i].get(i));
+    }
+    for (size_t i = 0; i < mPinnedCpus.size(); i++) {
+        stats[i + 1].cpu = mPinnedCpus[i];
+    }
+    return stats;
+}
+
+bool TaskProcessor::applyAffinity(unsigned int threadIndex) {
+    const pid_t tid = mPoolThreadIds[threadIndex - 1];
+    if (tid == 0) {
+        // The thread will do it when it starts.
+        return true;
+    }
+    cpu_set_t cpus = mInheritedAffinity;
+    if (!mPinnedCpus.empty()) {
+        CPU_ZERO(&cpus);
+        CPU_SET(mPinnedCpus[threadIndex - 1], &cpus);
+    }
+    if (sched_setaffinity(tid, sizeof(cpus), &cpus) != 0) {
+        ALOGE("Can't set the affinity of pool thread %u: %s", threadIndex, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool TaskProcessor::setCpuAffinity(const std::vector<int>& cpus, ThreadPlacement placement) {
+    if (cpus.empty()) {
+        ALOGE("No CPU to pin the pool threads to.");
+        return false;
+    }
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &mInheritedAffinity)) {
+            ALOGE("The pool threads can't run on CPU %d.", cpu);
+            return false;
+        }
+    }
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    mPinningOrder = orderCpusForPlacement(cpus, placement);
+    mPinnedCpus.clear();
+    for (unsigned int i = 0; i < mNumberOfPoolThreads; i++) {
+        mPinnedCpus.push_back(mPinningOrder[i % mPinningOrder.size()]);
+    }
+    bool pinned = true;
+    for (unsigned int t = 1; t <= mNumberOfPoolThreads; t++) {
+        pinned = applyAffinity(t) && pinned;
+    }
+    if (!pinned) {
+        mPinningOrder.clear();
+        mPinnedCpus.clear();
+        for (unsigned int t = 1; t <= mNumberOfPoolThreads; t++) {
+            applyAffinity(t);
+        }
+    }
+    return pinned;
+}
+
+void TaskProcessor::clearCpuAffinity() {
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    mPinningOrder.clear();
+    mPinnedCpus.clear();
+    for (unsigned int t = 1; t <= mNumberOfPoolThreads; t++) {
+        applyAffinity(t);
+    }
+}
+
+void TaskProcessor::resetStats() {
+    mStats.reset();
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    for (WorkerActivity& activity : mWorkerActivity) {
+        activity.reset();
+    }
+}
+
+void TaskProcessor::startTracing() {
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    mTracer.start();
+}
+
+void TaskProcessor::stopTracing() {
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    mTracer.stop();
+}
+
+bool TaskProcessor::writeTrace(const char* path) {
+    std::lock_guard<std::mutex> lockGuard(mSettingsMutex);
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        ALOGE("Can't open %s to write the trace.", path);
+        return false;
+    }
+    const bool written = mTracer.write(file);
+    return fclose(file) == 0 && written;
 }
 
 }  // namespace renderscript
@@ -19,16 +19,46 @@
 
 // #include <android-base/thread_annotations.h>
 
+#include <sched.h>
+
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
 #include "ColorUtil.h"
+#include "CpuTopology.h"
+#include "KernelTable.h"
+#include "NodeTiles.h"
+#include "PerfCounters.h"
+#include "TaskStats.h"
+#include "TaskTracer.h"
+#include "TileAutotuner.h"
+#include "TileRanges.h"
+#include "TuningProfile.h"
 
 namespace renderscript {
 
+using CancellationToken = RenderScriptToolkit::CancellationToken;
+using Priority = RenderScriptToolkit::Priority;
+using Scheduler = RenderScriptToolkit::Scheduler;
+using TaskOptions = RenderScriptToolkit::TaskOptions;
+using TaskStatus = RenderScriptToolkit::TaskStatus;
+using WaitPolicy = RenderScriptToolkit::WaitPolicy;
+
+/**
+ * The number of values of Priority.
+ */
+constexpr int kNumberOfPriorities = 3;
+
+class TaskProcessor;
+
 /**
  * Description of the data to be processed for one Toolkit method call, e.g. one blur or one
  * blend operation.
@@ -42,8 +72,8 @@ namespace renderscript {
  *    BlurTask task(in, out, sizeX, sizeY, vectorSize, etc);
  *    processor->doTask(&task);
  *
- * The TaskProcessor should call setTiling() and setUsesSimd() once, before calling processTile().
- * Other classes should not call setTiling(), setUsesSimd(), and processTile().
+ * The TaskProcessor should call setKernels(), allocateThreadStorage(), and setTiling() once, before
+ * calling processTile(). Other classes should not call them.
  */
 class Task {
    protected:
@@ -70,15 +100,21 @@ class Task {
      */
     const bool mPrefersDataAsOneRow;
     /**
-     * Whether the processor we're working on supports SIMD operations.
+     * Whether we're using SIMD operations, i.e. whether the SIMD tier is not SCALAR.
      */
     bool mUsesSimd = false;
+    /**
+     * The SIMD kernels of the selected tier. See KernelTable.
+     */
+    const KernelTable* mKernels = nullptr;
 
    private:
     /**
-     * If not null, we'll process a subset of the whole 2D array. This specifies the restriction.
+     * If set, we'll process a subset of the whole 2D array. mRestriction specifies it. It's a
+     * copy, so that the caller's restriction doesn't need to outlive an asynchronous call.
      */
-    const struct Restriction* mRestriction;
+    bool mHasRestriction;
+    Restriction mRestriction;
 
     /**
      * We'll divide the work into rectangular tiles. See setTiling().
@@ -106,8 +142,8 @@ class Task {
      * Construct a task.
      *
      * sizeX and sizeY should be greater than 0. vectorSize should be between 1 and 4.
-     * The restriction should outlive this instance. The Toolkit validates the
-     * arguments so we won't do that again here.
+     * The restriction, if any, is copied. The Toolkit validates the arguments so we won't do
+     * that again here.
      */
     Task(size_t sizeX, size_t sizeY, size_t vectorSize, bool prefersDataAsOneRow,
          const Restriction* restriction)
@@ -115,25 +151,41 @@ class Task {
           mSizeY{sizeY},
           mVectorSize{vectorSize},
           mPrefersDataAsOneRow{prefersDataAsOneRow},
-          mRestriction{restriction} {}
+          mHasRestriction{restriction != nullptr},
+          mRestriction{restriction != nullptr ? *restriction : Restriction{}} {}
     virtual ~Task() {}
 
-    void setUsesSimd(bool uses) { mUsesSimd = uses; }
+    void setKernels(const KernelTable* kernels) {
+        mKernels = kernels;
+        mUsesSimd = kernels->tier != SimdTier::SCALAR;
+    }
+
+    /**
+     * Called by the TaskProcessor before the tiles are processed, with the number of threads
+     * of the pool, the client thread included, i.e. one more than the highest threadIndex that
+     * processTile() will get. Tasks that need temporary storage for each thread allocate it here.
+     */
+    virtual void allocateThreadStorage(unsigned int /*numberOfThreads*/) {}
 
     /**
      * Divide the work into a number of tiles that can be distributed to the various threads.
      * A tile will be a rectangular region. To be robust, we'll want to handle regular cases
      * like 400x300 but also unusual ones like 1x120000, 120000x1, 1x1.
      *
-     * We have a target size for the tiles, which corresponds roughly to how much data a thread
-     * will want to process before checking for more work. If the target is set too low, we'll spend
-     * more time in synchronization. If it's too large, some cores may not be used as efficiently.
+     * The tiles are sized by their expected duration, so that each thread gets several tiles to
+     * balance the load with, while each tile is long enough for the time spent claiming it to
+     * be negligible. The duration is estimated from costPerCell(), unless nsPerCell is given.
+     * The rows are split by their width in bytes only, so that the results don't depend on the
+     * measurements.
      *
      * This method returns the number of tiles.
      *
-     * @param targetTileSizeInBytes Target size. Values less than 1000 will be treated as 1000.
+     * @param numberOfThreads The number of threads that may process the tiles.
+     * @param nsPerCell The measured time to process a cell, or 0 if not known.
+     * @param cellsPerTile The tile size chosen by the TuningProfile, or 0 to size the tiles
+     * from their duration.
      */
-    int setTiling(unsigned int targetTileSizeInBytes);
+    int setTiling(unsigned int numberOfThreads, double nsPerCell, size_t cellsPerTile);
 
     /**
      * This is called by the TaskProcessor to instruct the task to process a tile.
@@ -143,6 +195,60 @@ class Task {
      */
     void processTile(unsigned int threadIndex, size_t tileIndex);
 
+    /**
+     * Returns the number of cells to process, i.e. the area of the restriction if any.
+     */
+    size_t getNumberOfCells() const;
+
+    /**
+     * Returns the rectangle of cells covered by a tile. The end values are EXCLUDED.
+     */
+    void getTileBounds(size_t tileIndex, size_t* startX, size_t* startY, size_t* endX,
+                       size_t* endY) const;
+
+    /**
+     * A rough estimate of the work needed to process one cell, as a number of simple arithmetic
+     * operations. By default, one per byte of the cell. Tasks that do more, e.g. a blur that
+     * reads the cells within its radius, override this.
+     */
+    virtual size_t costPerCell() const { return mVectorSize; }
+
+    /**
+     * The address of row y of the memory the task reads, e.g. of its input image, so that the
+     * TaskProcessor can find out which NUMA node holds it. Null for the tasks that don't read
+     * rows that match the rows they process.
+     */
+    virtual const void* dataOfRow(size_t /*y*/) const { return nullptr; }
+
+    /**
+     * The fewest rows the task would like its tiles to have. Tiles are made of whole rows when
+     * they can, as the SIMD kernels are more efficient with long rows. Tasks that read many rows
+     * around each cell, like blur, prefer taller tiles, as most of the rows read for one row of
+     * the tile are read again for the next ones and are then still in the cache of the core.
+     */
+    virtual size_t preferredMinTileRows() const { return 1; }
+
+    /**
+     * A rough estimate of the work of the whole task, in the units of costPerCell(). It's
+     * cheap to compute, so that the TaskProcessor can decide whether the task is worth
+     * distributing to the pool threads.
+     */
+    size_t getCost() const { return getNumberOfCells() * costPerCell(); }
+
+    /**
+     * Called once all the tiles have been processed, by the thread that completes the task.
+     * Tasks that combine the results of the threads, like the histograms, do it here.
+     */
+    virtual void finish() {}
+
+    /**
+     * The name of the Toolkit method this task does, e.g. "blur". Used when reporting.
+     */
+    virtual const char* name() const = 0;
+
+    size_t getSizeX() const { return mSizeX; }
+    size_t getSizeY() const { return mSizeY; }
+
    private:
     /**
      * Call to the derived class to process the data bounded by the rectangle specified
@@ -153,37 +259,284 @@ class Task {
                              size_t endY) = 0;
 };
 
+/**
+ * A task being processed, with the state used by the TaskProcessor to distribute its tiles. The
+ * fields marked as guarded are guarded by the TaskProcessor's mQueueMutex.
+ *
+ * For doTask(), it lives on the stack of the client thread. For startTask(), it's shared with the
+ * TaskHandles and keeps itself alive until the task is done.
+ */
+struct ActiveTask {
+    TaskProcessor* processor;
+    /**
+     * The task, or the first task of a batch.
+     */
+    Task* task;
+    /**
+     * The tasks to do, numberOfTasks of them: either just task, or the tasks of a batch started
+     * by doTasks(). The tiles of a batch are numbered consecutively across its tasks, and
+     * firstTileOfTask holds the index of the first tile of each. It's empty for a single task.
+     */
+    Task* const* tasks;
+    size_t numberOfTasks = 1;
+    std::vector<int> firstTileOfTask;
+    /**
+     * The number of tiles of all the tasks.
+     */
+    int numberOfTiles;
+    /**
+     * The most pool threads that may work on the task at the same time. Fewer than the pool when
+     * the TuningProfile limits the number of threads of the op.
+     */
+    int maxHelpers = INT32_MAX;
+    /**
+     * How urgent the task is. The pool threads help with the most urgent tasks first.
+     */
+    Priority priority = Priority::NORMAL;
+    /**
+     * When not null, the task stops once the token is cancelled.
+     */
+    const CancellationToken* cancellationToken = nullptr;
+    /**
+     * The task stops if it's not done by then, in the time base of nowInNanoseconds().
+     */
+    int64_t deadline = INT64_MAX;
+    /**
+     * COMPLETE until the task is stopped, then why it was. See shouldStop().
+     */
+    std::atomic<TaskStatus> status{TaskStatus::COMPLETE};
+    /**
+     * When the Toolkit method was called.
+     */
+    int64_t submittedTime;
+    /**
+     * The time at which the task was made available to the pool threads. Used to measure
+     * how long they take to wake up.
+     */
+    int64_t postedTime = 0;
+    /**
+     * When the first tile of the task started.
+     */
+    int64_t firstTileTime /*GUARDED_BY(mQueueMutex)*/ = INT64_MAX;
+    /**
+     * With the SHARED_COUNTER scheduler, when a thread starts working on a new tile, it
+     * decrements this count to identify which tile to work on. The tile number is sufficient
+     * to determine the boundaries of the data to process. It goes negative when threads try
+     * to claim a tile after all of them have been started.
+     *
+     * It's on its own cache line, as all the threads working on the task hammer it.
+     */
+    alignas(64) std::atomic<int> tilesNotYetStarted;
+    /**
+     * The scheduler that distributes the tiles.
+     */
+    Scheduler scheduler;
+    /**
+     * With the WORK_STEALING scheduler, the ranges of tiles of each thread. Null otherwise.
+     */
+    std::unique_ptr<TileRanges> ranges;
+    /**
+     * With the NUMA_NODES scheduler on a machine with several nodes, the tiles of each node. Set
+     * by the TaskProcessor before the task is posted. Null otherwise.
+     */
+    std::unique_ptr<NodeTiles> nodeTiles;
+    /**
+     * The number of tiles not yet completed. Each thread subtracts the number of tiles it
+     * processed once it finds no more to claim.
+     */
+    alignas(64) int tilesNotYetFinished /*GUARDED_BY(mQueueMutex)*/;
+    /**
+     * The number of threads working on the task, other than the client thread of doTask(). The
+     * task can't be destroyed until they're all done with it, even if they didn't manage to
+     * claim a tile.
+     */
+    int helpersWorking /*GUARDED_BY(mQueueMutex)*/ = 0;
+    /**
+     * Whether the task is counted in TaskProcessor::mTasksNeedingHelp. Set under mQueueMutex, and
+     * cleared by the thread that claims the last tile, without it.
+     */
+    std::atomic<bool> countedAsNeedingHelp{false};
+    /**
+     * Whether a client thread processes tiles of the task, as threadIndex 0. Only one can, as the
+     * tasks have per-thread state.
+     */
+    bool clientIsWorking /*GUARDED_BY(mQueueMutex)*/ = false;
+    /**
+     * The sum and the maximum over the threads of the time spent processing the tiles of
+     * the task, and the number of threads that processed some. Used to compute the imbalance
+     * reported in the OperationStats.
+     */
+    int64_t totalBusyNs /*GUARDED_BY(mQueueMutex)*/ = 0;
+    int64_t maxBusyNs /*GUARDED_BY(mQueueMutex)*/ = 0;
+    int threadsWithTiles /*GUARDED_BY(mQueueMutex)*/ = 0;
+    /**
+     * Signaled when the task is done, to wake up the client threads waiting for it.
+     */
+    std::condition_variable isFinished;
+
+    /**
+     * For startTask(). The task, owned by this instance, and the callback to call once it's done.
+     */
+    std::unique_ptr<Task> ownedTask;
+    std::function<void()> callback;
+    /**
+     * For startTask(). Keeps this instance alive until the task is done, even if all the
+     * TaskHandles are gone.
+     */
+    std::shared_ptr<ActiveTask> self;
+    /**
+     * For startTask(). Set once the task is done and the callback has returned.
+     */
+    std::atomic<bool> done{false};
+
+    ActiveTask(TaskProcessor* processor, Task* task, int numberOfTiles, int64_t submittedTime,
+               Scheduler scheduler, unsigned int numberOfThreads)
+        : processor{processor},
+          task{task},
+          tasks{&this->task},
+          numberOfTiles{numberOfTiles},
+          submittedTime{submittedTime},
+          tilesNotYetStarted{numberOfTiles},
+          scheduler{scheduler},
+          tilesNotYetFinished{numberOfTiles} {
+        if (scheduler == Scheduler::WORK_STEALING) {
+            ranges = std::make_unique<TileRanges>(numberOfTiles, numberOfThreads);
+        }
+    }
+
+    /**
+     * Claims a tile for threadIndex, which runs on the NUMA node. Returns false if they've all
+     * been claimed.
+     */
+    bool claim(unsigned int threadIndex, int node, int* tileIndex) {
+        if (nodeTiles != nullptr) {
+            return nodeTiles->claim(node, tileIndex);
+        }
+        if (ranges != nullptr) {
+            return ranges->claim(threadIndex, tileIndex);
+        }
+        // This picks the tiles in decreasing order but that does not matter.
+        *tileIndex = tilesNotYetStarted.fetch_sub(1, std::memory_order_relaxed) - 1;
+        return *tileIndex >= 0;
+    }
+
+    bool hasTilesLeft() const {
+        if (nodeTiles != nullptr) {
+            return nodeTiles->hasTilesLeft();
+        }
+        return ranges != nullptr ? ranges->hasTilesLeft()
+                                 : tilesNotYetStarted.load(std::memory_order_relaxed) > 0;
+    }
+
+    /**
+     * Returns the task that tileIndex belongs to, and changes tileIndex into the index of the tile
+     * in that task.
+     */
+    Task* taskOfTile(int* tileIndex) const {
+        if (firstTileOfTask.empty()) {
+            return task;
+        }
+        const size_t i = std::upper_bound(firstTileOfTask.begin(), firstTileOfTask.end(),
+                                          *tileIndex) -
+                         firstTileOfTask.begin() - 1;
+        *tileIndex -= firstTileOfTask[i];
+        return tasks[i];
+    }
+
+    bool isAsync() const { return ownedTask != nullptr; }
+
+    /**
+     * Returns whether the remaining tiles should be skipped, because the task was cancelled or
+     * its deadline has passed. Once it returns true, it always does.
+     */
+    bool shouldStop();
+
+    bool isStopped() const {
+        return status.load(std::memory_order_relaxed) != TaskStatus::COMPLETE;
+    }
+
+    bool allTilesDone() const /*REQUIRES(mQueueMutex)*/ {
+        return tilesNotYetFinished == 0 && helpersWorking == 0;
+    }
+};
+
 /**
  * There's one instance of the task processor for the Toolkit. This class owns the thread pool,
  * and dispatches the tiles of work to the threads.
  */
 class TaskProcessor {
     /**
-     * Does this processor support SIMD-like instructions?
+     * The SIMD kernels we'll use, selected at construction from the processor features.
      */
-    const bool mUsesSimd;
+    const KernelTable* const mKernels;
     /**
      * The number of separate threads we'll spawn. It's one less than the number of threads that
-     * do the work as the client thread that starts the work will also be used.
+     * do the work as the client thread that starts the work will also be used. Changed by
+     * setNumberOfThreads(), under mQueueMutex, while no call is in progress.
+     */
+    std::atomic<unsigned int> mNumberOfPoolThreads;
+    /**
+     * Records the processing of the tasks and tiles when tracing is started.
+     */
+    TaskTracer mTracer;
+    /**
+     * The statistics of the tasks done. See RenderScriptToolkit::getStats().
+     */
+    TaskStats mStats;
+    /**
+     * What each thread has been doing, indexed by threadIndex. See
+     * RenderScriptToolkit::getWorkerStats(). A deque, like the other per-thread entries that
+     * can't be moved, so that entries can be added when the pool grows.
      */
-    const unsigned int mNumberOfPoolThreads;
+    std::deque<WorkerActivity> mWorkerActivity;
     /**
-     * Ensures that only one task is done at a time.
+     * Serializes the changes to the hardware counters settings, to the tracer, to the affinity
+     * of the pool threads, and to the size of the per-thread entries.
      */
-    std::mutex mTaskMutex;
+    std::mutex mSettingsMutex;
     /**
-     * Ensures consistent access to the shared queue state.
+     * The kernel ids of the pool threads, indexed by threadIndex - 1, to set their affinity. 0
+     * until the thread has started.
+     */
+    std::vector<pid_t> mPoolThreadIds /*GUARDED_BY(mSettingsMutex)*/;
+    /**
+     * The CPU each pool thread is pinned to, indexed by threadIndex - 1. Empty when they're not
+     * pinned. See RenderScriptToolkit::setCpuAffinity().
+     */
+    std::vector<int> mPinnedCpus /*GUARDED_BY(mSettingsMutex)*/;
+    /**
+     * The CPUs given to setCpuAffinity(), in the order the pool threads are pinned to them, so
+     * that the threads added when the pool grows can be pinned too.
+     */
+    std::vector<int> mPinningOrder /*GUARDED_BY(mSettingsMutex)*/;
+    /**
+     * The CPUs the pool threads run on when they're not pinned: those of the thread that created
+     * the processor, which they inherit.
+     */
+    cpu_set_t mInheritedAffinity;
+    /**
+     * The NUMA nodes of the machine, and whether each has CPUs in mInheritedAffinity, i.e. threads
+     * to process its tiles. Used by the NUMA_NODES scheduler.
+     */
+    const NumaTopology mNuma;
+    std::vector<bool> mNodeHasThreads;
+    /**
+     * Guards the list of active tasks and the bookkeeping of their completion. It's also used by
+     * the pool threads to sleep until there's work, and by the client threads to sleep until their
+     * task is done. The tiles themselves are claimed without it.
      */
     std::mutex mQueueMutex;
     /**
      * The thread pool workers.
      */
     std::vector<std::thread> mPoolThreads;
+
     /**
-     * The task being processed, if any. We only do one task at a time. We could create a queue
-     * of tasks but using a mTaskMutex is sufficient for now.
+     * The tasks being processed, in the order they were started. Tasks from different client
+     * threads are processed at the same time. The pool threads help with the one with tiles left
+     * that has the fewest pool threads working on it.
      */
-    Task* mCurrentTask /*GUARDED_BY(mTaskMutex)*/ = nullptr;
+    std::vector<ActiveTask*> mActiveTasks /*GUARDED_BY(mQueueMutex)*/;
     /**
      * Signals that the mPoolThreads should terminate.
      */
@@ -194,68 +547,362 @@ class TaskProcessor {
      */
     std::condition_variable mWorkAvailableOrStop;
     /**
-     * Signaled when the work for the task is finished.
+     * How the tiles of the tasks are distributed. A change applies to the tasks started after it.
      */
-    std::condition_variable mWorkIsFinished;
+    std::atomic<Scheduler> mScheduler{Scheduler::SHARED_COUNTER};
     /**
-     * A user task, e.g. a blend or a blur, is split into a number of tiles. When a thread starts
-     * working on a new tile, it uses this count to identify which tile to work on. The tile
-     * number is sufficient to determine the boundaries of the data to process.
-     *
-     * The number of tiles left to process.
+     * What the pool threads do when they run out of work, and how long they poll for more
+     * before parking with the SPIN and YIELD policies.
+     */
+    std::atomic<WaitPolicy> mWaitPolicy{WaitPolicy::PARK};
+    std::atomic<int64_t> mSpinBudgetNs{RenderScriptToolkit::kDefaultSpinMicroseconds * 1000};
+    /**
+     * Incremented, under mQueueMutex, whenever a task is posted or the pool threads are asked to
+     * stop. The pool threads that poll for work watch it, without taking the lock.
+     */
+    std::atomic<uint64_t> mWorkGeneration{0};
+    /**
+     * The number of pool threads polling for work. Those don't need to be notified.
      */
-    int mTilesNotYetStarted /*GUARDED_BY(mQueueMutex)*/ = 0;
+    std::atomic<int> mSpinningThreads{0};
     /**
-     * The number of tiles currently being processed. Must not be greater than
-     * mNumberOfPoolThreads + 1.
+     * The number of tasks of each priority in mActiveTasks that have tiles left to claim and
+     * room for another helper. Read without mQueueMutex by the pool threads between tiles to
+     * tell whether a more urgent task may need them, so they only take the lock when one does.
+     * See updateNeedsHelp().
      */
-    int mTilesInProcess /*GUARDED_BY(mQueueMutex)*/ = 0;
+    std::atomic<int> mTasksNeedingHelp[kNumberOfPriorities] = {};
 
     /**
-     * Determines how we'll tile the work and signals the thread pool of available work.
-     *
-     * @param task The task to be performed.
+     * Whether the tiles are sized from the times measured by mAutotuner. See
+     * RenderScriptToolkit::enableTileAutotuning().
+     */
+    std::atomic<bool> mTileAutotuning{false};
+    TileAutotuner mAutotuner;
+    /**
+     * The number of threads and the tile size of each op and size class. See
+     * RenderScriptToolkit::setTuning().
      */
-    void startWork(Task* task) /*REQUIRES(mTaskMutex)*/;
+    TuningProfile mTuning;
 
     /**
-     * Tells the thread to start processing work off the queue.
-     *
-     * The flag is used for prevent the main thread from blocking forever if the work is
-     * so trivial that the worker threads complete the work before the main thread calls this
-     * method.
+     * Whether we capture the hardware counters around each tile. See enableHardwareCounters().
+     */
+    std::atomic<bool> mCountHardwareEvents{false};
+    /**
+     * Whether each hardware counter could be opened, as found when they were enabled.
+     */
+    bool mAvailableHardwareCounters[kNumberOfHardwareCounters] /*GUARDED_BY(mSettingsMutex)*/ = {};
+    /**
+     * The hardware counts accumulated by one thread. They're aligned to a cache line so that
+     * threads updating their own counts don't slow each other down. They're atomic as the
+     * client threads share the entry of threadIndex 0, and as they can be read while tasks are
+     * processed.
+     */
+    struct alignas(64) ThreadCounters {
+        std::atomic<uint64_t> values[kNumberOfHardwareCounters] = {};
+        std::atomic<uint64_t> tiles{0};
+    };
+    /**
+     * The hardware counts, indexed by threadIndex.
+     */
+    std::deque<ThreadCounters> mThreadCounters;
+
+    /**
+     * Serializes the calls to setNumberOfThreads().
+     */
+    std::mutex mResizeMutex;
+    /**
+     * The number of Toolkit calls in progress, asynchronous ones included until they're done,
+     * and whether the pool is being resized. A resize waits for the calls in progress to be done,
+     * and the calls made meanwhile wait for the resize, so that the number of threads doesn't
+     * change under a task. Signaled by mCallsChanged.
+     */
+    std::mutex mCallsMutex;
+    std::condition_variable mCallsChanged;
+    int mCallsInProgress /*GUARDED_BY(mCallsMutex)*/ = 0;
+    bool mResizing /*GUARDED_BY(mCallsMutex)*/ = false;
+
+    /**
+     * Brackets the processing of a task, from before prepareTask() to its completion. See
+     * mCallsInProgress.
+     */
+    void beginCall();
+    void endCall();
+
+    /**
+     * Adds the task, already tiled, to mActiveTasks, and signals the thread pool of available
+     * work. Only as many pool threads are woken up as there are tiles for them, as the others
+     * would find nothing to do.
+     */
+    void startWork(ActiveTask* active);
+
+    /**
+     * For the NUMA_NODES scheduler, returns the tiles of each node: those whose input rows are in
+     * the memory of the node, or contiguous bands of rows when that's not known. Returns null if
+     * there's a single node.
+     */
+    std::unique_ptr<NodeTiles> assignTilesToNodes(ActiveTask* active) const;
+
+    /**
+     * Selects the kernels of the task and divides it into tiles. Returns the number of tiles,
+     * and sets numberOfThreads to the number of threads, the client thread included, that should
+     * work on the task.
+     */
+    int prepareTask(Task* task, unsigned int* numberOfThreads);
+
+    /**
+     * Whether doTask() and doTasks() should process tasks of this number of tiles and of this
+     * cost on the calling thread alone, without involving the pool.
+     */
+    bool shouldRunInline(int numberOfTiles, size_t cost, unsigned int numberOfThreads) const;
+
+    /**
+     * Processes the task on the calling thread, as threadIndex 0, without adding it to
+     * mActiveTasks. The pool threads never see it.
+     */
+    void runInline(ActiveTask* active);
+
+    /**
+     * Sets the affinity of the pool thread, from mPinnedCpus, if it has started. Returns false if
+     * the kernel refuses.
+     */
+    bool applyAffinity(unsigned int threadIndex) /*REQUIRES(mSettingsMutex)*/;
+
+    /**
+     * Tells the pool thread to start processing work off the queue. Returns when mStopThreads
+     * is set and there are no tiles left to start.
      *
-     * @param threadIndex The index number (0..mNumberOfPoolThreads) this thread will referred by.
-     * @param returnWhenNoWork If there's no work, return immediately.
+     * @param threadIndex The index number (1..mNumberOfPoolThreads) this thread will referred by.
+     */
+    void processTilesOfWork(int threadIndex);
+
+    /**
+     * Polls for new work, i.e. for mWorkGeneration to change from generation, according to the
+     * wait policy. Returns false if there was none by the end of the spin budget.
+     */
+    bool spinForWork(uint64_t generation);
+
+    /**
+     * Returns the task of mActiveTasks that a pool thread should help with, or nullptr if none
+     * has tiles left to start: the most urgent one, and of those, the one with the fewest pool
+     * threads working on it.
+     */
+    ActiveTask* findTaskToHelpWith() /*REQUIRES(mQueueMutex)*/;
+
+    /**
+     * Whether a task more urgent than priority has tiles left that a pool thread could help with.
+     */
+    bool hasMoreUrgentTask(Priority priority) /*EXCLUDES(mQueueMutex)*/;
+
+    /**
+     * Adds the task to mActiveTasks, or removes it.
+     */
+    void addActiveTask(ActiveTask* active) /*REQUIRES(mQueueMutex)*/;
+    void removeActiveTask(ActiveTask* active) /*REQUIRES(mQueueMutex)*/;
+
+    /**
+     * Counts the task in mTasksNeedingHelp if it has tiles left and room for another helper, or
+     * stops counting it. Called whenever helpersWorking changes.
+     */
+    void updateNeedsHelp(ActiveTask* active) /*REQUIRES(mQueueMutex)*/;
+
+    /**
+     * Stops counting the task in mTasksNeedingHelp. Doesn't need mQueueMutex, so the thread that
+     * claims the last tile can call it right away.
+     */
+    void stopCountingAsNeedingHelp(ActiveTask* active);
+
+    /**
+     * The tiles of a task that one thread processed in one go.
+     */
+    struct TileRun {
+        int tiles = 0;
+        /** The tiles claimed but not processed, as the task was stopped. */
+        int skipped = 0;
+        /** The time spent processing them. */
+        int64_t busyNs = 0;
+        /** When the first of them started. */
+        int64_t start = 0;
+    };
+
+    /**
+     * Processes tiles of the task until there are none left to claim. A pool thread stops early
+     * when a more urgent task needs help, see RenderScriptToolkit::Priority. Once the task is
+     * stopped, see ActiveTask::shouldStop(), the tiles are claimed without being processed.
+     */
+    TileRun claimAndRunTiles(int threadIndex, ActiveTask* active);
+
+    /**
+     * Accounts for the tiles processed by one thread in the task's completion count. Returns true
+     * if that completed an asynchronous task, which the caller must then pass to
+     * completeAsyncTask() after releasing mQueueMutex.
+     */
+    bool finishTiles(ActiveTask* active, const TileRun& run) /*REQUIRES(mQueueMutex)*/;
+
+    /**
+     * Does what's left once all the tiles of the task are done: Task::finish(), and recording
+     * the task in the tracer and the statistics. A stopped task is only traced.
      */
-    void processTilesOfWork(int threadIndex, bool returnWhenNoWork);
+    void completeTask(int threadIndex, ActiveTask* active);
 
     /**
-     * Wait for the pool workers to complete the work on the current task.
+     * Completes an asynchronous task: calls completeTask() and the callback, then wakes up the
+     * threads waiting for it and lets it go.
      */
-    void waitForPoolWorkersToComplete();
+    void completeAsyncTask(int threadIndex, ActiveTask* active);
+
+    /**
+     * Processes the task on the calling thread, as threadIndex 0, and the pool threads, and
+     * returns once it's complete. Used by doTask() and doTasks().
+     */
+    void runClientTask(ActiveTask* active);
+
+    /**
+     * Accounts for the tiles processed by the client thread, waits for the pool workers to
+     * complete the work on the task, then removes it from mActiveTasks.
+     */
+    void waitForPoolWorkersToComplete(ActiveTask* active, const TileRun& run);
+
+    /**
+     * Processes a tile of the task, capturing the hardware counters and tracing it if requested.
+     * Returns the time it took.
+     */
+    int64_t runTile(int threadIndex, ActiveTask* active, int tileIndex);
+
+    /**
+     * Processes a tile of the task, and adds the hardware events that occurred on this thread
+     * while doing so to its entry of mThreadCounters.
+     */
+    void processTileWithCounters(int threadIndex, Task* task, int tileIndex);
 
    public:
     /**
      * Create the processor.
      *
-     * @param numThreads The total number of threads to use. If 0, we'll decided based on system
-     * properties.
+     * @param numThreads The total number of threads to use. If 0, we'll decide based on system
+     * properties, see defaultNumberOfThreads().
+     * @param simdTier The SIMD tier to use. If not supported, the best supported tier below it
+     * is used.
      */
-    explicit TaskProcessor(unsigned int numThreads = 0);
+    TaskProcessor(unsigned int numThreads, SimdTier simdTier);
 
     ~TaskProcessor();
 
     /**
-     * Do the specified task. Returns only after the task has been completed.
+     * Do the specified task. Returns only after the task has been completed. Tasks started from
+     * different threads are processed at the same time, their tiles spread over the pool. The
+     * calling thread only processes tiles of its own task. Tasks too small to be worth waking
+     * up the pool for, see shouldRunInline(), are processed by the calling thread alone. The
+     * options, which may be null, are those of the Toolkit method call. Returns whether the task
+     * was completed or stopped.
      */
-    void doTask(Task* task);
+    TaskStatus doTask(Task* task, const TaskOptions* options);
 
     /**
-     * Some Tasks need to allocate temporary storage for each worker thread.
-     * This provides the number of threads.
+     * Does the tasks as one batch. Returns only after they have all been completed. Their tiles
+     * are distributed together, so the pool is woken up once for the batch, and small tasks that
+     * have fewer tiles than there are threads still keep all the threads busy. The batch is
+     * recorded in the statistics and the trace as one call, under the name of its first task.
+     * Stopping the batch stops all its tasks.
+     */
+    TaskStatus doTasks(const std::vector<std::unique_ptr<Task>>& tasks, const TaskOptions* options);
+
+    /**
+     * Starts the task and returns without waiting for it to be done. The callback, if any, is
+     * called once it is, on the thread that completed it. If there are no pool threads, the task
+     * is done before this returns. See RenderScriptToolkit::TaskHandle.
+     */
+    std::shared_ptr<ActiveTask> startTask(std::unique_ptr<Task> task,
+                                          std::function<void()> callback,
+                                          const TaskOptions* options);
+
+    /**
+     * Waits for a task started by startTask() to be done. If no other client thread is working on
+     * it, the calling thread helps with its tiles.
+     */
+    void waitFor(ActiveTask* active);
+
+    /**
+     * The number of threads that process the tasks, the client thread included.
      */
     unsigned int getNumberOfThreads() const { return mNumberOfPoolThreads + 1; }
+
+    /**
+     * See RenderScriptToolkit::defaultNumberOfThreads().
+     */
+    static unsigned int defaultNumberOfThreads(unsigned int maxThreads);
+
+    /**
+     * See RenderScriptToolkit::setNumberOfThreads(). numberOfThreads is at least 1.
+     */
+    void setNumberOfThreads(unsigned int numberOfThreads);
+
+    /**
+     * The SIMD tier used for all the tasks.
+     */
+    SimdTier getSimdTier() const { return mKernels->tier; }
+
+    /**
+     * See RenderScriptToolkit::setScheduler().
+     */
+    void setScheduler(Scheduler scheduler) { mScheduler = scheduler; }
+    Scheduler getScheduler() const { return mScheduler; }
+
+    /**
+     * See RenderScriptToolkit::setWaitPolicy().
+     */
+    void setWaitPolicy(WaitPolicy policy, int spinMicroseconds) {
+        mSpinBudgetNs = static_cast<int64_t>(std::max(0, spinMicroseconds)) * 1000;
+        mWaitPolicy = policy;
+    }
+    WaitPolicy getWaitPolicy() const { return mWaitPolicy; }
+
+    /**
+     * See RenderScriptToolkit::enableTileAutotuning().
+     */
+    void enableTileAutotuning(bool enable) {
+        if (enable && !mTileAutotuning) {
+            mAutotuner.reset();
+        }
+        mTileAutotuning = enable;
+    }
+
+    /**
+     * See RenderScriptToolkit::setCpuAffinity().
+     */
+    bool setCpuAffinity(const std::vector<int>& cpus, ThreadPlacement placement);
+    void clearCpuAffinity();
+
+    /**
+     * See RenderScriptToolkit::setTuning().
+     */
+    void setTuning(const Tuning& tuning) { mTuning.set(tuning); }
+    std::vector<Tuning> getTuning() const { return mTuning.get(); }
+    void clearTuning() { mTuning.clear(); }
+    bool loadTuningProfile(const char* path) { return mTuning.load(path); }
+    bool saveTuningProfile(const char* path) const { return mTuning.save(path); }
+
+    /**
+     * See RenderScriptToolkit::enableHardwareCounters().
+     */
+    bool enableHardwareCounters(bool enable);
+    HardwareCounters getHardwareCounters();
+    void resetHardwareCounters();
+
+    /**
+     * See RenderScriptToolkit::startTracing().
+     */
+    void startTracing();
+    void stopTracing();
+    bool writeTrace(const char* path);
+
+    /**
+     * See RenderScriptToolkit::getStats().
+     */
+    std::vector<OperationStats> getStats() const { return mStats.get(); }
+    std::vector<WorkerStats> getWorkerStats();
+    void resetStats();
 };
 
 }  // namespace renderscript
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TaskStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace renderscript {
+
+int DurationHistogram::bucketOf(uint64_t nanoseconds) {
+    if (nanoseconds < kSubBuckets) {
+        return static_cast<int>(nanoseconds);
+    }
+    const int powerOfTwo = std::min(63 - __builtin_clzll(nanoseconds), kMaxPowerOfTwo);
+    if (powerOfTwo == kMaxPowerOfTwo) {
+        return kNumberOfBuckets - 1;
+    }
+    // The kSubBucketBits bits that follow the most significant one select the sub-bucket.
+    const int subBucket =
+            static_cast<int>(nanoseconds >> (powerOfTwo - kSubBucketBits)) & (kSubBuckets - 1);
+    return kSubBuckets * (powerOfTwo - kSubBucketBits + 1) + subBucket;
+}
+
+double DurationHistogram::middleOf(int bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    const int powerOfTwo = bucket / kSubBuckets + kSubBucketBits - 1;
+    const int subBucket = bucket % kSubBuckets;
+    const double width = std::ldexp(1.0, powerOfTwo - kSubBucketBits);
+    return (kSubBuckets + subBucket) * width + width / 2;
+}
+
+void DurationHistogram::add(int64_t nanoseconds) {
+    mCounts[bucketOf(static_cast<uint64_t>(std::max<int64_t>(0, nanoseconds)))]++;
+    mTotalCount++;
+}
+
+double DurationHistogram::percentileUs(double p) const {
+    if (mTotalCount == 0) {
+        return 0;
+    }
+    // The rank of the duration we're looking for, from 1 to mTotalCount.
+    const uint64_t rank = std::max<uint64_t>(
+            1, static_cast<uint64_t>(std::ceil(p * static_cast<double>(mTotalCount))));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < kNumberOfBuckets; bucket++) {
+        seen += mCounts[bucket];
+        if (seen >= rank) {
+            return middleOf(bucket) / 1000.0;
+        }
+    }
+    return middleOf(kNumberOfBuckets - 1) / 1000.0;
+}
+
+void TaskStats::record(const char* name, size_t pixels, int64_t waitNs, int64_t latencyNs,
+                       double imbalance) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto found = mOps.find(name);
+    if (found == mOps.end()) {
+        found = mOps.emplace(name, Op()).first;
+    }
+    Op& op = found->second;
+    op.calls++;
+    op.pixels += pixels;
+    op.totalLatencyNs += latencyNs;
+    op.maxLatencyNs = std::max(op.maxLatencyNs, latencyNs);
+    op.totalWaitNs += waitNs;
+    op.maxWaitNs = std::max(op.maxWaitNs, waitNs);
+    op.totalImbalance += imbalance;
+    op.maxImbalance = std::max(op.maxImbalance, imbalance);
+    op.latency.add(latencyNs);
+    op.wait.add(waitNs);
+}
+
+std::vector<OperationStats> TaskStats::get() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<OperationStats> stats;
+    for (const auto& [name, op] : mOps) {
+        OperationStats s;
+        s.name = name;
+        s.calls = op.calls;
+        s.pixels = op.pixels;
+        // The middle of a bucket can be above the longest duration that fell in it.
+        s.totalLatencyUs = static_cast<double>(op.totalLatencyNs) / 1000.0;
+        s.latencyMaxUs = static_cast<double>(op.maxLatencyNs) / 1000.0;
+        s.latencyP50Us = std::min(op.latency.percentileUs(0.50), s.latencyMaxUs);
+        s.latencyP95Us = std::min(op.latency.percentileUs(0.95), s.latencyMaxUs);
+        s.latencyP99Us = std::min(op.latency.percentileUs(0.99), s.latencyMaxUs);
+        s.totalWaitUs = static_cast<double>(op.totalWaitNs) / 1000.0;
+        s.waitMaxUs = static_cast<double>(op.maxWaitNs) / 1000.0;
+        s.waitP50Us = std::min(op.wait.percentileUs(0.50), s.waitMaxUs);
+        s.waitP95Us = std::min(op.wait.percentileUs(0.95), s.waitMaxUs);
+        s.waitP99Us = std::min(op.wait.percentileUs(0.99), s.waitMaxUs);
+        s.imbalanceMean = op.totalImbalance / static_cast<double>(op.calls);
+        s.imbalanceMax = op.maxImbalance;
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+void TaskStats::reset() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mOps.clear();
+}
+
+void WorkerActivity::addWakeUp(int64_t latencyNs) {
+    add<uint64_t>(&mWakeUps, 1);
+    add(&mTotalWakeLatencyNs, latencyNs);
+    if (latencyNs > mMaxWakeLatencyNs.load(std::memory_order_relaxed)) {
+        mMaxWakeLatencyNs.store(latencyNs, std::memory_order_relaxed);
+    }
+}
+
+WorkerStats WorkerActivity::get(unsigned int threadIndex) const {
+    WorkerStats s;
+    s.threadIndex = threadIndex;
+    s.tiles = mTiles.load(std::memory_order_relaxed);
+    s.busyUs = static_cast<double>(mBusyNs.load(std::memory_order_relaxed)) / 1000.0;
+    s.idleUs = static_cast<double>(mIdleNs.load(std::memory_order_relaxed)) / 1000.0;
+    s.wakeUps = mWakeUps.load(std::memory_order_relaxed);
+    s.totalWakeLatencyUs =
+            static_cast<double>(mTotalWakeLatencyNs.load(std::memory_order_relaxed)) / 1000.0;
+    s.maxWakeLatencyUs =
+            static_cast<double>(mMaxWakeLatencyNs.load(std::memory_order_relaxed)) / 1000.0;
+    return s;
+}
+
+void WorkerActivity::reset() {
+    mTiles = 0;
+    mBusyNs = 0;
+    mIdleNs = 0;
+    mWakeUps = 0;
+    mTotalWakeLatencyNs = 0;
+    mMaxWakeLatencyNs = 0;
+}
+
+}  // namespace renderscript
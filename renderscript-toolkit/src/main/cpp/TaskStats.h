@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_TASKSTATS_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_TASKSTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "RenderScriptToolkit.h"
+
+namespace renderscript {
+
+using OperationStats = RenderScriptToolkit::OperationStats;
+using WorkerStats = RenderScriptToolkit::WorkerStats;
+
+/**
+ * A histogram of durations with logarithmic buckets, from which we estimate percentiles.
+ *
+ * Durations below 8 ns each have their own bucket. Above that, each power of two is divided into
+ * 8 buckets, so an estimate is within 6.25% of the actual duration. Durations above about 18
+ * minutes all go in the last bucket.
+ */
+class DurationHistogram {
+    static constexpr int kSubBucketBits = 3;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kMaxPowerOfTwo = 40;
+    // The exact buckets, the sub-buckets of each power of two, and one for the longest durations.
+    static constexpr int kNumberOfBuckets =
+            kSubBuckets * (kMaxPowerOfTwo - kSubBucketBits + 1) + 1;
+
+    uint64_t mCounts[kNumberOfBuckets] = {};
+    uint64_t mTotalCount = 0;
+
+    static int bucketOf(uint64_t nanoseconds);
+    /**
+     * Returns the middle of the range of durations that fall in the bucket.
+     */
+    static double middleOf(int bucket);
+
+   public:
+    void add(int64_t nanoseconds);
+    /**
+     * Returns an estimate of the duration below which the fraction p of the durations are, in
+     * microseconds. Returns 0 if the histogram is empty.
+     */
+    double percentileUs(double p) const;
+};
+
+/**
+ * The statistics of the Toolkit method calls, per op. The TaskProcessor records each task once
+ * it's done. The stats have their own lock, so reading them doesn't wait for the current task.
+ */
+class TaskStats {
+    struct Op {
+        uint64_t calls = 0;
+        uint64_t pixels = 0;
+        int64_t totalLatencyNs = 0;
+        int64_t maxLatencyNs = 0;
+        int64_t totalWaitNs = 0;
+        int64_t maxWaitNs = 0;
+        double totalImbalance = 0;
+        double maxImbalance = 0;
+        DurationHistogram latency;
+        DurationHistogram wait;
+    };
+
+    mutable std::mutex mMutex;
+    /**
+     * The stats of each op, by name. std::less<> lets us look up a name without creating a
+     * std::string.
+     */
+    std::map<std::string, Op, std::less<>> mOps /*GUARDED_BY(mMutex)*/;
+
+   public:
+    /**
+     * Records a task of the named op that processed pixels cells. It waited waitNs for the
+     * previous tasks to finish, then took latencyNs to do. See OperationStats for imbalance.
+     */
+    void record(const char* name, size_t pixels, int64_t waitNs, int64_t latencyNs,
+                double imbalance);
+    std::vector<OperationStats> get() const;
+    void reset();
+};
+
+/**
+ * What one thread has been doing, for WorkerStats. They're atomic so that they can be read
+ * while the thread is working. The idle and wake-up totals are only updated by their pool
+ * thread, so without read-modify-write atomics.
+ *
+ * The entries of the threads are aligned to a cache line so that they don't slow each other down.
+ */
+class alignas(64) WorkerActivity {
+    std::atomic<uint64_t> mTiles{0};
+    std::atomic<int64_t> mBusyNs{0};
+    std::atomic<int64_t> mIdleNs{0};
+    std::atomic<uint64_t> mWakeUps{0};
+    std::atomic<int64_t> mTotalWakeLatencyNs{0};
+    std::atomic<int64_t> mMaxWakeLatencyNs{0};
+
+    template <typename T>
+    static void add(std::atomic<T>* total, T value) {
+        total->store(total->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+   public:
+    /**
+     * Adds tiles processed by the thread. The client threads all share threadIndex 0, so this
+     * total has more than one writer.
+     */
+    void addTiles(int tiles, int64_t busyNs) {
+        mTiles.fetch_add(tiles, std::memory_order_relaxed);
+        mBusyNs.fetch_add(busyNs, std::memory_order_relaxed);
+    }
+    void addIdle(int64_t idleNs) { add(&mIdleNs, idleNs); }
+    void addWakeUp(int64_t latencyNs);
+
+    WorkerStats get(unsigned int threadIndex) const;
+    void reset();
+};
+
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_TASKSTATS_H
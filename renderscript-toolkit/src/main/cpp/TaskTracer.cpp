@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TaskTracer.h"
+
+#include <unistd.h>
+
+#include <set>
+
+#include "Utils.h"
+
+#define LOG_TAG "renderscript.toolkit.TaskTracer"
+
+namespace renderscript {
+
+/**
+ * Returns a small number that identifies the calling thread in the trace, unlike its thread id
+ * which can be reused.
+ */
+static unsigned int clientId() {
+    static std::atomic<unsigned int> nextId{0};
+    thread_local unsigned int id = nextId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+TaskTracer::TaskTracer(unsigned int numberOfThreads) : mThreads(numberOfThreads) {}
+
+void TaskTracer::setNumberOfThreads(unsigned int numberOfThreads) {
+    while (mThreads.size() < numberOfThreads) {
+        mThreads.emplace_back();
+    }
+    while (mThreads.size() > numberOfThreads) {
+        mThreads.pop_back();
+    }
+}
+
+void TaskTracer::start() {
+    for (ThreadEvents& thread : mThreads) {
+        std::lock_guard<std::mutex> lock(thread.mutex);
+        thread.events.clear();
+        thread.dropped = 0;
+    }
+    mOrigin = nowInNanoseconds();
+    mEnabled = true;
+}
+
+void TaskTracer::stop() { mEnabled = false; }
+
+void TaskTracer::add(unsigned int threadIndex, Event event) {
+    if (threadIndex == 0) {
+        event.client = clientId();
+    }
+    ThreadEvents& thread = mThreads[threadIndex];
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    if (thread.events.size() >= kMaxEventsPerThread) {
+        thread.dropped++;
+        return;
+    }
+    thread.events.push_back(event);
+}
+
+void TaskTracer::addTask(unsigned int threadIndex, const char* name, int64_t start, int64_t end,
+                         size_t sizeX, size_t sizeY, size_t numberOfTiles) {
+    add(threadIndex, Event{EventType::TASK, name, start, end, numberOfTiles, 0, 0, sizeX, sizeY, 0});
+}
+
+void TaskTracer::addTile(unsigned int threadIndex, const char* name, size_t tileIndex,
+                         size_t startX, size_t startY, size_t endX, size_t endY, int64_t start,
+                         int64_t end) {
+    add(threadIndex,
+        Event{EventType::TILE, name, start, end, tileIndex, startX, startY, endX, endY, 0});
+}
+
+void TaskTracer::addWake(unsigned int threadIndex, int64_t posted, int64_t woken) {
+    add(threadIndex, Event{EventType::WAKE, "wake", posted, woken, 0, 0, 0, 0, 0, 0});
+}
+
+bool TaskTracer::write(FILE* file) {
+    const int pid = static_cast<int>(getpid());
+    const int64_t origin = mOrigin.load(std::memory_order_relaxed);
+    // The trace event timestamps are in microseconds.
+    auto us = [origin](int64_t t) { return static_cast<double>(t - origin) / 1000.0; };
+    // The pool threads are tracks 1 to size - 1. The client threads follow.
+    auto tid = [this](size_t t, const Event& e) {
+        return t == 0 ? mThreads.size() + e.client : t;
+    };
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(file,
+            "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": "
+            "\"RenderScriptToolkit\"}}",
+            pid);
+    for (size_t t = 0; t < mThreads.size(); t++) {
+        std::lock_guard<std::mutex> lock(mThreads[t].mutex);
+        std::set<unsigned int> clients;
+        if (t == 0) {
+            for (const Event& e : mThreads[t].events) {
+                clients.insert(e.client);
+            }
+        }
+        for (unsigned int client : clients) {
+            fprintf(file,
+                    ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %zu, "
+                    "\"args\": {\"name\": \"client %u\"}}",
+                    pid, mThreads.size() + client, client);
+        }
+        if (t > 0) {
+            fprintf(file,
+                    ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %zu, "
+                    "\"args\": {\"name\": \"pool %zu\"}}",
+                    pid, t, t);
+        }
+        for (const Event& e : mThreads[t].events) {
+            fprintf(file,
+                    ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, "
+                    "\"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+                    e.name,
+                    e.type == EventType::TASK ? "task"
+                                              : (e.type == EventType::TILE ? "tile" : "wake"),
+                    pid, tid(t, e), us(e.start), us(e.end) - us(e.start));
+            switch (e.type) {
+                case EventType::TASK:
+                    fprintf(file, "\"sizeX\": %zu, \"sizeY\": %zu, \"tiles\": %zu", e.endX,
+                            e.endY, e.index);
+                    break;
+                case EventType::TILE:
+                    fprintf(file,
+                            "\"tile\": %zu, \"startX\": %zu, \"startY\": %zu, \"endX\": %zu, "
+                            "\"endY\": %zu, \"cells\": %zu",
+                            e.index, e.startX, e.startY, e.endX, e.endY,
+                            (e.endX - e.startX) * (e.endY - e.startY));
+                    break;
+                case EventType::WAKE:
+                    break;
+            }
+            fprintf(file, "}}");
+        }
+        if (mThreads[t].dropped > 0) {
+            ALOGW("Thread %zu dropped %zu trace events", t, mThreads[t].dropped);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return !ferror(file);
+}
+
+}  // namespace renderscript
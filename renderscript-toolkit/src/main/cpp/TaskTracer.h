@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_TASKTRACER_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_TASKTRACER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace renderscript {
+
+/**
+ * Records when each task and each tile was processed, and by which thread, so that the
+ * scheduling of the work can be inspected in a trace viewer like Perfetto or chrome://tracing.
+ *
+ * The tracer is off until start() is called. When off, the TaskProcessor only pays for checking
+ * isEnabled(), a relaxed atomic load, once per task and once per tile.
+ *
+ * Each thread records its events in its own buffer, indexed by threadIndex. Each buffer has a
+ * lock, which is only contended for threadIndex 0, shared by all the client threads, and while
+ * start() or write() goes through the buffers. The events of threadIndex 0 remember which client
+ * thread recorded them, so that each client thread gets its own track.
+ *
+ * The times given to the add methods are those of nowInNanoseconds().
+ */
+class TaskTracer {
+   public:
+    /**
+     * Each thread records at most this many events. Beyond that, the events are dropped and
+     * counted, so that a forgotten tracer can't use up all the memory.
+     */
+    static constexpr size_t kMaxEventsPerThread = 1 << 20;
+
+    explicit TaskTracer(unsigned int numberOfThreads);
+
+    /**
+     * Adds or removes the buffers of the last threads, as the pool is resized. The events of the
+     * removed threads are dropped. No thread may record events meanwhile.
+     */
+    void setNumberOfThreads(unsigned int numberOfThreads);
+
+    bool isEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Discards the events recorded so far and starts recording.
+     */
+    void start();
+    void stop();
+
+    /**
+     * Records a task processed by threadIndex, the thread that called doTask, from start to end.
+     */
+    void addTask(unsigned int threadIndex, const char* name, int64_t start, int64_t end,
+                 size_t sizeX, size_t sizeY, size_t numberOfTiles);
+    /**
+     * Records a tile of a task processed by threadIndex from start to end. The end values of the
+     * rectangle are excluded.
+     */
+    void addTile(unsigned int threadIndex, const char* name, size_t tileIndex, size_t startX,
+                 size_t startY, size_t endX, size_t endY, int64_t start, int64_t end);
+    /**
+     * Records that the pool thread threadIndex woke up at woken to process the work posted at
+     * posted.
+     */
+    void addWake(unsigned int threadIndex, int64_t posted, int64_t woken);
+
+    /**
+     * Writes the recorded events in the Chrome trace event JSON format. Each thread of the
+     * pool and each client thread that called the Toolkit methods is a track. Returns false if
+     * the file can't be written.
+     */
+    bool write(FILE* file);
+
+   private:
+    enum class EventType { TASK, TILE, WAKE };
+
+    struct Event {
+        EventType type;
+        const char* name;
+        int64_t start;
+        int64_t end;
+        // For a task, the number of tiles. For a tile, its index.
+        size_t index;
+        // For a task, the size of the data. For a tile, its rectangle.
+        size_t startX;
+        size_t startY;
+        size_t endX;
+        size_t endY;
+        // For the events of threadIndex 0, which client thread recorded it. See clientId().
+        unsigned int client;
+    };
+
+    /**
+     * The events of one thread. They're aligned to a cache line so that threads recording their
+     * own events don't slow each other down.
+     */
+    struct alignas(64) ThreadEvents {
+        std::mutex mutex;
+        std::vector<Event> events /*GUARDED_BY(mutex)*/;
+        size_t dropped /*GUARDED_BY(mutex)*/ = 0;
+    };
+
+    void add(unsigned int threadIndex, Event event);
+
+    std::atomic<bool> mEnabled{false};
+    /**
+     * The time when tracing started. The timestamps in the trace are relative to it.
+     */
+    std::atomic<int64_t> mOrigin{0};
+    /**
+     * Indexed by threadIndex. A deque, as the buffers can't be moved when threads are added.
+     */
+    std::deque<ThreadEvents> mThreads;
+};
+
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_TASKTRACER_H
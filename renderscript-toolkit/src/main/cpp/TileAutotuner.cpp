@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TileAutotuner.h"
+
+#include <algorithm>
+
+namespace renderscript {
+
+int TileAutotuner::sizeClassOf(size_t cells) {
+    if (cells == 0) {
+        return 0;
+    }
+    const int powerOfTwo = 63 - __builtin_clzll(static_cast<unsigned long long>(cells));
+    return std::min(powerOfTwo / 2, kNumberOfSizeClasses - 1);
+}
+
+double TileAutotuner::nsPerCostUnit(const char* name, size_t cells) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto op = mNsPerCostUnit.find(name);
+    return op == mNsPerCostUnit.end() ? 0 : op->second[sizeClassOf(cells)];
+}
+
+void TileAutotuner::record(const char* name, size_t cells, size_t cost, int64_t busyNs) {
+    if (cost == 0 || busyNs <= 0) {
+        return;
+    }
+    const double measured = static_cast<double>(busyNs) / static_cast<double>(cost);
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto op = mNsPerCostUnit.find(name);
+    if (op == mNsPerCostUnit.end()) {
+        op = mNsPerCostUnit.emplace(name, std::array<double, kNumberOfSizeClasses>{}).first;
+    }
+    double& average = op->second[sizeClassOf(cells)];
+    average = average == 0 ? measured
+                           : average + (measured - average) * kWeightOfNewMeasurement;
+}
+
+void TileAutotuner::reset() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mNsPerCostUnit.clear();
+}
+
+}  // namespace renderscript
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_TILEAUTOTUNER_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_TILEAUTOTUNER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace renderscript {
+
+/**
+ * Learns how long the cells of each op take to process, so that the tiles can be sized from
+ * measurements rather than from the estimates of Task::costPerCell(). See
+ * RenderScriptToolkit::enableTileAutotuning().
+ *
+ * The time per cell is kept per op and size class, as small images are more likely to stay in
+ * the caches. It's normalized by costPerCell(), so that e.g. the blurs of different radii share
+ * their measurements. It's a moving average, so it follows changes like thermal throttling.
+ */
+class TileAutotuner {
+   public:
+    /**
+     * The number of size classes. Each is four times as many cells as the previous one.
+     */
+    static constexpr int kNumberOfSizeClasses = 16;
+
+    /**
+     * Returns the size class of tasks of this many cells.
+     */
+    static int sizeClassOf(size_t cells);
+
+    /**
+     * Returns the measured time in nanoseconds per unit of Task::costPerCell() of the named op,
+     * for a task of this many cells. Returns 0 if there's no measurement yet.
+     */
+    double nsPerCostUnit(const char* name, size_t cells) const;
+
+    /**
+     * Records that the threads were busy for busyNs, in total, to process a task of the named op
+     * of this many cells and of this cost, see Task::getCost().
+     */
+    void record(const char* name, size_t cells, size_t cost, int64_t busyNs);
+
+    void reset();
+
+   private:
+    /**
+     * The weight of a new measurement in the moving average.
+     */
+    static constexpr double kWeightOfNewMeasurement = 0.25;
+
+    mutable std::mutex mMutex;
+    /**
+     * The time per cost unit of each op, per size class. 0 when not measured.
+     */
+    std::map<std::string, std::array<double, kNumberOfSizeClasses>, std::less<>>
+            mNsPerCostUnit /*GUARDED_BY(mMutex)*/;
+};
+
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_TILEAUTOTUNER_H
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TileRanges.h"
+
+namespace renderscript {
+
+TileRanges::TileRanges(int numberOfTiles, unsigned int numberOfThreads)
+    : mRanges(numberOfThreads) {
+    const uint64_t tiles = static_cast<uint64_t>(numberOfTiles);
+    for (unsigned int i = 0; i < numberOfThreads; i++) {
+        mRanges[i].packed.store(pack(static_cast<uint32_t>(tiles * i / numberOfThreads),
+                                     static_cast<uint32_t>(tiles * (i + 1) / numberOfThreads)),
+                                std::memory_order_relaxed);
+    }
+}
+
+bool TileRanges::claim(unsigned int threadIndex, int* tileIndex) {
+    std::atomic<uint64_t>& mine = mRanges[threadIndex].packed;
+    do {
+        uint64_t range = mine.load(std::memory_order_relaxed);
+        while (beginOf(range) < endOf(range)) {
+            // On failure, range is reloaded. Only a thief can have changed it, by lowering the end.
+            if (mine.compare_exchange_weak(range, pack(beginOf(range) + 1, endOf(range)),
+                                           std::memory_order_relaxed)) {
+                *tileIndex = static_cast<int>(beginOf(range));
+                return true;
+            }
+        }
+    } while (steal(threadIndex));
+    return false;
+}
+
+bool TileRanges::steal(unsigned int threadIndex) {
+    while (true) {
+        // Find the victim with the most tiles left.
+        Range* victim = nullptr;
+        uint64_t victimRange = 0;
+        uint32_t mostLeft = 0;
+        for (size_t i = 0; i < mRanges.size(); i++) {
+            const uint64_t range = mRanges[i].packed.load(std::memory_order_relaxed);
+            const uint32_t left = endOf(range) - beginOf(range);
+            if (i != threadIndex && beginOf(range) < endOf(range) && left > mostLeft) {
+                victim = &mRanges[i];
+                victimRange = range;
+                mostLeft = left;
+            }
+        }
+        if (victim == nullptr) {
+            return false;
+        }
+        // Take the back half, rounded up so that we take the last tile of a range.
+        const uint32_t split = endOf(victimRange) - (mostLeft + 1) / 2;
+        if (victim->packed.compare_exchange_strong(victimRange,
+                                                   pack(beginOf(victimRange), split),
+                                                   std::memory_order_relaxed)) {
+            // Our range is empty, so no other thread touches it. It may get stolen from once
+            // it's stored.
+            mRanges[threadIndex].packed.store(pack(split, endOf(victimRange)),
+                                              std::memory_order_relaxed);
+            return true;
+        }
+    }
+}
+
+bool TileRanges::hasTilesLeft() const {
+    for (const Range& range : mRanges) {
+        const uint64_t packed = range.packed.load(std::memory_order_relaxed);
+        if (beginOf(packed) < endOf(packed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace renderscript
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_TILERANGES_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_TILERANGES_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace renderscript {
+
+/**
+ * Distributes the tiles of a task for the WORK_STEALING scheduler.
+ *
+ * The tiles are split into one contiguous range per thread. Each thread processes its own range
+ * from the front, so that adjacent tiles, which are adjacent rows of the image, stay on the same
+ * core. When its range is empty, the thread steals the back half of the largest range left.
+ *
+ * A range is a begin and an end packed into one 64 bit atomic, so that the owner and the
+ * thieves agree on it with a single compare and exchange. Each range is on its own cache line.
+ */
+class TileRanges {
+    struct alignas(64) Range {
+        // The begin in the low 32 bits, the end (excluded) in the high 32 bits.
+        std::atomic<uint64_t> packed{0};
+    };
+    std::vector<Range> mRanges;
+
+    static uint64_t pack(uint32_t begin, uint32_t end) {
+        return static_cast<uint64_t>(end) << 32 | begin;
+    }
+    static uint32_t beginOf(uint64_t packed) { return static_cast<uint32_t>(packed); }
+    static uint32_t endOf(uint64_t packed) { return static_cast<uint32_t>(packed >> 32); }
+
+    /**
+     * Takes the back half of the largest range of the other threads and makes it the range of
+     * threadIndex. Returns false if there's nothing left to steal.
+     */
+    bool steal(unsigned int threadIndex);
+
+   public:
+    /**
+     * Splits tiles 0 to numberOfTiles - 1 evenly between numberOfThreads threads.
+     */
+    TileRanges(int numberOfTiles, unsigned int numberOfThreads);
+
+    /**
+     * Claims the next tile for threadIndex, stealing if its range is empty. Returns false when
+     * all the tiles have been claimed.
+     */
+    bool claim(unsigned int threadIndex, int* tileIndex);
+
+    /**
+     * Returns whether some tiles have not been claimed yet.
+     */
+    bool hasTilesLeft() const;
+};
+
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_TILERANGES_H
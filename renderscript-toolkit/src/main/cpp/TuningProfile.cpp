@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TuningProfile.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "Utils.h"
+
+#define LOG_TAG "renderscript.toolkit.TuningProfile"
+
+namespace renderscript {
+
+/**
+ * The first line of a profile file.
+ */
+static const char* const kHeader = "# RenderScript Toolkit tuning profile";
+
+/**
+ * Returns the number of cells of the smallest tasks of the size class.
+ */
+static size_t firstCellsOfSizeClass(int sizeClass) {
+    return static_cast<size_t>(1) << (2 * sizeClass);
+}
+
+TuningProfile::Setting TuningProfile::find(const char* name, size_t cells) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto op = mSettings.find(name);
+    return op == mSettings.end() ? Setting{} : op->second[TileAutotuner::sizeClassOf(cells)];
+}
+
+void TuningProfile::set(const Tuning& tuning) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSettings[tuning.name][TileAutotuner::sizeClassOf(tuning.pixels)] =
+            Setting{static_cast<unsigned int>(std::max(0, tuning.numberOfThreads)),
+                    tuning.pixelsPerTile};
+}
+
+std::vector<Tuning> TuningProfile::get() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<Tuning> tunings;
+    for (const auto& [name, settings] : mSettings) {
+        for (int i = 0; i < TileAutotuner::kNumberOfSizeClasses; i++) {
+            const Setting& setting = settings[i];
+            if (setting.numberOfThreads != 0 || setting.cellsPerTile != 0) {
+                tunings.push_back(Tuning{name, firstCellsOfSizeClass(i),
+                                         static_cast<int>(setting.numberOfThreads),
+                                         setting.cellsPerTile});
+            }
+        }
+    }
+    return tunings;
+}
+
+void TuningProfile::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSettings.clear();
+}
+
+bool TuningProfile::load(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        ALOGE("Can't open the tuning profile %s.", path);
+        return false;
+    }
+    TuningProfile loaded;
+    char line[256];
+    int lineNumber = 0;
+    bool valid = true;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        lineNumber++;
+        char name[64];
+        uint64_t pixels = 0;
+        int threads = 0;
+        uint64_t pixelsPerTile = 0;
+        char extra = 0;
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        if (sscanf(line, "%63s %" SCNu64 " %d %" SCNu64 " %c", name, &pixels, &threads,
+                   &pixelsPerTile, &extra) != 4 ||
+            threads < 0) {
+            ALOGE("Line %d of the tuning profile %s is invalid.", lineNumber, path);
+            valid = false;
+            break;
+        }
+        loaded.set(Tuning{name, static_cast<size_t>(pixels), threads,
+                          static_cast<size_t>(pixelsPerTile)});
+    }
+    fclose(file);
+    if (!valid) {
+        return false;
+    }
+    std::scoped_lock lock(mMutex, loaded.mMutex);
+    mSettings = std::move(loaded.mSettings);
+    return true;
+}
+
+bool TuningProfile::save(const char* path) const {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        ALOGE("Can't open %s to write the tuning profile.", path);
+        return false;
+    }
+    fprintf(file, "%s\n# name pixels threads pixelsPerTile\n", kHeader);
+    for (const Tuning& tuning : get()) {
+        fprintf(file, "%s %zu %d %zu\n", tuning.name.c_str(), tuning.pixels,
+                tuning.numberOfThreads, tuning.pixelsPerTile);
+    }
+    return fclose(file) == 0;
+}
+
+}  // namespace renderscript
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_TUNINGPROFILE_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_TUNINGPROFILE_H
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "RenderScriptToolkit.h"
+#include "TileAutotuner.h"
+
+namespace renderscript {
+
+using Tuning = RenderScriptToolkit::Tuning;
+
+/**
+ * The number of threads and the tile size to use for each op and size class, as chosen by
+ * toolkit_bench --autotune on this machine. See RenderScriptToolkit::setTuning().
+ *
+ * The size classes are those of the TileAutotuner. The profile file has one line per op and size
+ * class: the name of the op, the number of cells of the smallest tasks of the class, the number of
+ * threads, and the number of cells per tile. Lines starting with # are comments.
+ */
+class TuningProfile {
+   public:
+    /**
+     * The settings for one op and size class. 0 means that the default applies.
+     */
+    struct Setting {
+        unsigned int numberOfThreads = 0;
+        size_t cellsPerTile = 0;
+    };
+
+    /**
+     * Returns the settings for tasks of the named op of this many cells.
+     */
+    Setting find(const char* name, size_t cells) const;
+
+    void set(const Tuning& tuning);
+    std::vector<Tuning> get() const;
+    void clear();
+
+    /**
+     * Replaces the settings by those of the profile file. Returns false, leaving the settings
+     * unchanged, if the file can't be read or is malformed.
+     */
+    bool load(const char* path);
+    bool save(const char* path) const;
+
+   private:
+    mutable std::mutex mMutex;
+    std::map<std::string, std::array<Setting, TileAutotuner::kNumberOfSizeClasses>, std::less<>>
+            mSettings /*GUARDED_BY(mMutex)*/;
+};
+
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_TUNINGPROFILE_H
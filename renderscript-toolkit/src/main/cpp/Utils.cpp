@@ -16,7 +16,13 @@
 
 #include "Utils.h"
 
+#include <chrono>
+
+#if defined(ANDROID)
 #include <cpu-features.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
 
 #include "RenderScriptToolkit.h"
 
@@ -24,6 +30,7 @@ namespace renderscript {
 
 #define LOG_TAG "renderscript.toolkit.Utils"
 
+#if defined(ANDROID)
 bool cpuSupportsSimd() {
     AndroidCpuFamily family = android_getCpuFamily();
     uint64_t features = android_getCpuFeatures();
@@ -43,6 +50,99 @@ bool cpuSupportsSimd() {
     return false;
 }
 
+bool cpuSupportsAvx2() {
+    AndroidCpuFamily family = android_getCpuFamily();
+    uint64_t features = android_getCpuFeatures();
+    return (family == ANDROID_CPU_FAMILY_X86 || family == ANDROID_CPU_FAMILY_X86_64) &&
+           (features & ANDROID_CPU_X86_FEATURE_AVX2);
+}
+
+bool cpuSupportsAvx512() {
+    // The cpufeatures library does not report the AVX-512 extensions.
+    return false;
+}
+#elif defined(__i386__) || defined(__x86_64__)
+bool cpuSupportsSimd() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ecx & bit_SSSE3) != 0;
+}
+
+/**
+ * Returns true if the OS saves all the registers selected by mask on context switches. The bits
+ * of mask are those of the XCR0 register.
+ */
+static bool osSavesRegisters(unsigned int mask) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & bit_OSXSAVE) == 0) {
+        return false;
+    }
+    unsigned int xcr0Low, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    return (xcr0Low & mask) == mask;
+}
+
+bool cpuSupportsAvx2() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    if ((ecx & bit_AVX) == 0) {
+        return false;
+    }
+    // The XMM and YMM registers.
+    if (!osSavesRegisters(0x06)) {
+        return false;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ebx & bit_AVX2) != 0;
+}
+
+bool cpuSupportsAvx512() {
+    if (!cpuSupportsAvx2()) {
+        return false;
+    }
+    // The XMM, YMM, opmask, and ZMM registers.
+    if (!osSavesRegisters(0xe6)) {
+        return false;
+    }
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ebx & bit_AVX512F) && (ebx & bit_AVX512BW) && (ecx & bit_AVX512VNNI);
+}
+#elif defined(__aarch64__)
+bool cpuSupportsSimd() {
+    // ASIMD is mandatory on ARMv8-A.
+    return true;
+}
+
+bool cpuSupportsAvx2() {
+    return false;
+}
+
+bool cpuSupportsAvx512() {
+    return false;
+}
+#else
+bool cpuSupportsSimd() {
+    return false;
+}
+
+bool cpuSupportsAvx2() {
+    return false;
+}
+
+bool cpuSupportsAvx512() {
+    return false;
+}
+#endif
+
 #ifdef ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
 bool validRestriction(const char* tag, size_t sizeX, size_t sizeY, const Restriction* restriction) {
     if (restriction == nullptr) {
@@ -76,4 +176,10 @@ bool validRestriction(const char* tag, size_t sizeX, size_t sizeY, const Restric
 }
 #endif
 
+int64_t nowInNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
 }  // namespace renderscript
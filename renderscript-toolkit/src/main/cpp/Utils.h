@@ -17,8 +17,13 @@
 #ifndef ANDROID_RENDERSCRIPT_TOOLKIT_UTILS_H
 #define ANDROID_RENDERSCRIPT_TOOLKIT_UTILS_H
 
+#ifdef ANDROID
 #include <android/log.h>
+#else
+#include <stdio.h>
+#endif
 #include <stddef.h>
+#include <stdint.h>
 
 namespace renderscript {
 
@@ -38,9 +43,22 @@ namespace renderscript {
  */
 #define ANDROID_RENDERSCRIPT_TOOLKIT_VALIDATE
 
+#ifdef ANDROID
 #define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
 #define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+/* When built as a host library, there's no logcat. We log to stderr in a similar format. */
+#define ALOG_TO_STDERR(level, ...)               \
+    do {                                         \
+        fprintf(stderr, level "/%s: ", LOG_TAG); \
+        fprintf(stderr, __VA_ARGS__);            \
+        fputc('\n', stderr);                     \
+    } while (0)
+#define ALOGI(...) ALOG_TO_STDERR("I", __VA_ARGS__)
+#define ALOGW(...) ALOG_TO_STDERR("W", __VA_ARGS__)
+#define ALOGE(...) ALOG_TO_STDERR("E", __VA_ARGS__)
+#endif
 
 using uchar = unsigned char;
 using uint = unsigned int;
@@ -142,6 +160,23 @@ bool validRestriction(const char* tag, size_t sizeX, size_t sizeY, const Restric
  */
 bool cpuSupportsSimd();
 
+/**
+ * Returns true if the processor and the operating system support the AVX2 instructions used
+ * by the kernels of x86_avx2.cpp. Always false on non-x86 processors.
+ */
+bool cpuSupportsAvx2();
+
+/**
+ * Returns true if the processor and the operating system support the AVX-512 F, BW, and VNNI
+ * instructions used by the kernels of x86_avx512.cpp. Always false on non-x86 processors.
+ */
+bool cpuSupportsAvx512();
+
+/**
+ * Returns the time of a monotonic clock, in nanoseconds. Used to measure durations.
+ */
+int64_t nowInNanoseconds();
+
 inline size_t divideRoundingUp(size_t a, size_t b) {
     return a / b + (a % b == 0 ? 0 : 1);
 }
@@ -44,6 +44,8 @@ class YuvToRgbTask : public Task {
                      size_t endY) override;
 
    public:
+    const char* name() const override { return "yuvToRgb"; }
+
     YuvToRgbTask(const uint8_t* input, uint8_t* output, size_t sizeX, size_t sizeY,
                  RenderScriptToolkit::YuvFormat format)
         : Task{sizeX, sizeY, 4, false, nullptr}, mOut{reinterpret_cast<uchar4*>(output)} {
@@ -112,12 +114,21 @@ static uchar4 rsYuvToRGBA_uchar4(uchar y, uchar u, uchar v) {
                     static_cast<uchar>(p.z), static_cast<uchar>(p.w)};
 }
 
+#if defined(ARCH_ARM_USE_INTRINSICS)
 extern "C" void rsdIntrinsicYuv_K(void *dst, const uchar *Y, const uchar *uv, uint32_t xstart,
                                   size_t xend);
 extern "C" void rsdIntrinsicYuvR_K(void *dst, const uchar *Y, const uchar *uv, uint32_t xstart,
                                    size_t xend);
 extern "C" void rsdIntrinsicYuv2_K(void *dst, const uchar *Y, const uchar *u, const uchar *v,
                                    size_t xstart, size_t xend);
+#endif
+
+/* The coefficients used by the x86 kernels, in the same fixed point format as
+ * rsYuvToRGBA_uchar4(). [0..4] are the multipliers, [8] is the Y bias, [16] the U & V bias.
+ */
+static const short kYuvParamsX86[24] = {298, 409, -100, 516, -208, 0, 0, 0,
+                                        16,  0,   0,    0,   0,    0, 0, 0,
+                                        128, 0,   0,    0,   0,    0, 0, 0};
 
 void YuvToRgbTask::kernel(uchar4 *out, uint32_t xstart, uint32_t xend, uint32_t currentY) {
     //ALOGI("kernel out %p, xstart=%u, xend=%u, currentY=%u", out, xstart, xend, currentY);
@@ -216,6 +227,18 @@ void YuvToRgbTask::kernel(uchar4 *out, uint32_t xstart, uint32_t xend, uint32_t
     }
 #endif
 
+    // The x86 kernel converts groups of 8 pixels. It only handles the interleaved VU layout
+    // of NV21. x1 is even at this point so the chroma of x1 is at v[x1].
+    if ((x2 > x1) && mKernels->yuvToRgb != nullptr && mCstep == 2 &&
+        ((intptr_t)u == (intptr_t)v + 1)) {
+        uint32_t count = (x2 - x1) >> 3;
+        if (count > 0) {
+            mKernels->yuvToRgb(out, y + x1, v + x1, count, kYuvParamsX86);
+            x1 += count << 3;
+            out += count << 3;
+        }
+    }
+
     if(x2 > x1) {
        // ALOGE("y %i  %i  %i", currentY, x1, x2);
         while(x1 < x2) {
@@ -230,10 +253,22 @@ void YuvToRgbTask::kernel(uchar4 *out, uint32_t xstart, uint32_t xend, uint32_t
     }
 }
 
-void RenderScriptToolkit::yuvToRgb(const uint8_t* input, uint8_t* output, size_t sizeX,
-                                   size_t sizeY, YuvFormat format) {
+RenderScriptToolkit::TaskStatus RenderScriptToolkit::yuvToRgb(const uint8_t* input, uint8_t* output,
+                                                              size_t sizeX, size_t sizeY,
+                                                              YuvFormat format,
+                                                              const TaskOptions* options) {
     YuvToRgbTask task(input, output, sizeX, sizeY, format);
-    processor->doTask(&task);
+    return processor->doTask(&task, options);
+}
+
+RenderScriptToolkit::TaskHandle RenderScriptToolkit::yuvToRgbAsync(const uint8_t* input,
+                                                                   uint8_t* output, size_t sizeX,
+                                                                   size_t sizeY, YuvFormat format,
+                                                                   Callback callback,
+                                                                   const TaskOptions* options) {
+    return TaskHandle(processor->startTask(
+            std::make_unique<YuvToRgbTask>(input, output, sizeX, sizeY, format),
+            std::move(callback), options));
 }
 
 }  // namespace renderscript
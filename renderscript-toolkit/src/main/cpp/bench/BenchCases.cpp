@@ -0,0 +1,478 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BenchCases.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+namespace renderscript {
+namespace bench {
+
+namespace {
+
+using BlendingMode = RenderScriptToolkit::BlendingMode;
+using YuvFormat = RenderScriptToolkit::YuvFormat;
+
+/**
+ * We don't resize to images larger than this many pixels, i.e. 8K. Doubling an 8K image would
+ * need a 500 MB output buffer and tell us little that doubling a 4K image doesn't.
+ */
+constexpr size_t kMaxResizeOutputPixels = 7680 * 4320;
+
+/**
+ * Extra bytes at the end of each buffer. Some SIMD kernels read a few bytes past the last
+ * pixel they compute.
+ */
+constexpr size_t kPadding = 64;
+
+struct NamedBlendingMode {
+    const char* name;
+    BlendingMode mode;
+};
+
+const NamedBlendingMode kBlendingModes[] = {
+        {"CLEAR", BlendingMode::CLEAR},
+        {"SRC", BlendingMode::SRC},
+        {"DST", BlendingMode::DST},
+        {"SRC_OVER", BlendingMode::SRC_OVER},
+        {"DST_OVER", BlendingMode::DST_OVER},
+        {"SRC_IN", BlendingMode::SRC_IN},
+        {"DST_IN", BlendingMode::DST_IN},
+        {"SRC_OUT", BlendingMode::SRC_OUT},
+        {"DST_OUT", BlendingMode::DST_OUT},
+        {"SRC_ATOP", BlendingMode::SRC_ATOP},
+        {"DST_ATOP", BlendingMode::DST_ATOP},
+        {"XOR", BlendingMode::XOR},
+        {"MULTIPLY", BlendingMode::MULTIPLY},
+        {"ADD", BlendingMode::ADD},
+        {"SUBTRACT", BlendingMode::SUBTRACT},
+        {"HUE", BlendingMode::HUE},
+        {"SATURATION", BlendingMode::SATURATION},
+        {"COLOR", BlendingMode::COLOR},
+        {"LUMINOSITY", BlendingMode::LUMINOSITY},
+};
+
+struct NamedMatrix {
+    const char* name;
+    const float* matrix;
+};
+
+/**
+ * The color matrix shapes: the input and output vector sizes, and the matrix. The greyscale
+ * matrix takes the dot product path of the SIMD code; the others take the general one.
+ */
+struct ColorMatrixShape {
+    size_t inputVectorSize;
+    size_t outputVectorSize;
+    NamedMatrix matrix;
+};
+
+const ColorMatrixShape kColorMatrixShapes[] = {
+        {4, 4, {"greyscale", RenderScriptToolkit::kGreyScaleColorMatrix}},
+        {4, 4, {"rgb_to_yuv", RenderScriptToolkit::kRgbToYuvMatrix}},
+        {3, 3, {"rgb_to_yuv", RenderScriptToolkit::kRgbToYuvMatrix}},
+        {2, 2, {"rgb_to_yuv", RenderScriptToolkit::kRgbToYuvMatrix}},
+        {1, 1, {"rgb_to_yuv", RenderScriptToolkit::kRgbToYuvMatrix}},
+        {4, 1, {"rgb_to_yuv", RenderScriptToolkit::kRgbToYuvMatrix}},
+        {1, 4, {"rgb_to_yuv", RenderScriptToolkit::kRgbToYuvMatrix}},
+        {4, 3, {"rgb_to_yuv", RenderScriptToolkit::kRgbToYuvMatrix}},
+        {3, 4, {"rgb_to_yuv", RenderScriptToolkit::kRgbToYuvMatrix}},
+};
+
+const size_t kLut3dCubeSizes[] = {2, 16, 33, 64};
+
+struct ResizeRatio {
+    const char* name;
+    size_t numerator;
+    size_t denominator;
+};
+
+const ResizeRatio kResizeRatios[] = {{"0.5", 1, 2}, {"0.75", 3, 4}, {"1.5", 3, 2}, {"2", 2, 1}};
+
+/**
+ * The number of images halved by one resizeBatch case, e.g. to make thumbnails.
+ */
+constexpr size_t kResizeBatchSize = 16;
+
+/**
+ * Coefficients that add to 1.0, like those of a typical sharpening or smoothing filter.
+ */
+const float kConvolve3x3Coefficients[9] = {-0.125f, -0.125f, -0.125f, -0.125f, 2.0f,
+                                           -0.125f, -0.125f, -0.125f, -0.125f};
+const float kConvolve5x5Coefficients[25] = {
+        0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f,
+        0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f, 0.04f};
+
+/**
+ * The number of bytes of a cell of vectorSize bytes. Cells of three bytes are padded to four.
+ */
+size_t paddedSize(size_t vectorSize) { return vectorSize == 3 ? 4 : vectorSize; }
+
+size_t roundUpTo16(size_t value) { return (value + 15) & ~static_cast<size_t>(15); }
+
+/**
+ * The size of the buffer of a YUV image. See the YuvToRgbTask constructor for the layout.
+ */
+size_t yuvBufferSize(ImageSize size, YuvFormat format) {
+    if (format == YuvFormat::NV21) {
+        return size.pixels() + 2 * (size.width / 2) * ((size.height + 1) / 2);
+    }
+    size_t strideY = roundUpTo16(size.width);
+    size_t strideU = roundUpTo16(strideY / 2);
+    return strideY * size.height + 2 * strideU * ((size.height + 1) / 2);
+}
+
+BenchParam numberParam(const char* name, size_t value) {
+    return BenchParam{name, std::to_string(value), true};
+}
+
+BenchParam stringParam(const char* name, const std::string& value) {
+    return BenchParam{name, value, false};
+}
+
+/**
+ * Fills the buffer with a deterministic, not too regular pattern, so that no op hits a
+ * degenerate fast path. The alpha of RGBA pixels is never zero.
+ */
+void fillPattern(std::vector<uint8_t>* buffer, uint32_t seed) {
+    uint32_t state = seed;
+    for (auto& value : *buffer) {
+        state = state * 1664525u + 1013904223u;
+        value = static_cast<uint8_t>(state >> 24);
+    }
+}
+
+/**
+ * Collects the cases of one image size, and keeps track of the output buffer they need.
+ */
+class CaseBuilder {
+   public:
+    explicit CaseBuilder(BenchImages* images) : mImages{images}, mSize{images->size()} {}
+
+    std::vector<BenchCase>& cases() { return mCases; }
+    size_t outputBytes() const { return mOutputBytes; }
+
+    void add(const std::string& op, std::vector<BenchParam> params, size_t pixels, size_t bytes,
+             size_t outputBytes, std::function<void(RenderScriptToolkit*)> run) {
+        mCases.push_back(BenchCase{op, std::move(params), mSize, pixels, bytes, std::move(run)});
+        mOutputBytes = std::max(mOutputBytes, outputBytes);
+    }
+
+    void addBlend();
+    void addBlur();
+    void addColorMatrix();
+    void addConvolve();
+    void addHistogram();
+    void addLut();
+    void addLut3d();
+    void addResize();
+    void addResizeBatch();
+    void addYuvToRgb();
+
+   private:
+    BenchImages* mImages;
+    ImageSize mSize;
+    std::vector<BenchCase> mCases;
+    size_t mOutputBytes = 0;
+};
+
+void CaseBuilder::addBlend() {
+    const size_t pixels = mSize.pixels();
+    for (const auto& m : kBlendingModes) {
+        BenchImages* images = mImages;
+        const ImageSize size = mSize;
+        const BlendingMode mode = m.mode;
+        // Blend reads both buffers and writes the destination.
+        add("blend", {stringParam("mode", m.name)}, pixels, pixels * 4 * 3, 0,
+            [images, size, mode](RenderScriptToolkit* toolkit) {
+                toolkit->blend(mode, images->input(), images->blendDestination(), size.width,
+                               size.height);
+            });
+    }
+}
+
+void CaseBuilder::addBlur() {
+    const size_t pixels = mSize.pixels();
+    for (size_t vectorSize : {1, 4}) {
+        for (int radius = 1; radius <= 25; radius++) {
+            BenchImages* images = mImages;
+            const ImageSize size = mSize;
+            add("blur", {numberParam("vectorSize", vectorSize), numberParam("radius", radius)},
+                pixels, pixels * vectorSize * 2, pixels * vectorSize,
+                [images, size, vectorSize, radius](RenderScriptToolkit* toolkit) {
+                    toolkit->blur(images->input(), images->output(), size.width, size.height,
+                                  vectorSize, radius);
+                });
+        }
+    }
+}
+
+void CaseBuilder::addColorMatrix() {
+    const size_t pixels = mSize.pixels();
+    for (const auto& shape : kColorMatrixShapes) {
+        BenchImages* images = mImages;
+        const ImageSize size = mSize;
+        const size_t in = shape.inputVectorSize;
+        const size_t out = shape.outputVectorSize;
+        const float* matrix = shape.matrix.matrix;
+        add("colorMatrix",
+            {numberParam("inputVectorSize", in), numberParam("outputVectorSize", out),
+             stringParam("matrix", shape.matrix.name)},
+            pixels, pixels * (paddedSize(in) + paddedSize(out)), pixels * paddedSize(out),
+            [images, size, in, out, matrix](RenderScriptToolkit* toolkit) {
+                toolkit->colorMatrix(images->input(), images->output(), in, out, size.width,
+                                     size.height, matrix);
+            });
+    }
+}
+
+void CaseBuilder::addConvolve() {
+    const size_t pixels = mSize.pixels();
+    for (size_t vectorSize = 1; vectorSize <= 4; vectorSize++) {
+        BenchImages* images = mImages;
+        const ImageSize size = mSize;
+        const size_t cell = paddedSize(vectorSize);
+        add("convolve3x3", {numberParam("vectorSize", vectorSize)}, pixels, pixels * cell * 2,
+            pixels * cell, [images, size, vectorSize](RenderScriptToolkit* toolkit) {
+                toolkit->convolve3x3(images->input(), images->output(), vectorSize, size.width,
+                                     size.height, kConvolve3x3Coefficients);
+            });
+    }
+    for (size_t vectorSize = 1; vectorSize <= 4; vectorSize++) {
+        BenchImages* images = mImages;
+        const ImageSize size = mSize;
+        const size_t cell = paddedSize(vectorSize);
+        add("convolve5x5", {numberParam("vectorSize", vectorSize)}, pixels, pixels * cell * 2,
+            pixels * cell, [images, size, vectorSize](RenderScriptToolkit* toolkit) {
+                toolkit->convolve5x5(images->input(), images->output(), vectorSize, size.width,
+                                     size.height, kConvolve5x5Coefficients);
+            });
+    }
+}
+
+void CaseBuilder::addHistogram() {
+    const size_t pixels = mSize.pixels();
+    // The histograms are written to output(), which is much larger than 256 * 4 int32_t.
+    for (size_t vectorSize = 1; vectorSize <= 4; vectorSize++) {
+        BenchImages* images = mImages;
+        const ImageSize size = mSize;
+        add("histogram", {numberParam("vectorSize", vectorSize)}, pixels,
+            pixels * paddedSize(vectorSize), 256 * 4 * sizeof(int32_t),
+            [images, size, vectorSize](RenderScriptToolkit* toolkit) {
+                toolkit->histogram(images->input(), reinterpret_cast<int32_t*>(images->output()),
+                                   size.width, size.height, vectorSize);
+            });
+    }
+    for (size_t vectorSize = 1; vectorSize <= 4; vectorSize++) {
+        BenchImages* images = mImages;
+        const ImageSize size = mSize;
+        add("histogramDot", {numberParam("vectorSize", vectorSize)}, pixels,
+            pixels * paddedSize(vectorSize), 256 * sizeof(int32_t),
+            [images, size, vectorSize](RenderScriptToolkit* toolkit) {
+                toolkit->histogramDot(images->input(),
+                                      reinterpret_cast<int32_t*>(images->output()), size.width,
+                                      size.height, vectorSize, nullptr);
+            });
+    }
+}
+
+void CaseBuilder::addLut() {
+    const size_t pixels = mSize.pixels();
+    // Inverts the red and blue channels, leaves the others as they are. Like the cubes of
+    // lut3d, the table is owned by the lambda so that it lives as long as the case.
+    auto table = std::make_shared<std::vector<uint8_t>>(256 * 4);
+    for (size_t i = 0; i < 256; i++) {
+        (*table)[i] = static_cast<uint8_t>(255 - i);
+        (*table)[256 + i] = static_cast<uint8_t>(i);
+        (*table)[512 + i] = static_cast<uint8_t>(255 - i);
+        (*table)[768 + i] = static_cast<uint8_t>(i);
+    }
+    BenchImages* images = mImages;
+    const ImageSize size = mSize;
+    add("lut", {}, pixels, pixels * 4 * 2, pixels * 4,
+        [images, size, table](RenderScriptToolkit* toolkit) {
+            const uint8_t* t = table->data();
+            toolkit->lut(images->input(), images->output(), size.width, size.height, t, t + 256,
+                         t + 512, t + 768);
+        });
+}
+
+void CaseBuilder::addLut3d() {
+    const size_t pixels = mSize.pixels();
+    for (size_t cubeSize : kLut3dCubeSizes) {
+        auto cube = std::make_shared<std::vector<uint8_t>>(cubeSize * cubeSize * cubeSize * 4);
+        fillPattern(cube.get(), static_cast<uint32_t>(cubeSize));
+        BenchImages* images = mImages;
+        const ImageSize size = mSize;
+        add("lut3d", {numberParam("cubeSize", cubeSize)}, pixels, pixels * 4 * 2, pixels * 4,
+            [images, size, cube, cubeSize](RenderScriptToolkit* toolkit) {
+                toolkit->lut3d(images->input(), images->output(), size.width, size.height,
+                               cube->data(), cubeSize, cubeSize, cubeSize);
+            });
+    }
+}
+
+void CaseBuilder::addResize() {
+    for (const auto& ratio : kResizeRatios) {
+        const size_t outX = std::max<size_t>(1, mSize.width * ratio.numerator / ratio.denominator);
+        const size_t outY = std::max<size_t>(1, mSize.height * ratio.numerator / ratio.denominator);
+        if (outX * outY > kMaxResizeOutputPixels) {
+            continue;
+        }
+        for (size_t vectorSize = 1; vectorSize <= 4; vectorSize++) {
+            BenchImages* images = mImages;
+            const ImageSize size = mSize;
+            const size_t cell = paddedSize(vectorSize);
+            add("resize",
+                {stringParam("ratio", ratio.name), numberParam("vectorSize", vectorSize),
+                 numberParam("outputSizeX", outX), numberParam("outputSizeY", outY)},
+                outX * outY, (size.pixels() + outX * outY) * cell, outX * outY * cell,
+                [images, size, vectorSize, outX, outY](RenderScriptToolkit* toolkit) {
+                    toolkit->resize(images->input(), images->output(), size.width, size.height,
+                                    vectorSize, outX, outY);
+                });
+        }
+    }
+}
+
+void CaseBuilder::addResizeBatch() {
+    // Each job halves the input into its own part of the output. The same jobs are also done
+    // with one resize() call each, to compare.
+    const size_t outX = std::max<size_t>(1, mSize.width / 2);
+    const size_t outY = std::max<size_t>(1, mSize.height / 2);
+    const size_t pixels = kResizeBatchSize * outX * outY;
+    auto jobs = std::make_shared<std::vector<RenderScriptToolkit::ResizeJob>>();
+    for (size_t i = 0; i < kResizeBatchSize; i++) {
+        jobs->push_back({mImages->input(), nullptr, mSize.width, mSize.height, outX, outY});
+    }
+    // The output buffer is only reserved once all the cases are known, so we find the job
+    // outputs when the case runs.
+    BenchImages* images = mImages;
+    auto setOutputs = [images, jobs, outX, outY]() {
+        for (size_t i = 0; i < jobs->size(); i++) {
+            (*jobs)[i].out = images->output() + i * outX * outY * 4;
+        }
+    };
+    const size_t bytes = kResizeBatchSize * (mSize.pixels() + outX * outY) * 4;
+    for (bool batched : {true, false}) {
+        add("resizeBatch",
+            {stringParam("submission", batched ? "batch" : "loop"),
+             numberParam("batchSize", kResizeBatchSize), numberParam("outputSizeX", outX),
+             numberParam("outputSizeY", outY)},
+            pixels, bytes, pixels * 4, [jobs, setOutputs, batched](RenderScriptToolkit* toolkit) {
+                setOutputs();
+                if (batched) {
+                    toolkit->resizeBatch(jobs->data(), jobs->size(), 4);
+                    return;
+                }
+                for (const auto& job : *jobs) {
+                    toolkit->resize(job.in, job.out, job.inputSizeX, job.inputSizeY, 4,
+                                    job.outputSizeX, job.outputSizeY);
+                }
+            });
+    }
+}
+
+void CaseBuilder::addYuvToRgb() {
+    // The YUV formats subsample the chroma by two horizontally.
+    if (mSize.width % 2 != 0) {
+        return;
+    }
+    const size_t pixels = mSize.pixels();
+    const std::pair<const char*, YuvFormat> formats[] = {{"NV21", YuvFormat::NV21},
+                                                         {"YV12", YuvFormat::YV12}};
+    for (const auto& f : formats) {
+        BenchImages* images = mImages;
+        const ImageSize size = mSize;
+        const YuvFormat format = f.second;
+        add("yuvToRgb", {stringParam("format", f.first)}, pixels,
+            yuvBufferSize(size, format) + pixels * 4, pixels * 4,
+            [images, size, format](RenderScriptToolkit* toolkit) {
+                toolkit->yuvToRgb(images->yuv(), images->output(), size.width, size.height, format);
+            });
+    }
+}
+
+}  // namespace
+
+BenchImages::BenchImages(ImageSize size)
+    : mSize{size},
+      mInput(size.pixels() * 4 + kPadding),
+      mBlendDestination(size.pixels() * 4 + kPadding),
+      mYuv(std::max(yuvBufferSize(size, YuvFormat::NV21), yuvBufferSize(size, YuvFormat::YV12)) +
+           kPadding) {
+    fillPattern(&mInput, 1);
+    fillPattern(&mBlendDestination, 2);
+    fillPattern(&mYuv, 3);
+}
+
+void BenchImages::reserveOutput(size_t bytes) {
+    if (mOutput.size() < bytes + kPadding) {
+        // Written once so that the pages are mapped before we start measuring.
+        mOutput.assign(bytes + kPadding, 0);
+    }
+}
+
+void BenchImages::resetOutputs() {
+    fillPattern(&mBlendDestination, 2);
+    std::fill(mOutput.begin(), mOutput.end(), 0);
+}
+
+std::vector<uint8_t> BenchImages::outputs() const {
+    std::vector<uint8_t> outputs(mOutput);
+    outputs.insert(outputs.end(), mBlendDestination.begin(), mBlendDestination.end());
+    return outputs;
+}
+
+const std::vector<std::string>& allBenchOps() {
+    static const std::vector<std::string> ops = {
+            "blend",       "blur",         "colorMatrix", "convolve3x3", "convolve5x5",
+            "histogram",   "histogramDot", "lut",         "lut3d",       "resize",
+            "resizeBatch", "yuvToRgb"};
+    return ops;
+}
+
+std::vector<BenchCase> makeBenchCases(BenchImages* images, const std::vector<std::string>& ops) {
+    CaseBuilder builder(images);
+    auto wanted = [&ops](const char* op) {
+        return std::find(ops.begin(), ops.end(), op) != ops.end();
+    };
+    if (wanted("blend")) builder.addBlend();
+    if (wanted("blur")) builder.addBlur();
+    if (wanted("colorMatrix")) builder.addColorMatrix();
+    if (wanted("convolve3x3") || wanted("convolve5x5")) builder.addConvolve();
+    if (wanted("histogram") || wanted("histogramDot")) builder.addHistogram();
+    if (wanted("lut")) builder.addLut();
+    if (wanted("lut3d")) builder.addLut3d();
+    if (wanted("resize")) builder.addResize();
+    if (wanted("resizeBatch")) builder.addResizeBatch();
+    if (wanted("yuvToRgb")) builder.addYuvToRgb();
+
+    // addConvolve() and addHistogram() add the cases of two ops each.
+    std::vector<BenchCase> cases;
+    for (auto& c : builder.cases()) {
+        if (wanted(c.op.c_str())) {
+            cases.push_back(std::move(c));
+        }
+    }
+    images->reserveOutput(builder.outputBytes());
+    return cases;
+}
+
+}  // namespace bench
+}  // namespace renderscript
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_BENCH_BENCHCASES_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_BENCH_BENCHCASES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "RenderScriptToolkit.h"
+
+namespace renderscript {
+namespace bench {
+
+/**
+ * The dimensions of the images used by a set of cases.
+ */
+struct ImageSize {
+    size_t width;
+    size_t height;
+
+    size_t pixels() const { return width * height; }
+    std::string name() const { return std::to_string(width) + "x" + std::to_string(height); }
+};
+
+/**
+ * A parameter of a case, other than the image size, as reported in the results.
+ */
+struct BenchParam {
+    std::string name;
+    std::string value;
+    // Whether the value is written as a JSON number rather than as a string.
+    bool isNumber;
+};
+
+/**
+ * A single Toolkit call to be timed.
+ */
+struct BenchCase {
+    /** The name of the Toolkit method, e.g. "blur". */
+    std::string op;
+    std::vector<BenchParam> params;
+    /** The size of the input image. */
+    ImageSize size;
+    /**
+     * The number of pixels produced by one call, used to compute the MPix/s. For the histograms,
+     * which don't produce an image, that's the number of pixels read.
+     */
+    size_t pixels;
+    /** The number of bytes of image data read and written by one call, used to compute the GB/s. */
+    size_t bytes;
+    /** Makes the call. The buffers are owned by the BenchImages the case was created with. */
+    std::function<void(RenderScriptToolkit*)> run;
+};
+
+/**
+ * The buffers used by the cases of one image size. They're allocated once and shared by all the
+ * cases, so that we don't measure the page faults of fresh allocations.
+ */
+class BenchImages {
+   public:
+    explicit BenchImages(ImageSize size);
+
+    ImageSize size() const { return mSize; }
+
+    /** An RGBA image, also used as the input of the smaller vector sizes. */
+    const uint8_t* input() const { return mInput.data(); }
+    /** A second RGBA image, modified in place by blend. */
+    uint8_t* blendDestination() { return mBlendDestination.data(); }
+    /** The output of all the ops that produce an image. */
+    uint8_t* output() { return mOutput.data(); }
+    /** The YUV input of yuvToRgb, large enough for both formats. */
+    const uint8_t* yuv() const { return mYuv.data(); }
+
+    /** Makes sure that output() has room for at least this many bytes. */
+    void reserveOutput(size_t bytes);
+
+    /**
+     * Restores blendDestination() and output() to their initial content, so that a case run
+     * several times, e.g. by --verify, starts from the same state each time.
+     */
+    void resetOutputs();
+    /** Returns the content of the buffers a case may write: output(), then blendDestination(). */
+    std::vector<uint8_t> outputs() const;
+
+   private:
+    ImageSize mSize;
+    std::vector<uint8_t> mInput;
+    std::vector<uint8_t> mBlendDestination;
+    std::vector<uint8_t> mOutput;
+    std::vector<uint8_t> mYuv;
+};
+
+/**
+ * Returns the names of all the ops that can be benchmarked, in the order they're run.
+ */
+const std::vector<std::string>& allBenchOps();
+
+/**
+ * Returns the cases of the requested ops for the size of images. This also reserves the
+ * output buffer needed by those cases.
+ */
+std::vector<BenchCase> makeBenchCases(BenchImages* images, const std::vector<std::string>& ops);
+
+}  // namespace bench
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_BENCH_BENCHCASES_H
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RENDERSCRIPT_TOOLKIT_BENCH_JSONWRITER_H
+#define ANDROID_RENDERSCRIPT_TOOLKIT_BENCH_JSONWRITER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace renderscript {
+namespace bench {
+
+/**
+ * Writes an indented JSON document to a FILE, one value at a time.
+ *
+ * The caller is responsible for the structure: inside an object, each value must be preceded
+ * by a call to key(). The writer only takes care of the separators, the indentation and the
+ * escaping of strings.
+ */
+class JsonWriter {
+    FILE* mFile;
+    // How deep we are in nested objects and arrays.
+    int mDepth = 0;
+    // Whether the next value is the first one of its object or array.
+    bool mFirst = true;
+    // Whether the next value follows a key, so needs neither a separator nor an indentation.
+    bool mAfterKey = false;
+
+    void startValue() {
+        if (mAfterKey) {
+            mAfterKey = false;
+            return;
+        }
+        if (mDepth > 0) {
+            fputs(mFirst ? "\n" : ",\n", mFile);
+            indent();
+        }
+        mFirst = false;
+    }
+
+    void indent() {
+        for (int i = 0; i < mDepth; i++) {
+            fputs("  ", mFile);
+        }
+    }
+
+    void open(char bracket) {
+        startValue();
+        fputc(bracket, mFile);
+        mDepth++;
+        mFirst = true;
+    }
+
+    void close(char bracket) {
+        mDepth--;
+        if (!mFirst) {
+            fputc('\n', mFile);
+            indent();
+        }
+        fputc(bracket, mFile);
+        mFirst = false;
+        if (mDepth == 0) {
+            fputc('\n', mFile);
+        }
+    }
+
+    void writeString(const std::string& s) {
+        fputc('"', mFile);
+        for (char c : s) {
+            switch (c) {
+                case '"': fputs("\\\"", mFile); break;
+                case '\\': fputs("\\\\", mFile); break;
+                case '\n': fputs("\\n", mFile); break;
+                case '\t': fputs("\\t", mFile); break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        fprintf(mFile, "\\u%04x", c);
+                    } else {
+                        fputc(c, mFile);
+                    }
+            }
+        }
+        fputc('"', mFile);
+    }
+
+   public:
+    explicit JsonWriter(FILE* file) : mFile{file} {}
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    void key(const std::string& name) {
+        startValue();
+        writeString(name);
+        fputs(": ", mFile);
+        mAfterKey = true;
+    }
+
+    void value(const std::string& s) {
+        startValue();
+        writeString(s);
+    }
+    void value(const char* s) { value(std::string(s)); }
+    void value(bool b) {
+        startValue();
+        fputs(b ? "true" : "false", mFile);
+    }
+    void value(int64_t i) {
+        startValue();
+        fprintf(mFile, "%lld", static_cast<long long>(i));
+    }
+    void value(int i) { value(static_cast<int64_t>(i)); }
+    void value(size_t i) { value(static_cast<int64_t>(i)); }
+    /** JSON has no representation for NaN or infinities. We write them as null. */
+    void value(double d) {
+        startValue();
+        if (std::isfinite(d)) {
+            fprintf(mFile, "%.6g", d);
+        } else {
+            fputs("null", mFile);
+        }
+    }
+
+    template <typename T>
+    void member(const std::string& name, const T& v) {
+        key(name);
+        value(v);
+    }
+};
+
+}  // namespace bench
+}  // namespace renderscript
+
+#endif  // ANDROID_RENDERSCRIPT_TOOLKIT_BENCH_JSONWRITER_H
@@ -0,0 +1,1580 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * toolkit_bench: measures the throughput and the latency of the RenderScriptToolkit methods.
+ *
+ * For each image size and each case, i.e. an op with a set of parameters, the call is repeated
+ * until both a minimum time and a minimum number of iterations are reached. The results are
+ * written as JSON, one entry per case, with the MPix/s and GB/s computed from the median
+ * latency, and the latency percentiles in microseconds.
+ *
+ * With --thread-sweep, each case is instead measured with 1 to N threads, to find out how far
+ * each op scales on this machine. With --wait-policy-sweep, it's measured with each wait policy
+ * of the pool threads, to compare how long the calls take to get the pool going. With --autotune,
+ * the fastest number of threads and tile size of each op and size class are written to a tuning
+ * profile that the Toolkit can load. With --cpus and --placement, the pool threads are pinned, to
+ * compare the placements. With --verify, nothing is timed: each case is run with every SIMD tier
+ * and several threads and schedulers, and the asynchronous, batched, stopped, and prioritized
+ * calls are run too, to check that they all compute the same results. The blur and convolve
+ * cases are also run on an image wide enough for its rows to be split into several tiles, with a
+ * tuning profile and with tile autotuning.
+ *
+ * Run with --help for the options.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BenchCases.h"
+#include "JsonWriter.h"
+#include "RenderScriptToolkit.h"
+
+namespace renderscript {
+namespace bench {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Scheduler = RenderScriptToolkit::Scheduler;
+using SimdTier = RenderScriptToolkit::SimdTier;
+using WaitPolicy = RenderScriptToolkit::WaitPolicy;
+using ThreadPlacement = RenderScriptToolkit::ThreadPlacement;
+
+const ImageSize kDefaultSizes[] = {{64, 64},     {256, 256},   {1280, 720},
+                                   {1920, 1080}, {3840, 2160}, {7680, 4320}};
+
+/**
+ * The sizes used by --verify when --sizes is not given. They're small, as each case is run many
+ * times. The odd width leaves pixels at the end of the rows for the narrower kernels.
+ */
+const ImageSize kDefaultVerifySizes[] = {{61, 37}, {322, 181}, {640, 360}};
+
+struct NamedSimdTier {
+    const char* name;
+    SimdTier tier;
+};
+
+// Same names as the RENDERSCRIPT_TOOLKIT_SIMD_TIER environment variable.
+const NamedSimdTier kSimdTiers[] = {
+        {"scalar", SimdTier::SCALAR}, {"ssse3", SimdTier::SSSE3}, {"avx2", SimdTier::AVX2},
+        {"avx512", SimdTier::AVX512}, {"neon", SimdTier::NEON},   {"asimd", SimdTier::ASIMD},
+};
+
+const char* simdTierName(SimdTier tier) {
+    for (const auto& t : kSimdTiers) {
+        if (t.tier == tier) {
+            return t.name;
+        }
+    }
+    return "unknown";
+}
+
+struct NamedScheduler {
+    const char* name;
+    Scheduler scheduler;
+};
+
+const NamedScheduler kSchedulers[] = {
+        {"shared", Scheduler::SHARED_COUNTER},
+        {"stealing", Scheduler::WORK_STEALING},
+        {"numa", Scheduler::NUMA_NODES},
+};
+
+const char* schedulerName(Scheduler scheduler) {
+    for (const auto& s : kSchedulers) {
+        if (s.scheduler == scheduler) {
+            return s.name;
+        }
+    }
+    return "unknown";
+}
+
+struct NamedWaitPolicy {
+    const char* name;
+    WaitPolicy policy;
+};
+
+const NamedWaitPolicy kWaitPolicies[] = {
+        {"park", WaitPolicy::PARK},
+        {"spin", WaitPolicy::SPIN},
+        {"yield", WaitPolicy::YIELD},
+};
+
+const char* waitPolicyName(WaitPolicy policy) {
+    for (const auto& p : kWaitPolicies) {
+        if (p.policy == policy) {
+            return p.name;
+        }
+    }
+    return "unknown";
+}
+
+struct NamedPlacement {
+    const char* name;
+    ThreadPlacement placement;
+};
+
+const NamedPlacement kPlacements[] = {
+        {"compact", ThreadPlacement::COMPACT},
+        {"scatter", ThreadPlacement::SCATTER},
+};
+
+const char* placementName(ThreadPlacement placement) {
+    for (const auto& p : kPlacements) {
+        if (p.placement == placement) {
+            return p.name;
+        }
+    }
+    return "unknown";
+}
+
+struct Options {
+    std::vector<std::string> ops = allBenchOps();
+    std::vector<ImageSize> sizes{std::begin(kDefaultSizes), std::end(kDefaultSizes)};
+    /** The number of threads of the Toolkit. 0 lets the Toolkit pick. */
+    int threads = 0;
+    /** When not 0, measures each case with 1 to threadSweep threads rather than with threads. */
+    int threadSweep = 0;
+    /** Whether simdTier is set. If not, the Toolkit uses its default tier. */
+    bool hasSimdTier = false;
+    SimdTier simdTier = SimdTier::SCALAR;
+    Scheduler scheduler = Scheduler::SHARED_COUNTER;
+    WaitPolicy waitPolicy = WaitPolicy::PARK;
+    int spinMicroseconds = RenderScriptToolkit::kDefaultSpinMicroseconds;
+    /** Whether to measure each case with each wait policy rather than with waitPolicy. */
+    bool waitPolicySweep = false;
+    /** The CPUs to pin the pool threads to, as given on the command line. Empty if not pinned. */
+    std::string cpuList;
+    std::vector<int> cpus;
+    ThreadPlacement placement = ThreadPlacement::COMPACT;
+    /** Whether the Toolkit sizes the tiles from its measurements. */
+    bool tileAutotuning = false;
+    /** When not empty, where to write the tuning profile measured for each op and size. */
+    std::string autotunePath;
+    double minTimeMs = 200;
+    size_t minIterations = 5;
+    size_t maxIterations = 10000;
+    /** Whether to capture the hardware performance counters. */
+    bool counters = false;
+    std::string outputPath;
+    /** When not empty, where to write a Chrome trace of the tiles processed. */
+    std::string tracePath;
+    /** Whether to check the results of the cases rather than time them. */
+    bool verify = false;
+};
+
+void printUsage(FILE* file) {
+    fprintf(file,
+            "Usage: toolkit_bench [options]\n"
+            "  --ops=OP,...        The ops to run. Default: all of blend, blur, colorMatrix,\n"
+            "                      convolve3x3, convolve5x5, histogram, histogramDot, lut,\n"
+            "                      lut3d, resize, resizeBatch, yuvToRgb\n"
+            "  --sizes=WxH,...     The image sizes. Default: 64x64,256x256,1280x720,\n"
+            "                      1920x1080,3840x2160,7680x4320\n"
+            "  --threads=N         The number of threads of the Toolkit. Default: 0, i.e.\n"
+            "                      the Toolkit's default\n"
+            "  --thread-sweep[=N]  Measure each case with 1 to N threads and report the\n"
+            "                      speedup, the parallel efficiency, and the knee of the\n"
+            "                      curve. Default N: the number of processors the\n"
+            "                      process can use\n"
+            "  --simd=TIER         One of scalar, ssse3, avx2, avx512, neon, asimd.\n"
+            "                      Default: the Toolkit's default\n"
+            "  --scheduler=NAME    How the tiles are distributed: shared, a single counter,\n"
+            "                      stealing, per-thread ranges with work stealing, or numa,\n"
+            "                      a band of rows per NUMA node. Default: shared\n"
+            "  --wait-policy=NAME  What the pool threads do when out of work: park, spin,\n"
+            "                      or yield. Default: park\n"
+            "  --spin-us=US        How long the threads poll for work before parking with\n"
+            "                      the spin and yield policies. Default: 100\n"
+            "  --wait-policy-sweep Measure each case with each wait policy and report the\n"
+            "                      dispatch latency, i.e. the time from a call posting its\n"
+            "                      work to the pool threads picking it up\n"
+            "  --cpus=LIST         Pin the pool threads to these CPUs, e.g. 0-3,8. The\n"
+            "                      calling thread is not pinned. Default: not pinned\n"
+            "  --placement=NAME    How the pool threads are placed on the CPUs: compact, on\n"
+            "                      neighboring cores, or scatter, spread over the packages\n"
+            "                      and clusters. Default: compact\n"
+            "  --tile-autotuning   Let the Toolkit size the tiles from the measured time per\n"
+            "                      pixel of each op, rather than from estimates\n"
+            "  --autotune=FILE     Find the fastest number of threads and tile size of each\n"
+            "                      op and size, and write them to FILE as a tuning profile,\n"
+            "                      see RenderScriptToolkit::loadTuningProfile()\n"
+            "  --min-time-ms=MS    Minimum time spent on each case. Default: 200\n"
+            "  --min-iterations=N  Minimum number of calls of each case. Default: 5\n"
+            "  --max-iterations=N  Maximum number of calls of each case. Default: 10000\n"
+            "  --counters          Also report the hardware performance counters per\n"
+            "                      pixel, when the platform allows it\n"
+            "  --trace=FILE        Write a Chrome trace of the tasks and tiles to FILE. Not\n"
+            "                      available with --thread-sweep\n"
+            "  --verify            Check that every SIMD tier, number of threads, scheduler,\n"
+            "                      and kind of call computes the same results, rather than\n"
+            "                      timing the cases. Exits with 1 if any differ. Default\n"
+            "                      sizes: 61x37,322x181,640x360\n"
+            "  --output=FILE       Where to write the JSON results. Default: stdout\n");
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        if (end > start) {
+            items.push_back(list.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return items;
+}
+
+bool parseSize(const std::string& text, ImageSize* size) {
+    unsigned long width = 0;
+    unsigned long height = 0;
+    char extra = 0;
+    if (sscanf(text.c_str(), "%lux%lu%c", &width, &height, &extra) != 2 || width == 0 ||
+        height == 0) {
+        return false;
+    }
+    *size = ImageSize{width, height};
+    return true;
+}
+
+/**
+ * Parses a list of CPUs like 0-3,8 into cpus.
+ */
+bool parseCpuList(const std::string& list, std::vector<int>* cpus) {
+    cpus->clear();
+    for (const auto& item : splitList(list)) {
+        unsigned int first = 0;
+        unsigned int last = 0;
+        char extra = 0;
+        const int fields = sscanf(item.c_str(), "%u-%u%c", &first, &last, &extra);
+        if (fields == 1) {
+            last = first;
+        } else if (fields != 2 || last < first) {
+            return false;
+        }
+        for (unsigned int cpu = first; cpu <= last; cpu++) {
+            cpus->push_back(static_cast<int>(cpu));
+        }
+    }
+    return !cpus->empty();
+}
+
+bool parseCount(const char* text, size_t* count) {
+    char* end = nullptr;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text || *end != '\0') {
+        return false;
+    }
+    *count = static_cast<size_t>(value);
+    return true;
+}
+
+/**
+ * Parses the command line into options. Returns false, after printing why, if it's invalid.
+ */
+bool parseOptions(int argc, char** argv, Options* options) {
+    bool hasSizes = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const size_t equal = arg.find('=');
+        const std::string name = arg.substr(0, equal);
+        const std::string value = equal == std::string::npos ? "" : arg.substr(equal + 1);
+        size_t count = 0;
+        if (name == "--help" || name == "-h") {
+            printUsage(stdout);
+            exit(0);
+        } else if (name == "--ops") {
+            options->ops = splitList(value);
+            for (const auto& op : options->ops) {
+                const auto& all = allBenchOps();
+                if (std::find(all.begin(), all.end(), op) == all.end()) {
+                    fprintf(stderr, "Unknown op %s\n", op.c_str());
+                    return false;
+                }
+            }
+        } else if (name == "--sizes") {
+            hasSizes = true;
+            options->sizes.clear();
+            for (const auto& item : splitList(value)) {
+                ImageSize size;
+                if (!parseSize(item, &size)) {
+                    fprintf(stderr, "Invalid size %s, expected WIDTHxHEIGHT\n", item.c_str());
+                    return false;
+                }
+                options->sizes.push_back(size);
+            }
+        } else if (name == "--threads" && parseCount(value.c_str(), &count)) {
+            options->threads = static_cast<int>(count);
+        } else if (name == "--thread-sweep" && value.empty()) {
+            options->threadSweep = RenderScriptToolkit::defaultNumberOfThreads(0);
+        } else if (name == "--thread-sweep" && parseCount(value.c_str(), &count) && count > 0) {
+            options->threadSweep = static_cast<int>(count);
+        } else if (name == "--simd") {
+            auto t = std::find_if(std::begin(kSimdTiers), std::end(kSimdTiers),
+                                  [&value](const NamedSimdTier& t) { return value == t.name; });
+            if (t == std::end(kSimdTiers)) {
+                fprintf(stderr, "Unknown SIMD tier %s\n", value.c_str());
+                return false;
+            }
+            options->hasSimdTier = true;
+            options->simdTier = t->tier;
+        } else if (name == "--scheduler") {
+            auto s = std::find_if(std::begin(kSchedulers), std::end(kSchedulers),
+                                  [&value](const NamedScheduler& s) { return value == s.name; });
+            if (s == std::end(kSchedulers)) {
+                fprintf(stderr, "Unknown scheduler %s\n", value.c_str());
+                return false;
+            }
+            options->scheduler = s->scheduler;
+        } else if (name == "--wait-policy") {
+            auto p = std::find_if(std::begin(kWaitPolicies), std::end(kWaitPolicies),
+                                  [&value](const NamedWaitPolicy& p) { return value == p.name; });
+            if (p == std::end(kWaitPolicies)) {
+                fprintf(stderr, "Unknown wait policy %s\n", value.c_str());
+                return false;
+            }
+            options->waitPolicy = p->policy;
+        } else if (name == "--spin-us" && parseCount(value.c_str(), &count)) {
+            options->spinMicroseconds = static_cast<int>(count);
+        } else if (name == "--wait-policy-sweep" && value.empty()) {
+            options->waitPolicySweep = true;
+        } else if (name == "--cpus") {
+            if (!parseCpuList(value, &options->cpus)) {
+                fprintf(stderr, "Invalid CPU list %s, expected e.g. 0-3,8\n", value.c_str());
+                return false;
+            }
+            options->cpuList = value;
+        } else if (name == "--placement") {
+            auto p = std::find_if(std::begin(kPlacements), std::end(kPlacements),
+                                  [&value](const NamedPlacement& p) { return value == p.name; });
+            if (p == std::end(kPlacements)) {
+                fprintf(stderr, "Unknown placement %s\n", value.c_str());
+                return false;
+            }
+            options->placement = p->placement;
+        } else if (name == "--tile-autotuning" && value.empty()) {
+            options->tileAutotuning = true;
+        } else if (name == "--autotune" && !value.empty()) {
+            options->autotunePath = value;
+        } else if (name == "--min-time-ms" && parseCount(value.c_str(), &count)) {
+            options->minTimeMs = static_cast<double>(count);
+        } else if (name == "--min-iterations" && parseCount(value.c_str(), &count)) {
+            options->minIterations = std::max<size_t>(1, count);
+        } else if (name == "--max-iterations" && parseCount(value.c_str(), &count)) {
+            options->maxIterations = std::max<size_t>(1, count);
+        } else if (name == "--counters" && value.empty()) {
+            options->counters = true;
+        } else if (name == "--trace" && !value.empty()) {
+            options->tracePath = value;
+        } else if (name == "--output" && !value.empty()) {
+            options->outputPath = value;
+        } else if (name == "--verify" && value.empty()) {
+            options->verify = true;
+        } else {
+            fprintf(stderr, "Invalid argument %s\n", arg.c_str());
+            printUsage(stderr);
+            return false;
+        }
+    }
+    if (options->threadSweep > 0 && !options->tracePath.empty()) {
+        fprintf(stderr, "--trace can't be used with --thread-sweep\n");
+        return false;
+    }
+    if (options->waitPolicySweep && (options->threadSweep > 0 || !options->tracePath.empty())) {
+        fprintf(stderr, "--wait-policy-sweep can't be used with --thread-sweep or --trace\n");
+        return false;
+    }
+    if (!options->autotunePath.empty() &&
+        (options->threadSweep > 0 || options->waitPolicySweep || !options->tracePath.empty())) {
+        fprintf(stderr, "--autotune can't be used with --thread-sweep, --wait-policy-sweep, or "
+                        "--trace\n");
+        return false;
+    }
+    if (options->verify && (options->threadSweep > 0 || options->waitPolicySweep ||
+                            !options->autotunePath.empty() || !options->tracePath.empty())) {
+        fprintf(stderr, "--verify can't be used with --thread-sweep, --wait-policy-sweep, "
+                        "--autotune, or --trace\n");
+        return false;
+    }
+    if (options->verify && !hasSizes) {
+        options->sizes.assign(std::begin(kDefaultVerifySizes), std::end(kDefaultVerifySizes));
+    }
+    if (options->ops.empty() || options->sizes.empty()) {
+        fprintf(stderr, "No ops or no sizes to run\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The latencies of the calls of one case, in microseconds, and their summary.
+ */
+struct LatencyStats {
+    size_t iterations = 0;
+    double minUs = 0;
+    double meanUs = 0;
+    double p50Us = 0;
+    double p90Us = 0;
+    double p99Us = 0;
+    double maxUs = 0;
+};
+
+/**
+ * Returns the value below which the fraction p of the sorted values are, interpolating
+ * between the two closest ranks.
+ */
+double percentile(const std::vector<double>& sorted, double p) {
+    const double rank = p * static_cast<double>(sorted.size() - 1);
+    const size_t lower = static_cast<size_t>(rank);
+    const size_t upper = std::min(lower + 1, sorted.size() - 1);
+    const double fraction = rank - static_cast<double>(lower);
+    return sorted[lower] + (sorted[upper] - sorted[lower]) * fraction;
+}
+
+LatencyStats summarize(std::vector<double> latencies) {
+    LatencyStats stats;
+    std::sort(latencies.begin(), latencies.end());
+    stats.iterations = latencies.size();
+    stats.minUs = latencies.front();
+    stats.maxUs = latencies.back();
+    double sum = 0;
+    for (double l : latencies) {
+        sum += l;
+    }
+    stats.meanUs = sum / static_cast<double>(latencies.size());
+    stats.p50Us = percentile(latencies, 0.50);
+    stats.p90Us = percentile(latencies, 0.90);
+    stats.p99Us = percentile(latencies, 0.99);
+    return stats;
+}
+
+/**
+ * The result of measuring a case.
+ */
+struct Measurement {
+    LatencyStats latency;
+    /** Whether counters is set, i.e. whether the hardware counters were enabled. */
+    bool hasCounters = false;
+    /** The counts over all the iterations. */
+    RenderScriptToolkit::HardwareCounters counters;
+    /**
+     * The number of times a pool thread picked up the work of a call, and the mean and maximum
+     * time it took to do so after the work was posted. See RenderScriptToolkit::WorkerStats.
+     */
+    uint64_t wakeUps = 0;
+    double meanWakeLatencyUs = 0;
+    double maxWakeLatencyUs = 0;
+};
+
+/**
+ * Calls the case repeatedly and returns the statistics of the latencies, and the hardware counts
+ * if they're enabled on the toolkit. The first call is a warm up and isn't counted.
+ */
+Measurement measure(const BenchCase& benchCase, RenderScriptToolkit* toolkit,
+                    const Options& options) {
+    benchCase.run(toolkit);
+    if (options.counters) {
+        toolkit->resetHardwareCounters();
+    }
+    toolkit->resetStats();
+
+    std::vector<double> latencies;
+    const auto start = Clock::now();
+    const auto minTime = std::chrono::duration<double, std::milli>(options.minTimeMs);
+    while (latencies.size() < options.maxIterations) {
+        const auto before = Clock::now();
+        benchCase.run(toolkit);
+        const auto after = Clock::now();
+        latencies.push_back(std::chrono::duration<double, std::micro>(after - before).count());
+        if (latencies.size() >= options.minIterations && after - start >= minTime) {
+            break;
+        }
+    }
+    Measurement measurement;
+    measurement.latency = summarize(std::move(latencies));
+    if (options.counters) {
+        measurement.hasCounters = true;
+        measurement.counters = toolkit->getHardwareCounters();
+    }
+    double totalWakeLatencyUs = 0;
+    for (const auto& worker : toolkit->getWorkerStats()) {
+        measurement.wakeUps += worker.wakeUps;
+        totalWakeLatencyUs += worker.totalWakeLatencyUs;
+        measurement.maxWakeLatencyUs = std::max(measurement.maxWakeLatencyUs,
+                                                worker.maxWakeLatencyUs);
+    }
+    if (measurement.wakeUps > 0) {
+        measurement.meanWakeLatencyUs = totalWakeLatencyUs / measurement.wakeUps;
+    }
+    return measurement;
+}
+
+/**
+ * The fraction of the best speedup at which we place the knee of a thread sweep. Past the knee,
+ * adding threads buys at most the remaining 10%.
+ */
+constexpr double kKneeFractionOfBestSpeedup = 0.9;
+
+std::unique_ptr<RenderScriptToolkit> makeToolkit(const Options& options, int threads) {
+    auto toolkit = options.hasSimdTier
+                           ? std::make_unique<RenderScriptToolkit>(threads, options.simdTier)
+                           : std::make_unique<RenderScriptToolkit>(threads);
+    toolkit->setScheduler(options.scheduler);
+    toolkit->setWaitPolicy(options.waitPolicy, options.spinMicroseconds);
+    toolkit->enableTileAutotuning(options.tileAutotuning);
+    if (!options.cpus.empty() && !toolkit->setCpuAffinity(options.cpus, options.placement)) {
+        fprintf(stderr, "Can't pin the pool threads to the CPUs %s.\n", options.cpuList.c_str());
+    }
+    if (options.counters && !toolkit->enableHardwareCounters(true)) {
+        fprintf(stderr, "The hardware counters are not available. They'll be reported as null.\n");
+    }
+    return toolkit;
+}
+
+/**
+ * Writes the CPUs the pool threads are pinned to, if any, and the placement.
+ */
+void writeAffinity(JsonWriter* json, const Options& options) {
+    if (options.cpus.empty()) {
+        return;
+    }
+    json->member("cpus", options.cpuList);
+    json->member("placement", placementName(options.placement));
+}
+
+/**
+ * Writes the members that identify the case: the op, the image size, and the parameters.
+ */
+void writeCase(JsonWriter* json, const BenchCase& benchCase) {
+    json->member("op", benchCase.op);
+    json->member("width", benchCase.size.width);
+    json->member("height", benchCase.size.height);
+    json->key("params");
+    json->beginObject();
+    for (const auto& param : benchCase.params) {
+        json->key(param.name);
+        if (param.isNumber) {
+            json->value(static_cast<int64_t>(std::stoll(param.value)));
+        } else {
+            json->value(param.value);
+        }
+    }
+    json->endObject();
+}
+
+/**
+ * Writes the hardware counts per pixel, and the instructions per cycle. The counters that are
+ * not available are written as null.
+ */
+void writeCounters(JsonWriter* json, const BenchCase& benchCase, const Measurement& measurement) {
+    using HardwareCounter = RenderScriptToolkit::HardwareCounter;
+    const RenderScriptToolkit::HardwareCounters& counters = measurement.counters;
+    const double pixels = static_cast<double>(benchCase.pixels) *
+                          static_cast<double>(measurement.latency.iterations);
+    auto perPixel = [&counters, pixels](HardwareCounter counter) {
+        return counters.has(counter) && counters.tiles > 0
+                       ? static_cast<double>(counters.get(counter)) / pixels
+                       : NAN;
+    };
+    const double cycles = perPixel(HardwareCounter::CYCLES);
+    const double instructions = perPixel(HardwareCounter::INSTRUCTIONS);
+    json->key("counters");
+    json->beginObject();
+    json->member("cycles_per_pixel", cycles);
+    json->member("instructions_per_pixel", instructions);
+    json->member("ipc", instructions / cycles);
+    json->member("l1d_read_misses_per_pixel", perPixel(HardwareCounter::L1D_READ_MISSES));
+    json->member("llc_misses_per_pixel", perPixel(HardwareCounter::LLC_MISSES));
+    json->member("branch_misses_per_pixel", perPixel(HardwareCounter::BRANCH_MISSES));
+    json->member("tiles", counters.tiles);
+    json->endObject();
+}
+
+/**
+ * Writes the members that describe one measurement of the case: the throughput, the latencies,
+ * and the hardware counters if they were captured.
+ */
+void writeMeasurement(JsonWriter* json, const BenchCase& benchCase,
+                      const Measurement& measurement) {
+    const LatencyStats& stats = measurement.latency;
+    json->member("iterations", stats.iterations);
+    // pixels / us is the same as Mpixels / s, and bytes / us / 1000 as GB / s.
+    json->member("mpix_per_s", static_cast<double>(benchCase.pixels) / stats.p50Us);
+    json->member("gb_per_s", static_cast<double>(benchCase.bytes) / stats.p50Us / 1000.0);
+    json->key("latency_us");
+    json->beginObject();
+    json->member("min", stats.minUs);
+    json->member("p50", stats.p50Us);
+    json->member("p90", stats.p90Us);
+    json->member("p99", stats.p99Us);
+    json->member("max", stats.maxUs);
+    json->member("mean", stats.meanUs);
+    json->endObject();
+    if (measurement.hasCounters) {
+        writeCounters(json, benchCase, measurement);
+    }
+}
+
+/**
+ * Writes the measurements of a case at each thread count of the sweep, with the speedup and the
+ * parallel efficiency relative to a single thread, and the knee of the speedup curve.
+ *
+ * The knee is the smallest thread count whose speedup is at least kKneeFractionOfBestSpeedup of
+ * the best speedup of the sweep. It's a reasonable size for the pool when running that op.
+ */
+void writeScaling(JsonWriter* json, const BenchCase& benchCase, const std::vector<int>& threads,
+                  const std::vector<Measurement>& stats) {
+    const double baseUs = stats[0].latency.p50Us;
+    std::vector<double> speedups;
+    size_t best = 0;
+    for (size_t i = 0; i < stats.size(); i++) {
+        speedups.push_back(baseUs / stats[i].latency.p50Us);
+        if (speedups[i] > speedups[best]) {
+            best = i;
+        }
+    }
+    size_t knee = 0;
+    while (speedups[knee] < speedups[best] * kKneeFractionOfBestSpeedup) {
+        knee++;
+    }
+
+    json->beginObject();
+    writeCase(json, benchCase);
+    json->key("scaling");
+    json->beginArray();
+    for (size_t i = 0; i < stats.size(); i++) {
+        json->beginObject();
+        json->member("threads", threads[i]);
+        writeMeasurement(json, benchCase, stats[i]);
+        json->member("speedup", speedups[i]);
+        json->member("efficiency", speedups[i] / threads[i]);
+        json->endObject();
+    }
+    json->endArray();
+    json->member("best_threads", threads[best]);
+    json->member("best_speedup", speedups[best]);
+    json->member("knee_threads", threads[knee]);
+    json->member("knee_speedup", speedups[knee]);
+    json->member("knee_efficiency", speedups[knee] / threads[knee]);
+    json->endObject();
+}
+
+/**
+ * Measures each case once with a Toolkit of options.threads threads.
+ */
+void runThroughput(const Options& options, JsonWriter* json, FILE* output) {
+    std::unique_ptr<RenderScriptToolkit> toolkit = makeToolkit(options, options.threads);
+    json->member("mode", "throughput");
+    json->member("threads", options.threads);
+    if (!options.tracePath.empty()) {
+        toolkit->startTracing();
+    }
+    json->member("simd_tier", simdTierName(toolkit->getSimdTier()));
+    json->member("scheduler", schedulerName(options.scheduler));
+    json->member("wait_policy", waitPolicyName(options.waitPolicy));
+    json->member("spin_us", options.spinMicroseconds);
+    writeAffinity(json, options);
+    json->member("tile_autotuning", options.tileAutotuning);
+    json->member("min_time_ms", options.minTimeMs);
+    json->member("counters", options.counters);
+    json->key("results");
+    json->beginArray();
+    for (const ImageSize& size : options.sizes) {
+        BenchImages images(size);
+        const std::vector<BenchCase> cases = makeBenchCases(&images, options.ops);
+        fprintf(stderr, "%s: %zu cases\n", size.name().c_str(), cases.size());
+        for (const BenchCase& benchCase : cases) {
+            json->beginObject();
+            writeCase(json, benchCase);
+            writeMeasurement(json, benchCase, measure(benchCase, toolkit.get(), options));
+            json->endObject();
+        }
+        fflush(output);
+    }
+    json->endArray();
+    if (!options.tracePath.empty() && !toolkit->writeTrace(options.tracePath.c_str())) {
+        fprintf(stderr, "Can't write the trace to %s\n", options.tracePath.c_str());
+    }
+}
+
+/**
+ * Measures each case with 1 to options.threadSweep threads, resizing the pool of one Toolkit, so
+ * that no idle pool thread gets in the way.
+ */
+void runThreadSweep(const Options& options, JsonWriter* json, FILE* output) {
+    std::vector<int> threads;
+    for (int t = 1; t <= options.threadSweep; t++) {
+        threads.push_back(t);
+    }
+    json->member("mode", "thread_sweep");
+    json->key("thread_counts");
+    json->beginArray();
+    for (int t : threads) {
+        json->value(t);
+    }
+    json->endArray();
+    std::unique_ptr<RenderScriptToolkit> toolkit = makeToolkit(options, 1);
+    json->member("simd_tier", simdTierName(toolkit->getSimdTier()));
+    json->member("scheduler", schedulerName(options.scheduler));
+    json->member("wait_policy", waitPolicyName(options.waitPolicy));
+    json->member("spin_us", options.spinMicroseconds);
+    writeAffinity(json, options);
+    json->member("tile_autotuning", options.tileAutotuning);
+    json->member("min_time_ms", options.minTimeMs);
+    json->member("counters", options.counters);
+    json->member("knee_fraction_of_best_speedup", kKneeFractionOfBestSpeedup);
+    json->key("results");
+    json->beginArray();
+    for (const ImageSize& size : options.sizes) {
+        BenchImages images(size);
+        const std::vector<BenchCase> cases = makeBenchCases(&images, options.ops);
+        // stats[c][t] is the measurement of case c with threads[t] threads.
+        std::vector<std::vector<Measurement>> stats(cases.size());
+        for (int t : threads) {
+            fprintf(stderr, "%s: %zu cases with %d threads\n", size.name().c_str(), cases.size(),
+                    t);
+            toolkit->setNumberOfThreads(t);
+            for (size_t c = 0; c < cases.size(); c++) {
+                stats[c].push_back(measure(cases[c], toolkit.get(), options));
+            }
+        }
+        for (size_t c = 0; c < cases.size(); c++) {
+            writeScaling(json, cases[c], threads, stats[c]);
+        }
+        fflush(output);
+    }
+    json->endArray();
+}
+
+/**
+ * Measures each case with a Toolkit of options.threads threads for each wait policy. Besides the
+ * latency of the calls, which are made back to back, reports the dispatch latency of each policy.
+ */
+void runWaitPolicySweep(const Options& options, JsonWriter* json, FILE* output) {
+    json->member("mode", "wait_policy_sweep");
+    json->member("threads", options.threads);
+    json->member("simd_tier", simdTierName(makeToolkit(options, 1)->getSimdTier()));
+    json->member("scheduler", schedulerName(options.scheduler));
+    json->member("spin_us", options.spinMicroseconds);
+    writeAffinity(json, options);
+    json->member("tile_autotuning", options.tileAutotuning);
+    json->member("min_time_ms", options.minTimeMs);
+    json->member("counters", options.counters);
+    json->key("results");
+    json->beginArray();
+    for (const ImageSize& size : options.sizes) {
+        BenchImages images(size);
+        const std::vector<BenchCase> cases = makeBenchCases(&images, options.ops);
+        // stats[c][p] is the measurement of case c with the wait policy kWaitPolicies[p].
+        std::vector<std::vector<Measurement>> stats(cases.size());
+        for (const auto& policy : kWaitPolicies) {
+            fprintf(stderr, "%s: %zu cases with the %s policy\n", size.name().c_str(),
+                    cases.size(), policy.name);
+            std::unique_ptr<RenderScriptToolkit> toolkit = makeToolkit(options, options.threads);
+            toolkit->setWaitPolicy(policy.policy, options.spinMicroseconds);
+            for (size_t c = 0; c < cases.size(); c++) {
+                stats[c].push_back(measure(cases[c], toolkit.get(), options));
+            }
+        }
+        for (size_t c = 0; c < cases.size(); c++) {
+            json->beginObject();
+            writeCase(json, cases[c]);
+            json->key("policies");
+            json->beginArray();
+            for (size_t p = 0; p < stats[c].size(); p++) {
+                json->beginObject();
+                json->member("wait_policy", kWaitPolicies[p].name);
+                writeMeasurement(json, cases[c], stats[c][p]);
+                json->key("dispatch");
+                json->beginObject();
+                json->member("wake_ups", stats[c][p].wakeUps);
+                json->member("mean_latency_us", stats[c][p].meanWakeLatencyUs);
+                json->member("max_latency_us", stats[c][p].maxWakeLatencyUs);
+                json->endObject();
+                json->endObject();
+            }
+            json->endArray();
+            json->endObject();
+        }
+        fflush(output);
+    }
+    json->endArray();
+}
+
+/**
+ * The tile sizes, in pixels, tried by --autotune. 0 is the Toolkit's own sizing.
+ */
+const size_t kAutotuneTileSizes[] = {0, 4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024};
+
+/**
+ * How much slower than the fastest the settings chosen by --autotune may be, when they use fewer
+ * threads. Threads that barely help are better left to the rest of the application.
+ */
+constexpr double kAutotuneTolerance = 1.05;
+
+/**
+ * Returns the first number of pixels of the size class of calls of this many pixels, i.e. the
+ * number rounded down to a power of four. See RenderScriptToolkit::Tuning.
+ */
+size_t sizeClassStart(size_t pixels) {
+    size_t start = 1;
+    while (start <= pixels / 4) {
+        start *= 4;
+    }
+    return start;
+}
+
+/**
+ * Returns the sum of the median latencies of the cases.
+ */
+double measureCases(const std::vector<const BenchCase*>& cases, RenderScriptToolkit* toolkit,
+                    const Options& options) {
+    double totalUs = 0;
+    for (const BenchCase* benchCase : cases) {
+        totalUs += measure(*benchCase, toolkit, options).latency.p50Us;
+    }
+    return totalUs;
+}
+
+/**
+ * For each op and size class, measures its cases with 1, 2, 4, etc. threads up to the threads of
+ * the Toolkit, then with each of kAutotuneTileSizes with the best number of threads, and writes
+ * the fastest settings to options.autotunePath. Returns false if the profile can't be written.
+ */
+bool runAutotune(const Options& options, JsonWriter* json, FILE* output) {
+    std::unique_ptr<RenderScriptToolkit> toolkit = makeToolkit(options, options.threads);
+    // We start from scratch, not from the profile the environment may name.
+    toolkit->clearTuning();
+    std::vector<int> threads;
+    for (int t = 1; t < toolkit->getNumberOfThreads(); t *= 2) {
+        threads.push_back(t);
+    }
+    threads.push_back(toolkit->getNumberOfThreads());
+    json->member("mode", "autotune");
+    json->member("threads", toolkit->getNumberOfThreads());
+    json->member("simd_tier", simdTierName(toolkit->getSimdTier()));
+    json->member("scheduler", schedulerName(options.scheduler));
+    json->member("wait_policy", waitPolicyName(options.waitPolicy));
+    json->member("spin_us", options.spinMicroseconds);
+    writeAffinity(json, options);
+    json->member("min_time_ms", options.minTimeMs);
+    json->member("tolerance", kAutotuneTolerance);
+    json->member("profile", options.autotunePath);
+    json->key("results");
+    json->beginArray();
+    for (const ImageSize& size : options.sizes) {
+        BenchImages images(size);
+        const std::vector<BenchCase> cases = makeBenchCases(&images, options.ops);
+        // The cases of each op and size class, in the order they come.
+        std::vector<std::pair<RenderScriptToolkit::Tuning, std::vector<const BenchCase*>>> groups;
+        for (const BenchCase& benchCase : cases) {
+            // The calls of a batch are tuned as the calls of its method.
+            if (benchCase.op == "resizeBatch") {
+                continue;
+            }
+            const size_t start = sizeClassStart(benchCase.pixels);
+            auto group = std::find_if(groups.begin(), groups.end(), [&](const auto& g) {
+                return g.first.name == benchCase.op && g.first.pixels == start;
+            });
+            if (group == groups.end()) {
+                RenderScriptToolkit::Tuning tuning;
+                tuning.name = benchCase.op;
+                tuning.pixels = start;
+                group = groups.insert(groups.end(), {tuning, {}});
+            }
+            group->second.push_back(&benchCase);
+        }
+        fprintf(stderr, "%s: %zu ops and size classes\n", size.name().c_str(), groups.size());
+        for (auto& [tuning, group] : groups) {
+            std::vector<double> threadUs;
+            size_t best = 0;
+            for (size_t i = 0; i < threads.size(); i++) {
+                tuning.numberOfThreads = threads[i];
+                tuning.pixelsPerTile = 0;
+                toolkit->setTuning(tuning);
+                threadUs.push_back(measureCases(group, toolkit.get(), options));
+                if (threadUs[i] < threadUs[best]) {
+                    best = i;
+                }
+            }
+            size_t chosen = 0;
+            while (threadUs[chosen] > threadUs[best] * kAutotuneTolerance) {
+                chosen++;
+            }
+            tuning.numberOfThreads = threads[chosen];
+
+            // The Toolkit's own sizing was measured above.
+            std::vector<double> tileUs{threadUs[chosen]};
+            size_t bestTile = 0;
+            for (size_t i = 1; i < std::size(kAutotuneTileSizes); i++) {
+                tuning.pixelsPerTile = kAutotuneTileSizes[i];
+                toolkit->setTuning(tuning);
+                tileUs.push_back(measureCases(group, toolkit.get(), options));
+                if (tileUs[i] < tileUs[bestTile]) {
+                    bestTile = i;
+                }
+            }
+            tuning.pixelsPerTile = kAutotuneTileSizes[bestTile];
+            toolkit->setTuning(tuning);
+
+            json->beginObject();
+            json->member("op", tuning.name);
+            json->member("pixels", tuning.pixels);
+            json->member("cases", group.size());
+            json->key("threads");
+            json->beginArray();
+            for (size_t i = 0; i < threads.size(); i++) {
+                json->beginObject();
+                json->member("threads", threads[i]);
+                json->member("total_p50_us", threadUs[i]);
+                json->endObject();
+            }
+            json->endArray();
+            json->key("tiles");
+            json->beginArray();
+            for (size_t i = 0; i < tileUs.size(); i++) {
+                json->beginObject();
+                json->member("pixels_per_tile", kAutotuneTileSizes[i]);
+                json->member("total_p50_us", tileUs[i]);
+                json->endObject();
+            }
+            json->endArray();
+            json->member("chosen_threads", tuning.numberOfThreads);
+            json->member("chosen_pixels_per_tile", tuning.pixelsPerTile);
+            json->endObject();
+        }
+        fflush(output);
+    }
+    json->endArray();
+    if (!toolkit->saveTuningProfile(options.autotunePath.c_str())) {
+        fprintf(stderr, "Can't write the tuning profile to %s\n", options.autotunePath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The ops whose SIMD kernels round differently from the generic code, with the most they may
+ * differ from it with the parameters of BenchCases.cpp. The convolve kernels use 16 bit fixed
+ * point coefficients, and the blur ones add up the taps in another order. The SIMD tiers must
+ * still agree exactly with each other.
+ */
+struct RoundingTolerance {
+    const char* op;
+    int maxDifference;
+};
+
+const RoundingTolerance kScalarTolerances[] = {
+        {"blur", 1},
+        {"convolve3x3", 2},
+        {"convolve5x5", 8},
+};
+
+int scalarTolerance(const std::string& op) {
+    for (const auto& t : kScalarTolerances) {
+        if (op == t.op) {
+            return t.maxDifference;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Extra bytes at the end of the buffers of --verify, as some SIMD kernels read past the last
+ * pixel they compute.
+ */
+constexpr size_t kVerifyPadding = 64;
+
+const char* statusName(RenderScriptToolkit::TaskStatus status) {
+    switch (status) {
+        case RenderScriptToolkit::TaskStatus::COMPLETE:
+            return "COMPLETE";
+        case RenderScriptToolkit::TaskStatus::CANCELLED:
+            return "CANCELLED";
+        case RenderScriptToolkit::TaskStatus::DEADLINE_EXCEEDED:
+            return "DEADLINE_EXCEEDED";
+        case RenderScriptToolkit::TaskStatus::INVALID_ARGUMENTS:
+            return "INVALID_ARGUMENTS";
+    }
+    return "unknown";
+}
+
+/**
+ * Returns an empty string if the call returned the expected status, or else what it returned.
+ */
+std::string compareStatus(RenderScriptToolkit::TaskStatus actual,
+                          RenderScriptToolkit::TaskStatus expected) {
+    if (actual == expected) {
+        return "";
+    }
+    return std::string("returned ") + statusName(actual) + " rather than " + statusName(expected);
+}
+
+/**
+ * Returns an empty string if no byte of the outputs differs by more than tolerance, or else how
+ * they differ.
+ */
+std::string compareOutputs(const std::vector<uint8_t>& actual, const std::vector<uint8_t>& expected,
+                           int tolerance) {
+    if (actual.size() != expected.size()) {
+        return "the outputs differ in size";
+    }
+    size_t differing = 0;
+    size_t first = 0;
+    int largest = 0;
+    for (size_t i = 0; i < actual.size(); i++) {
+        const int difference =
+                std::abs(static_cast<int>(actual[i]) - static_cast<int>(expected[i]));
+        if (difference > tolerance) {
+            if (differing == 0) {
+                first = i;
+            }
+            differing++;
+        }
+        largest = std::max(largest, difference);
+    }
+    if (differing == 0) {
+        return "";
+    }
+    return std::to_string(differing) + " bytes differ by more than " + std::to_string(tolerance) +
+           ", the first at offset " + std::to_string(first) + ", by up to " +
+           std::to_string(largest);
+}
+
+/**
+ * Returns the op, the size, and the parameters of the case, e.g. "blur 61x37 radius=3".
+ */
+std::string describe(const BenchCase& benchCase) {
+    std::string description = benchCase.op + " " + benchCase.size.name();
+    for (const auto& param : benchCase.params) {
+        description += " " + param.name + "=" + param.value;
+    }
+    return description;
+}
+
+/**
+ * Counts the checks made by --verify, by kind, and writes those that fail to the "failures"
+ * array, which must be open.
+ */
+class VerifyResults {
+   public:
+    explicit VerifyResults(JsonWriter* json) : mJson{json} {}
+
+    /**
+     * Records a check of the kind. An empty failure means it passed. Otherwise, what was checked
+     * and how it failed are written out.
+     */
+    void record(const std::string& kind, const std::string& what, const std::string& failure) {
+        auto k = std::find_if(mKinds.begin(), mKinds.end(),
+                              [&kind](const Kind& k) { return k.name == kind; });
+        if (k == mKinds.end()) {
+            k = mKinds.insert(mKinds.end(), Kind{kind});
+        }
+        k->checked++;
+        if (failure.empty()) {
+            return;
+        }
+        k->failed++;
+        fprintf(stderr, "%s check failed for %s: %s\n", kind.c_str(), what.c_str(),
+                failure.c_str());
+        mJson->beginObject();
+        mJson->member("check", kind);
+        mJson->member("case", what);
+        mJson->member("failure", failure);
+        mJson->endObject();
+    }
+
+    /** Writes the number of checks of each kind, and how many failed. */
+    void writeSummary() const {
+        mJson->beginArray();
+        for (const Kind& k : mKinds) {
+            mJson->beginObject();
+            mJson->member("check", k.name);
+            mJson->member("checked", k.checked);
+            mJson->member("failed", k.failed);
+            mJson->endObject();
+        }
+        mJson->endArray();
+    }
+
+    bool allPassed() const {
+        return std::all_of(mKinds.begin(), mKinds.end(),
+                           [](const Kind& k) { return k.failed == 0; });
+    }
+
+   private:
+    struct Kind {
+        std::string name;
+        size_t checked = 0;
+        size_t failed = 0;
+    };
+    JsonWriter* mJson;
+    std::vector<Kind> mKinds;
+};
+
+/**
+ * Runs the case from the initial content of the images, and returns what it wrote.
+ */
+std::vector<uint8_t> runForOutputs(const BenchCase& benchCase, BenchImages* images,
+                                   RenderScriptToolkit* toolkit) {
+    images->resetOutputs();
+    benchCase.run(toolkit);
+    return images->outputs();
+}
+
+bool isX86Tier(SimdTier tier) {
+    return tier == SimdTier::SSSE3 || tier == SimdTier::AVX2 || tier == SimdTier::AVX512;
+}
+
+/**
+ * Returns the tiers --verify compares: scalar, then the SIMD tiers up to the default one, lowest
+ * first. Only the x86 tiers build on each other.
+ */
+std::vector<SimdTier> tiersToVerify(SimdTier best) {
+    std::vector<SimdTier> tiers{SimdTier::SCALAR};
+    for (const auto& t : kSimdTiers) {
+        if (t.tier != SimdTier::SCALAR &&
+            (t.tier == best || (isX86Tier(t.tier) && isX86Tier(best) && t.tier < best))) {
+            tiers.push_back(t.tier);
+        }
+    }
+    return tiers;
+}
+
+/**
+ * Runs each case with each of the tiers, on one thread. The SIMD tiers must agree exactly with
+ * the lowest one, and all of them with the scalar tier, but for the rounding allowed by
+ * kScalarTolerances.
+ */
+void verifySimdTiers(const std::vector<SimdTier>& tiers, BenchImages* images,
+                     const std::vector<BenchCase>& cases, VerifyResults* results) {
+    std::vector<std::unique_ptr<RenderScriptToolkit>> toolkits;
+    for (SimdTier tier : tiers) {
+        toolkits.push_back(std::make_unique<RenderScriptToolkit>(1, tier));
+    }
+    for (const BenchCase& benchCase : cases) {
+        const std::vector<uint8_t> scalar = runForOutputs(benchCase, images, toolkits[0].get());
+        std::vector<uint8_t> lowestSimd;
+        for (size_t i = 1; i < toolkits.size(); i++) {
+            const std::vector<uint8_t> outputs =
+                    runForOutputs(benchCase, images, toolkits[i].get());
+            const std::string what = describe(benchCase) + " on " + simdTierName(tiers[i]);
+            results->record("simd_tier_vs_scalar", what,
+                            compareOutputs(outputs, scalar, scalarTolerance(benchCase.op)));
+            if (i == 1) {
+                lowestSimd = outputs;
+            } else {
+                results->record("simd_tier_vs_" + std::string(simdTierName(tiers[1])), what,
+                                compareOutputs(outputs, lowestSimd, 0));
+            }
+        }
+    }
+}
+
+/**
+ * Runs each case on one thread, then on the threads with each scheduler. The tiling must not
+ * change the results.
+ */
+void verifyThreads(int threads, BenchImages* images, const std::vector<BenchCase>& cases,
+                   VerifyResults* results) {
+    RenderScriptToolkit single(1);
+    RenderScriptToolkit pool(threads);
+    for (const BenchCase& benchCase : cases) {
+        const std::vector<uint8_t> expected = runForOutputs(benchCase, images, &single);
+        for (const auto& s : kSchedulers) {
+            pool.setScheduler(s.scheduler);
+            results->record("threads",
+                            describe(benchCase) + " with " + std::to_string(threads) +
+                                    " threads and the " + s.name + " scheduler",
+                            compareOutputs(runForOutputs(benchCase, images, &pool), expected, 0));
+        }
+    }
+}
+
+/**
+ * An image wide enough for its RGBA rows to be split into several tiles, see Task::setTiling().
+ */
+const ImageSize kWideVerifySize = {4800, 120};
+
+/**
+ * The number of times --verify repeats each call with tile autotuning, which sizes the tiles of
+ * a call from the timings of the previous ones.
+ */
+constexpr int kAutotunedRepeats = 8;
+
+/**
+ * Returns the value of the parameter of the case, or an empty string if it doesn't have it.
+ */
+std::string paramValue(const BenchCase& benchCase, const std::string& name) {
+    for (const auto& param : benchCase.params) {
+        if (param.name == name) {
+            return param.value;
+        }
+    }
+    return "";
+}
+
+/**
+ * Whether the case is one of those whose SIMD kernels stop short of the end of a tile and leave
+ * the last cells to the generic code, which rounds differently. Only the largest blur is kept.
+ */
+bool isSensitiveToTileEdges(const BenchCase& benchCase) {
+    if (paramValue(benchCase, "vectorSize") != "4") {
+        return false;
+    }
+    if (benchCase.op == "blur") {
+        return paramValue(benchCase, "radius") == "25";
+    }
+    return benchCase.op == "convolve3x3" || benchCase.op == "convolve5x5";
+}
+
+/**
+ * Runs the cases of the ops that are sensitive to where the tiles end on an image whose rows are
+ * split. The results must not depend on the number of threads, the scheduler, the tuning
+ * profile, or the timings measured by the tile autotuning, none of which may move the splits.
+ */
+void verifyTiling(const std::vector<std::string>& ops, int threads, VerifyResults* results) {
+    BenchImages images(kWideVerifySize);
+    std::vector<BenchCase> cases = makeBenchCases(&images, ops);
+    cases.erase(std::remove_if(cases.begin(), cases.end(),
+                               [](const BenchCase& c) { return !isSensitiveToTileEdges(c); }),
+                cases.end());
+    if (cases.empty()) {
+        return;
+    }
+    fprintf(stderr, "%s: %zu cases with split rows\n", kWideVerifySize.name().c_str(),
+            cases.size());
+
+    RenderScriptToolkit single(1);
+    std::vector<std::unique_ptr<RenderScriptToolkit>> pools;
+    for (int n : {2, threads}) {
+        if (pools.empty() || pools.back()->getNumberOfThreads() != n) {
+            pools.push_back(std::make_unique<RenderScriptToolkit>(n));
+        }
+    }
+    RenderScriptToolkit tuned(threads);
+    RenderScriptToolkit autotuned(threads);
+    autotuned.enableTileAutotuning(true);
+    for (const BenchCase& benchCase : cases) {
+        const std::string what = describe(benchCase);
+        const std::vector<uint8_t> expected = runForOutputs(benchCase, &images, &single);
+        for (const auto& pool : pools) {
+            for (const auto& s : kSchedulers) {
+                pool->setScheduler(s.scheduler);
+                results->record(
+                        "tiling",
+                        what + " with " + std::to_string(pool->getNumberOfThreads()) +
+                                " threads and the " + s.name + " scheduler",
+                        compareOutputs(runForOutputs(benchCase, &images, pool.get()), expected,
+                                       0));
+            }
+        }
+
+        // Tiles of several rows, which must not keep the rows whole.
+        RenderScriptToolkit::Tuning tuning;
+        tuning.name = benchCase.op;
+        tuning.pixels = benchCase.pixels;
+        tuning.pixelsPerTile = kWideVerifySize.width * 4;
+        tuned.setTuning(tuning);
+        results->record("tiling",
+                        what + " with a profile of " + std::to_string(tuning.pixelsPerTile) +
+                                " pixels per tile",
+                        compareOutputs(runForOutputs(benchCase, &images, &tuned), expected, 0));
+
+        std::string failure;
+        for (int i = 0; i < kAutotunedRepeats && failure.empty(); i++) {
+            failure = compareOutputs(runForOutputs(benchCase, &images, &autotuned), expected, 0);
+            if (!failure.empty()) {
+                failure = "call " + std::to_string(i + 1) + ": " + failure;
+            }
+        }
+        results->record("tiling", what + " repeated with tile autotuning", failure);
+    }
+}
+
+/**
+ * Checks the asynchronous, batched, stopped, and prioritized calls against the same calls made
+ * synchronously, with images of the size.
+ */
+void verifyCalls(ImageSize size, int threads, VerifyResults* results) {
+    using TaskHandle = RenderScriptToolkit::TaskHandle;
+    using TaskOptions = RenderScriptToolkit::TaskOptions;
+    using TaskStatus = RenderScriptToolkit::TaskStatus;
+    using Priority = RenderScriptToolkit::Priority;
+
+    BenchImages images(size);
+    const uint8_t* in = images.input();
+    const size_t sizeX = size.width;
+    const size_t sizeY = size.height;
+    const std::string name = size.name();
+    const size_t bytes = size.pixels() * 4 + kVerifyPadding;
+    RenderScriptToolkit toolkit(threads);
+    auto blur = [&](uint8_t* out, const TaskOptions* options) {
+        return toolkit.blur(in, out, sizeX, sizeY, 4, 5, nullptr, options);
+    };
+    std::vector<uint8_t> expectedBlur(bytes, 0);
+    blur(expectedBlur.data(), nullptr);
+
+    // Each async variant must write what the sync method does, and call the callback once.
+    auto checkAsync = [&](const std::string& op, const std::function<void(uint8_t*)>& call,
+                          const std::function<TaskHandle(uint8_t*, std::function<void()>)>& start) {
+        std::vector<uint8_t> expected(bytes, 0);
+        std::vector<uint8_t> actual(bytes, 0);
+        call(expected.data());
+        std::atomic<int> callbacks{0};
+        TaskHandle handle = start(actual.data(), [&callbacks]() { callbacks++; });
+        std::string failure = compareStatus(handle.wait(), TaskStatus::COMPLETE);
+        if (failure.empty() && callbacks != 1) {
+            failure = "the callback was called " + std::to_string(callbacks) + " times";
+        }
+        if (failure.empty()) {
+            failure = compareOutputs(actual, expected, 0);
+        }
+        results->record("async", op + " " + name, failure);
+    };
+    checkAsync(
+            "blur", [&](uint8_t* out) { blur(out, nullptr); },
+            [&](uint8_t* out, std::function<void()> callback) {
+                return toolkit.blurAsync(in, out, sizeX, sizeY, 4, 5, nullptr, std::move(callback));
+            });
+    // Its threads each count into their own histogram, which finish() adds up.
+    checkAsync(
+            "histogram",
+            [&](uint8_t* out) {
+                toolkit.histogram(in, reinterpret_cast<int32_t*>(out), sizeX, sizeY, 4);
+            },
+            [&](uint8_t* out, std::function<void()> callback) {
+                return toolkit.histogramAsync(in, reinterpret_cast<int32_t*>(out), sizeX, sizeY, 4,
+                                              nullptr, std::move(callback));
+            });
+    const size_t halfX = std::max<size_t>(1, sizeX / 2);
+    const size_t halfY = std::max<size_t>(1, sizeY / 2);
+    checkAsync(
+            "resize",
+            [&](uint8_t* out) { toolkit.resize(in, out, sizeX, sizeY, 4, halfX, halfY); },
+            [&](uint8_t* out, std::function<void()> callback) {
+                return toolkit.resizeAsync(in, out, sizeX, sizeY, 4, halfX, halfY, nullptr,
+                                           std::move(callback));
+            });
+
+    // A batch must write what one call per job does. The jobs differ in size.
+    const size_t jobSizes[][2] = {{sizeX, sizeY}, {halfX, sizeY}, {sizeX, halfY}, {1, 1}};
+    constexpr size_t kJobs = std::size(jobSizes);
+    std::vector<std::vector<uint8_t>> expected(kJobs, std::vector<uint8_t>(bytes, 0));
+    std::vector<std::vector<uint8_t>> actual(kJobs, std::vector<uint8_t>(bytes, 0));
+    std::vector<RenderScriptToolkit::BlurJob> blurJobs;
+    for (size_t i = 0; i < kJobs; i++) {
+        toolkit.blur(in, expected[i].data(), jobSizes[i][0], jobSizes[i][1], 4, 3);
+        blurJobs.push_back({in, actual[i].data(), jobSizes[i][0], jobSizes[i][1]});
+    }
+    std::string failure =
+            compareStatus(toolkit.blurBatch(blurJobs.data(), kJobs, 4, 3), TaskStatus::COMPLETE);
+    for (size_t i = 0; i < kJobs && failure.empty(); i++) {
+        failure = compareOutputs(actual[i], expected[i], 0);
+    }
+    results->record("batch", "blurBatch " + name, failure);
+    std::vector<RenderScriptToolkit::ResizeJob> resizeJobs;
+    for (size_t i = 0; i < kJobs; i++) {
+        std::fill(expected[i].begin(), expected[i].end(), 0);
+        std::fill(actual[i].begin(), actual[i].end(), 0);
+        toolkit.resize(in, expected[i].data(), sizeX, sizeY, 4, jobSizes[i][0], jobSizes[i][1]);
+        resizeJobs.push_back(
+                {in, actual[i].data(), sizeX, sizeY, jobSizes[i][0], jobSizes[i][1]});
+    }
+    failure = compareStatus(toolkit.resizeBatch(resizeJobs.data(), kJobs, 4),
+                            TaskStatus::COMPLETE);
+    for (size_t i = 0; i < kJobs && failure.empty(); i++) {
+        failure = compareOutputs(actual[i], expected[i], 0);
+    }
+    results->record("batch", "resizeBatch " + name, failure);
+
+    // A stopped call must say so. A histogram, which is only written at the end, must be left
+    // untouched.
+    RenderScriptToolkit::CancellationToken token;
+    TaskOptions cancellable;
+    cancellable.cancellationToken = &token;
+    token.cancel();
+    std::vector<uint8_t> out(bytes, 0);
+    results->record("status", "cancelled blur " + name,
+                    compareStatus(blur(out.data(), &cancellable), TaskStatus::CANCELLED));
+    results->record("status", "cancelled blurBatch " + name,
+                    compareStatus(toolkit.blurBatch(blurJobs.data(), kJobs, 4, 3, &cancellable),
+                                  TaskStatus::CANCELLED));
+    std::atomic<int> callbacks{0};
+    failure = compareStatus(toolkit.blurAsync(in, out.data(), sizeX, sizeY, 4, 5, nullptr,
+                                              [&callbacks]() { callbacks++; }, &cancellable)
+                                    .wait(),
+                            TaskStatus::CANCELLED);
+    if (failure.empty() && callbacks != 1) {
+        failure = "the callback was called " + std::to_string(callbacks) + " times";
+    }
+    results->record("status", "cancelled blurAsync " + name, failure);
+    std::vector<uint8_t> histogram(256 * 4 * sizeof(int32_t), 0xff);
+    const std::vector<uint8_t> untouched = histogram;
+    failure = compareStatus(toolkit.histogram(in, reinterpret_cast<int32_t*>(histogram.data()),
+                                              sizeX, sizeY, 4, nullptr, &cancellable),
+                            TaskStatus::CANCELLED);
+    if (failure.empty()) {
+        failure = compareOutputs(histogram, untouched, 0);
+    }
+    results->record("status", "cancelled histogram " + name, failure);
+    token.reset();
+    failure = compareStatus(blur(out.data(), &cancellable), TaskStatus::COMPLETE);
+    if (failure.empty()) {
+        failure = compareOutputs(out, expectedBlur, 0);
+    }
+    results->record("status", "blur with a reset token " + name, failure);
+    TaskOptions late;
+    late.deadline = std::chrono::steady_clock::now();
+    results->record("status", "blur past its deadline " + name,
+                    compareStatus(blur(out.data(), &late), TaskStatus::DEADLINE_EXCEEDED));
+    results->record("status", "blur with radius 0 " + name,
+                    compareStatus(toolkit.blur(in, out.data(), sizeX, sizeY, 4, 0),
+                                  TaskStatus::INVALID_ARGUMENTS));
+    results->record("status", "blurAsync with radius 0 " + name,
+                    compareStatus(toolkit.blurAsync(in, out.data(), sizeX, sizeY, 4, 0).wait(),
+                                  TaskStatus::INVALID_ARGUMENTS));
+
+    // The priorities change the order in which the tiles are processed, not the results. A
+    // background call and calls of each priority from two threads share the pool.
+    std::vector<uint8_t> expectedResize(bytes, 0);
+    toolkit.resize(in, expectedResize.data(), sizeX, sizeY, 4, halfX, halfY);
+    for (Priority priority : {Priority::BACKGROUND, Priority::NORMAL, Priority::INTERACTIVE}) {
+        TaskOptions background;
+        background.priority = Priority::BACKGROUND;
+        TaskOptions urgent;
+        urgent.priority = priority;
+        std::vector<uint8_t> resized(bytes, 0);
+        std::vector<uint8_t> blurred(bytes, 0);
+        std::vector<uint8_t> blurredByOther(bytes, 0);
+        TaskHandle handle = toolkit.resizeAsync(in, resized.data(), sizeX, sizeY, 4, halfX, halfY,
+                                                nullptr, nullptr, &background);
+        std::thread other([&]() { blur(blurredByOther.data(), &urgent); });
+        blur(blurred.data(), &urgent);
+        other.join();
+        handle.wait();
+        failure = compareOutputs(resized, expectedResize, 0);
+        if (failure.empty()) {
+            failure = compareOutputs(blurred, expectedBlur, 0);
+        }
+        if (failure.empty()) {
+            failure = compareOutputs(blurredByOther, expectedBlur, 0);
+        }
+        results->record("priority",
+                        "blur of priority " + std::to_string(static_cast<int>(priority)) +
+                                " during a background resize " + name,
+                        failure);
+    }
+}
+
+/**
+ * Checks that the cases compute the same results with every SIMD tier, number of threads, and
+ * scheduler, and that the other kinds of calls agree with the synchronous ones. Returns false if
+ * any check failed.
+ */
+bool runVerify(const Options& options, JsonWriter* json, FILE* output) {
+    // Enough threads to split the tiles, even on a machine with few processors.
+    const int threads = options.threads > 0
+                                ? options.threads
+                                : std::max(4, RenderScriptToolkit::defaultNumberOfThreads());
+    const SimdTier best = RenderScriptToolkit(1).getSimdTier();
+    const std::vector<SimdTier> tiers = tiersToVerify(best);
+    json->member("mode", "verify");
+    json->member("threads", threads);
+    json->key("simd_tiers");
+    json->beginArray();
+    for (SimdTier tier : tiers) {
+        json->value(simdTierName(tier));
+    }
+    json->endArray();
+    json->key("failures");
+    json->beginArray();
+    VerifyResults results(json);
+    for (const ImageSize& size : options.sizes) {
+        BenchImages images(size);
+        const std::vector<BenchCase> cases = makeBenchCases(&images, options.ops);
+        fprintf(stderr, "%s: %zu cases\n", size.name().c_str(), cases.size());
+        verifySimdTiers(tiers, &images, cases, &results);
+        verifyThreads(threads, &images, cases, &results);
+        verifyCalls(size, threads, &results);
+        fflush(output);
+    }
+    verifyTiling(options.ops, threads, &results);
+    json->endArray();
+    json->key("checks");
+    results.writeSummary();
+    json->member("passed", results.allPassed());
+    return results.allPassed();
+}
+
+int run(const Options& options) {
+    FILE* output = stdout;
+    if (!options.outputPath.empty()) {
+        output = fopen(options.outputPath.c_str(), "w");
+        if (output == nullptr) {
+            fprintf(stderr, "Can't open %s: %s\n", options.outputPath.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+
+    JsonWriter json(output);
+    json.beginObject();
+    json.member("benchmark", "toolkit_bench");
+    bool succeeded = true;
+    if (options.verify) {
+        succeeded = runVerify(options, &json, output);
+    } else if (!options.autotunePath.empty()) {
+        succeeded = runAutotune(options, &json, output);
+    } else if (options.threadSweep > 0) {
+        runThreadSweep(options, &json, output);
+    } else if (options.waitPolicySweep) {
+        runWaitPolicySweep(options, &json, output);
+    } else {
+        runThroughput(options, &json, output);
+    }
+    json.endObject();
+
+    if (output != stdout) {
+        fclose(output);
+    }
+    return succeeded ? 0 : 1;
+}
+
+}  // namespace
+}  // namespace bench
+}  // namespace renderscript
+
+int main(int argc, char** argv) {
+    renderscript::bench::Options options;
+    if (!renderscript::bench::parseOptions(argc, argv, &options)) {
+        return 2;
+    }
+    return renderscript::bench::run(options);
+}
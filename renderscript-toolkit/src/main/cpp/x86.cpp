@@ -378,7 +378,7 @@ void rsdIntrinsicBlurHFU1_K(void *dst,
     const __m128i Mu8 = _mm_set_epi32(0xffffffff, 0xffffffff, 0xffffffff, 0x0c080400);
     const float *pi;
     __m128 pf, g0, g1, g2, g3, gx, p0, p1;
-    __m128i o;
+    __m128i o, q0, q1;
     int r;
 
     for (; x1 < x2; x1+=4) {
@@ -392,15 +392,17 @@ void rsdIntrinsicBlurHFU1_K(void *dst,
             gx = _mm_loadu_ps((const float *)gptr + r);
             p0 = _mm_loadu_ps(pi + r);
             p1 = _mm_loadu_ps(pi + r + 4);
+            q0 = _mm_castps_si128(p0);
+            q1 = _mm_castps_si128(p1);
 
             g0 = _mm_shuffle_ps(gx, gx, _MM_SHUFFLE(0, 0, 0, 0));
             pf = _mm_add_ps(pf, _mm_mul_ps(g0, p0));
             g1 = _mm_shuffle_ps(gx, gx, _MM_SHUFFLE(1, 1, 1, 1));
-            pf = _mm_add_ps(pf, _mm_mul_ps(g1, _mm_alignr_epi8(p1, p0, 4)));
+            pf = _mm_add_ps(pf, _mm_mul_ps(g1, _mm_castsi128_ps(_mm_alignr_epi8(q1, q0, 4))));
             g2 = _mm_shuffle_ps(gx, gx, _MM_SHUFFLE(2, 2, 2, 2));
-            pf = _mm_add_ps(pf, _mm_mul_ps(g2, _mm_alignr_epi8(p1, p0, 8)));
+            pf = _mm_add_ps(pf, _mm_mul_ps(g2, _mm_castsi128_ps(_mm_alignr_epi8(q1, q0, 8))));
             g3 = _mm_shuffle_ps(gx, gx, _MM_SHUFFLE(3, 3, 3, 3));
-            pf = _mm_add_ps(pf, _mm_mul_ps(g3, _mm_alignr_epi8(p1, p0, 12)));
+            pf = _mm_add_ps(pf, _mm_mul_ps(g3, _mm_castsi128_ps(_mm_alignr_epi8(q1, q0, 12))));
         }
 
         o = _mm_cvtps_epi32(pf);
@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* AVX2 versions of some of the kernels found in x86.cpp. This file is compiled with -mavx2.
+ * The callers must check cpuSupportsAvx2() before calling any of these functions.
+ *
+ * Unless stated otherwise, the kernels compute the same values as their SSSE3 counterparts but
+ * process twice as many pixels per instruction.
+ */
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+namespace renderscript {
+
+/* Zero extends the four RGBA pixels found at p into 16-bit lanes. The 128-bit low lane
+ * contains pixels 0 and 1, the high lane pixels 2 and 3.
+ */
+static inline __m256i expandFourPixels(const void *p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+/* Broadcasts the pair of 16-bit coefficients (coef[0], coef[1]) in all 32-bit lanes, the layout
+ * expected by _mm256_madd_epi16.
+ */
+static inline __m256i coefficientPair(const short *coef) {
+    return _mm256_set1_epi32((int32_t)(((uint32_t)(uint16_t)coef[1] << 16) | (uint16_t)coef[0]));
+}
+
+/* Multiplies the taps a and b by their coefficients and adds the result to the accumulators.
+ * sumLo accumulates the pixels 0 and 2 of the group, sumHi the pixels 1 and 3.
+ */
+static inline void accumulateTaps(__m256i &sumLo, __m256i &sumHi, __m256i a, __m256i b,
+                                  __m256i coef) {
+    sumLo = _mm256_add_epi32(sumLo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), coef));
+    sumHi = _mm256_add_epi32(sumHi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), coef));
+}
+
+/* Scales down the sums of accumulateTaps() and stores the resulting four RGBA pixels. */
+static inline void storeConvolvedPixels(void *dst, __m256i sumLo, __m256i sumHi) {
+    sumLo = _mm256_srai_epi32(sumLo, 8);
+    sumHi = _mm256_srai_epi32(sumHi, 8);
+    // Lane 0 holds pixels 0 & 1, lane 1 holds pixels 2 & 3.
+    __m256i o = _mm256_packus_epi32(sumLo, sumHi);
+    o = _mm256_packus_epi16(o, o);
+    o = _mm256_permute4x64_epi64(o, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(o));
+}
+
+/* Convolves count groups of four RGBA pixels using a size x size matrix. rows[i] points to the
+ * first pixel of row i, i.e. size / 2 pixels to the left of the first pixel to compute.
+ * The coefficients are in the same fixed point format as the SSSE3 kernels.
+ */
+template <int size>
+static inline void convolve(void *dst, const uint8_t *rows[size], const short *coef,
+                            uint32_t count) {
+    constexpr int kTaps = size * size;
+    __m256i c[(kTaps + 1) / 2];
+    for (int t = 0; t < kTaps; t += 2) {
+        // The last pair has only one valid coefficient. Its second tap will be zero.
+        const short pair[2] = {coef[t], t + 1 < kTaps ? coef[t + 1] : (short)0};
+        c[t / 2] = coefficientPair(pair);
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        __m256i sumLo = _mm256_setzero_si256();
+        __m256i sumHi = _mm256_setzero_si256();
+        for (int t = 0; t < kTaps; t += 2) {
+            __m256i a = expandFourPixels(rows[t / size] + (t % size) * 4);
+            __m256i b = t + 1 < kTaps
+                    ? expandFourPixels(rows[(t + 1) / size] + ((t + 1) % size) * 4)
+                    : _mm256_setzero_si256();
+            accumulateTaps(sumLo, sumHi, a, b, c[t / 2]);
+        }
+        storeConvolvedPixels(dst, sumLo, sumHi);
+
+        for (int r = 0; r < size; r++) {
+            rows[r] += 16;
+        }
+        dst = (char *)dst + 16;
+    }
+}
+
+/* Like rsdIntrinsicConvolve3x3_K but count is the number of groups of four pixels. */
+extern "C" void rsdIntrinsicConvolve3x3_avx2_K(void *dst, const void *y0, const void *y1,
+                                               const void *y2, const short *coef,
+                                               uint32_t count) {
+    const uint8_t *rows[3] = {(const uint8_t *)y0, (const uint8_t *)y1, (const uint8_t *)y2};
+    convolve<3>(dst, rows, coef, count);
+}
+
+/* Same arguments as rsdIntrinsicConvolve5x5_K: count is the number of groups of four pixels. */
+extern "C" void rsdIntrinsicConvolve5x5_avx2_K(void *dst, const void *y0, const void *y1,
+                                               const void *y2, const void *y3, const void *y4,
+                                               const short *coef, uint32_t count) {
+    const uint8_t *rows[5] = {(const uint8_t *)y0, (const uint8_t *)y1, (const uint8_t *)y2,
+                              (const uint8_t *)y3, (const uint8_t *)y4};
+    convolve<5>(dst, rows, coef, count);
+}
+
+/* Same arguments as rsdIntrinsicBlurVFU4_K. x2 - x1 must be even.
+ *
+ * The blur kernels multiply and add separately, in the order of the SSSE3 ones, rather than with
+ * FMA, whose single rounding would make some pixels differ by 1 from the other tiers.
+ */
+void rsdIntrinsicBlurVFU4_avx2_K(void *dst, const void *pin, int stride, const void *gptr,
+                                 int rct, int x1, int x2) {
+    const float *g = (const float *)gptr;
+    float *out = (float *)dst;
+
+    for (; x1 + 4 <= x2; x1 += 4) {
+        const uint8_t *pi = (const uint8_t *)pin + (x1 << 2);
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        for (int r = 0; r < rct; ++r) {
+            __m128i p = _mm_loadu_si128((const __m128i *)pi);
+            __m256 w = _mm256_broadcast_ss(g + r);
+            __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(p));
+            __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(p, 8)));
+            sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(f0, w));
+            sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(f1, w));
+            pi += stride;
+        }
+        _mm256_storeu_ps(out, sum0);
+        _mm256_storeu_ps(out + 8, sum1);
+        out += 16;
+    }
+
+    for (; x1 < x2; x1 += 2) {
+        const uint8_t *pi = (const uint8_t *)pin + (x1 << 2);
+        __m256 sum = _mm256_setzero_ps();
+        for (int r = 0; r < rct; ++r) {
+            __m128i p = _mm_loadl_epi64((const __m128i *)pi);
+            __m256 w = _mm256_broadcast_ss(g + r);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(p)), w));
+            pi += stride;
+        }
+        _mm256_storeu_ps(out, sum);
+        out += 8;
+    }
+}
+
+/* Same arguments as rsdIntrinsicBlurHFU4_K. */
+void rsdIntrinsicBlurHFU4_avx2_K(void *dst, const void *pin, const void *gptr, int rct, int x1,
+                                 int x2) {
+    const __m256i Mpixels = _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5);
+    const float *g = (const float *)gptr;
+    uint8_t *out = (uint8_t *)dst;
+
+    for (; x1 + 4 <= x2; x1 += 4) {
+        const float *pi = (const float *)pin + (x1 << 2);
+        // sum0 accumulates pixels 0 & 1, sum1 pixels 2 & 3.
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        for (int r = 0; r < rct; ++r) {
+            __m256 w = _mm256_broadcast_ss(g + r);
+            sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(pi + (r << 2)), w));
+            sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(pi + (r << 2) + 8), w));
+        }
+        // After packing, lane 0 holds pixels 0 & 2, lane 1 holds pixels 1 & 3.
+        __m256i o = _mm256_packus_epi32(_mm256_cvtps_epi32(sum0), _mm256_cvtps_epi32(sum1));
+        o = _mm256_packus_epi16(o, o);
+        o = _mm256_permutevar8x32_epi32(o, Mpixels);
+        _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(o));
+        out += 16;
+    }
+
+    for (; x1 < x2; ++x1) {
+        const float *pi = (const float *)pin + (x1 << 2);
+        __m128 sum = _mm_setzero_ps();
+        for (int r = 0; r < rct; ++r) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pi + (r << 2)), _mm_broadcast_ss(g + r)));
+        }
+        __m128i o = _mm_packus_epi32(_mm_cvtps_epi32(sum), _mm_setzero_si128());
+        o = _mm_packus_epi16(o, o);
+        *(int32_t *)out = _mm_cvtsi128_si32(o);
+        out += 4;
+    }
+}
+
+/* Applies a 4x4 color matrix and an add vector to count groups of four RGBA pixels.
+ *
+ * Unlike the SSSE3 color matrix kernels, this computes in floating point exactly like the
+ * generic C++ code. coef and add should be the coefficients scaled for unsigned byte output,
+ * i.e. ColorMatrixTask::mTmpFp and mTmpFpa. If zeroInputAlpha is true, the alpha of the input
+ * is treated as 0, as is done for 3 channel inputs.
+ */
+void rsdIntrinsicColorMatrix4x4_avx2_K(void *dst, const void *src, const float *coef,
+                                       const float *add, uint32_t count, bool zeroInputAlpha) {
+    const __m256i Mpixels = _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5);
+    const __m256 inputMask = _mm256_castsi256_ps(
+            zeroInputAlpha ? _mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0)
+                           : _mm256_set1_epi32(-1));
+    const __m256 c0 = _mm256_broadcast_ps((const __m128 *)(coef + 0));
+    const __m256 c1 = _mm256_broadcast_ps((const __m128 *)(coef + 4));
+    const __m256 c2 = _mm256_broadcast_ps((const __m128 *)(coef + 8));
+    const __m256 c3 = _mm256_broadcast_ps((const __m128 *)(coef + 12));
+    const __m256 a = _mm256_broadcast_ps((const __m128 *)add);
+    const __m256 lo = _mm256_setzero_ps();
+    const __m256 hi = _mm256_set1_ps(255.5f);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        __m128i p = _mm_loadu_si128((const __m128i *)src);
+        __m256 f[2] = {_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(p)),
+                       _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(p, 8)))};
+        __m256i o[2];
+        for (int j = 0; j < 2; j++) {
+            // Same order of operations as the generic code, so we get the same results.
+            __m256 v = _mm256_and_ps(f[j], inputMask);
+            __m256 sum = _mm256_mul_ps(_mm256_permute_ps(v, 0x00), c0);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_permute_ps(v, 0x55), c1));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_permute_ps(v, 0xAA), c2));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_permute_ps(v, 0xFF), c3));
+            sum = _mm256_add_ps(sum, a);
+            sum = _mm256_min_ps(_mm256_max_ps(sum, lo), hi);
+            o[j] = _mm256_cvttps_epi32(sum);
+        }
+        // After packing, lane 0 holds pixels 0 & 2, lane 1 holds pixels 1 & 3.
+        __m256i packed = _mm256_packus_epi32(o[0], o[1]);
+        packed = _mm256_packus_epi16(packed, packed);
+        packed = _mm256_permutevar8x32_epi32(packed, Mpixels);
+        _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(packed));
+
+        src = (const char *)src + 16;
+        dst = (char *)dst + 16;
+    }
+}
+
+/* The blend kernels below take the same arguments as the SSSE3 ones: count8 is the number of
+ * groups of eight pixels. The per pixel math is identical to the SSSE3 versions.
+ */
+
+/* Returns the 16-bit alpha of each pixel of v, repeated in the four channels. */
+static inline __m256i alpha16(__m256i v) {
+    return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0xFF), 0xFF);
+}
+
+static inline __m256i unpackLo(__m256i v) {
+    return _mm256_unpacklo_epi8(v, _mm256_setzero_si256());
+}
+
+static inline __m256i unpackHi(__m256i v) {
+    return _mm256_unpackhi_epi8(v, _mm256_setzero_si256());
+}
+
+/* Runs op on the 16-bit expansion of each group of eight pixels and stores the packed result.
+ * op receives (ins, outs) and returns the blended 16-bit value.
+ */
+template <typename Op>
+static inline void blend16(void *dst, const void *src, uint32_t count8, Op op) {
+    for (uint32_t i = 0; i < count8; ++i) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)src);
+        __m256i out = _mm256_loadu_si256((const __m256i *)dst);
+        __m256i t0 = op(unpackLo(in), unpackLo(out));
+        __m256i t1 = op(unpackHi(in), unpackHi(out));
+        _mm256_storeu_si256((__m256i *)dst, _mm256_packus_epi16(t0, t1));
+
+        src = (const __m256i *)src + 1;
+        dst = (__m256i *)dst + 1;
+    }
+}
+
+void rsdIntrinsicBlendSrcOver_avx2_K(void *dst, const void *src, uint32_t count8) {
+    const __m256i all1s = _mm256_set1_epi16(255);
+    blend16(dst, src, count8, [all1s](__m256i ins, __m256i outs) {
+        __m256i t = _mm256_mullo_epi16(outs, _mm256_sub_epi16(all1s, alpha16(ins)));
+        return _mm256_add_epi16(_mm256_srli_epi16(t, 8), ins);
+    });
+}
+
+void rsdIntrinsicBlendDstOver_avx2_K(void *dst, const void *src, uint32_t count8) {
+    const __m256i all1s = _mm256_set1_epi16(255);
+    blend16(dst, src, count8, [all1s](__m256i ins, __m256i outs) {
+        __m256i t = _mm256_mullo_epi16(ins, _mm256_sub_epi16(all1s, alpha16(outs)));
+        return _mm256_add_epi16(_mm256_srli_epi16(t, 8), outs);
+    });
+}
+
+void rsdIntrinsicBlendSrcIn_avx2_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, [](__m256i ins, __m256i outs) {
+        return _mm256_srli_epi16(_mm256_mullo_epi16(ins, alpha16(outs)), 8);
+    });
+}
+
+void rsdIntrinsicBlendDstIn_avx2_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, [](__m256i ins, __m256i outs) {
+        return _mm256_srli_epi16(_mm256_mullo_epi16(outs, alpha16(ins)), 8);
+    });
+}
+
+void rsdIntrinsicBlendSrcOut_avx2_K(void *dst, const void *src, uint32_t count8) {
+    const __m256i all1s = _mm256_set1_epi16(255);
+    blend16(dst, src, count8, [all1s](__m256i ins, __m256i outs) {
+        __m256i t = _mm256_mullo_epi16(ins, _mm256_sub_epi16(all1s, alpha16(outs)));
+        return _mm256_srli_epi16(t, 8);
+    });
+}
+
+void rsdIntrinsicBlendDstOut_avx2_K(void *dst, const void *src, uint32_t count8) {
+    const __m256i all1s = _mm256_set1_epi16(255);
+    blend16(dst, src, count8, [all1s](__m256i ins, __m256i outs) {
+        __m256i t = _mm256_mullo_epi16(outs, _mm256_sub_epi16(all1s, alpha16(ins)));
+        return _mm256_srli_epi16(t, 8);
+    });
+}
+
+void rsdIntrinsicBlendSrcAtop_avx2_K(void *dst, const void *src, uint32_t count8) {
+    const __m256i all1s = _mm256_set1_epi16(255);
+    const __m256i M0001 = _mm256_set1_epi32(0xff000000);
+    for (uint32_t i = 0; i < count8; ++i) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)src);
+        __m256i out = _mm256_loadu_si256((const __m256i *)dst);
+        auto op = [all1s](__m256i ins, __m256i outs) {
+            __m256i t = _mm256_mullo_epi16(_mm256_sub_epi16(all1s, alpha16(ins)), outs);
+            t = _mm256_adds_epu16(t, _mm256_mullo_epi16(alpha16(outs), ins));
+            return _mm256_srli_epi16(t, 8);
+        };
+        __m256i t = _mm256_packus_epi16(op(unpackLo(in), unpackLo(out)),
+                                        op(unpackHi(in), unpackHi(out)));
+        // The alpha of the destination is preserved.
+        _mm256_storeu_si256((__m256i *)dst, _mm256_blendv_epi8(t, out, M0001));
+
+        src = (const __m256i *)src + 1;
+        dst = (__m256i *)dst + 1;
+    }
+}
+
+void rsdIntrinsicBlendDstAtop_avx2_K(void *dst, const void *src, uint32_t count8) {
+    const __m256i all1s = _mm256_set1_epi16(255);
+    const __m256i M0001 = _mm256_set1_epi32(0xff000000);
+    for (uint32_t i = 0; i < count8; ++i) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)src);
+        __m256i out = _mm256_loadu_si256((const __m256i *)dst);
+        auto op = [all1s](__m256i ins, __m256i outs) {
+            __m256i t = _mm256_mullo_epi16(_mm256_sub_epi16(all1s, alpha16(outs)), ins);
+            t = _mm256_adds_epu16(t, _mm256_mullo_epi16(alpha16(ins), outs));
+            return _mm256_srli_epi16(t, 8);
+        };
+        __m256i t = _mm256_packus_epi16(op(unpackLo(in), unpackLo(out)),
+                                        op(unpackHi(in), unpackHi(out)));
+        // The alpha of the source is used.
+        _mm256_storeu_si256((__m256i *)dst, _mm256_blendv_epi8(t, in, M0001));
+
+        src = (const __m256i *)src + 1;
+        dst = (__m256i *)dst + 1;
+    }
+}
+
+void rsdIntrinsicBlendXor_avx2_K(void *dst, const void *src, uint32_t count8) {
+    for (uint32_t i = 0; i < count8; ++i) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)src);
+        __m256i out = _mm256_loadu_si256((const __m256i *)dst);
+        _mm256_storeu_si256((__m256i *)dst, _mm256_xor_si256(out, in));
+
+        src = (const __m256i *)src + 1;
+        dst = (__m256i *)dst + 1;
+    }
+}
+
+void rsdIntrinsicBlendMultiply_avx2_K(void *dst, const void *src, uint32_t count8) {
+    blend16(dst, src, count8, [](__m256i ins, __m256i outs) {
+        return _mm256_srli_epi16(_mm256_mullo_epi16(ins, outs), 8);
+    });
+}
+
+void rsdIntrinsicBlendAdd_avx2_K(void *dst, const void *src, uint32_t count8) {
+    for (uint32_t i = 0; i < count8; ++i) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)src);
+        __m256i out = _mm256_loadu_si256((const __m256i *)dst);
+        _mm256_storeu_si256((__m256i *)dst, _mm256_adds_epu8(out, in));
+
+        src = (const __m256i *)src + 1;
+        dst = (__m256i *)dst + 1;
+    }
+}
+
+void rsdIntrinsicBlendSub_avx2_K(void *dst, const void *src, uint32_t count8) {
+    for (uint32_t i = 0; i < count8; ++i) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)src);
+        __m256i out = _mm256_loadu_si256((const __m256i *)dst);
+        _mm256_storeu_si256((__m256i *)dst, _mm256_subs_epu8(out, in));
+
+        src = (const __m256i *)src + 1;
+        dst = (__m256i *)dst + 1;
+    }
+}
+
+}  // namespace renderscript
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* AVX-512 versions of the convolve 5x5 and color matrix kernels. This file is compiled with
+ * -mavx512f -mavx512bw -mavx512vnni. The callers must check cpuSupportsAvx512() before calling
+ * any of these functions.
+ *
+ * The kernels handle groups of eight pixels. The callers use the AVX2 kernels for what's left.
+ */
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+namespace renderscript {
+
+/* Zero extends the eight RGBA pixels found at p into 16-bit lanes. The 128-bit lane i contains
+ * the pixels 2 * i and 2 * i + 1.
+ */
+static inline __m512i expandEightPixels(const void *p) {
+    return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)p));
+}
+
+/* Same arguments as rsdIntrinsicConvolve5x5_K, except that count is the number of groups of
+ * eight pixels. The results are the same as the SSSE3 and AVX2 kernels.
+ *
+ * Each pair of taps is multiplied by its pair of 16-bit coefficients and accumulated in 32 bits
+ * with a single VPDPWSSD.
+ */
+extern "C" void rsdIntrinsicConvolve5x5_avx512_K(void *dst, const void *y0, const void *y1,
+                                                 const void *y2, const void *y3, const void *y4,
+                                                 const short *coef, uint32_t count) {
+    constexpr int kTaps = 25;
+    const uint8_t *rows[5] = {(const uint8_t *)y0, (const uint8_t *)y1, (const uint8_t *)y2,
+                              (const uint8_t *)y3, (const uint8_t *)y4};
+    // After packing, the low 64 bits of the 128-bit lane i hold the pixels 2 * i and 2 * i + 1.
+    const __m512i Mpixels = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+
+    __m512i c[(kTaps + 1) / 2];
+    for (int t = 0; t < kTaps; t += 2) {
+        // The last pair has only one valid coefficient. Its second tap will be zero.
+        uint16_t second = t + 1 < kTaps ? (uint16_t)coef[t + 1] : 0;
+        c[t / 2] = _mm512_set1_epi32((int32_t)(((uint32_t)second << 16) | (uint16_t)coef[t]));
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        // sumLo accumulates the even pixels of the group, sumHi the odd ones.
+        __m512i sumLo = _mm512_setzero_si512();
+        __m512i sumHi = _mm512_setzero_si512();
+        for (int t = 0; t < kTaps; t += 2) {
+            __m512i a = expandEightPixels(rows[t / 5] + (t % 5) * 4);
+            __m512i b = t + 1 < kTaps ? expandEightPixels(rows[(t + 1) / 5] + ((t + 1) % 5) * 4)
+                                      : _mm512_setzero_si512();
+            sumLo = _mm512_dpwssd_epi32(sumLo, _mm512_unpacklo_epi16(a, b), c[t / 2]);
+            sumHi = _mm512_dpwssd_epi32(sumHi, _mm512_unpackhi_epi16(a, b), c[t / 2]);
+        }
+        sumLo = _mm512_srai_epi32(sumLo, 8);
+        sumHi = _mm512_srai_epi32(sumHi, 8);
+        __m512i o = _mm512_packus_epi32(sumLo, sumHi);
+        o = _mm512_packus_epi16(o, o);
+        o = _mm512_permutexvar_epi64(Mpixels, o);
+        _mm256_storeu_si256((__m256i *)dst, _mm512_castsi512_si256(o));
+
+        for (int r = 0; r < 5; r++) {
+            rows[r] += 32;
+        }
+        dst = (char *)dst + 32;
+    }
+}
+
+/* Same arguments as rsdIntrinsicColorMatrix4x4_avx2_K, except that count is the number of
+ * groups of eight pixels. The results are the same as the generic C++ code.
+ */
+void rsdIntrinsicColorMatrix4x4_avx512_K(void *dst, const void *src, const float *coef,
+                                         const float *add, uint32_t count, bool zeroInputAlpha) {
+    const __m512i Mpixels = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 0, 4, 8, 12, 1, 5, 9, 13);
+    const __mmask16 inputMask = zeroInputAlpha ? 0x7777 : 0xffff;
+    const __m512 c0 = _mm512_broadcast_f32x4(_mm_loadu_ps(coef + 0));
+    const __m512 c1 = _mm512_broadcast_f32x4(_mm_loadu_ps(coef + 4));
+    const __m512 c2 = _mm512_broadcast_f32x4(_mm_loadu_ps(coef + 8));
+    const __m512 c3 = _mm512_broadcast_f32x4(_mm_loadu_ps(coef + 12));
+    const __m512 a = _mm512_broadcast_f32x4(_mm_loadu_ps(add));
+    const __m512 lo = _mm512_setzero_ps();
+    const __m512 hi = _mm512_set1_ps(255.5f);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)src);
+        __m512i o[2];
+        for (int j = 0; j < 2; j++) {
+            __m128i half = j == 0 ? _mm256_castsi256_si128(p) : _mm256_extracti128_si256(p, 1);
+            __m512 v = _mm512_maskz_cvtepi32_ps(inputMask, _mm512_cvtepu8_epi32(half));
+            // Same order of operations as the generic code, so we get the same results.
+            __m512 sum = _mm512_mul_ps(_mm512_permute_ps(v, 0x00), c0);
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_permute_ps(v, 0x55), c1));
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_permute_ps(v, 0xAA), c2));
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_permute_ps(v, 0xFF), c3));
+            sum = _mm512_add_ps(sum, a);
+            sum = _mm512_min_ps(_mm512_max_ps(sum, lo), hi);
+            o[j] = _mm512_cvttps_epi32(sum);
+        }
+        // After packing, the 128-bit lane i holds the pixels i and i + 4.
+        __m512i packed = _mm512_packus_epi32(o[0], o[1]);
+        packed = _mm512_packus_epi16(packed, packed);
+        packed = _mm512_permutexvar_epi32(Mpixels, packed);
+        _mm256_storeu_si256((__m256i *)dst, _mm512_castsi512_si256(packed));
+
+        src = (const char *)src + 32;
+        dst = (char *)dst + 32;
+    }
+}
+
+}  // namespace renderscript
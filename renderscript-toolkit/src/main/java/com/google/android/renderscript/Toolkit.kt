@@ -36,8 +36,8 @@ private const val externalName = "RenderScript Toolkit"
  * The Toolkit creates a thread pool that's used for processing the functions. The threads live
  * for the duration of the application. They can be destroyed by calling the method shutdown().
  *
- * This library is thread safe. You can call methods from different poolThreads. The functions will
- * execute sequentially.
+ * This library is thread safe. You can call methods from different threads. The calls made at the
+ * same time share the pool threads, each calling thread also working on its own call.
  *
  * A native C++ version of this Toolkit is available. Check the RenderScriptToolkit.h file in the
  * cpp directory.